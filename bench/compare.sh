@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+#
+# pg_consul/bench/compare.sh	Compare the results of run.sh across builds
+#
+# Usage: compare.sh results/baseline.csv results/candidate.csv [...]
+#
+# Prints one row per script, client count, value size and prefix size, with
+# the tps and p99 latency of each build.  Builds after the first also show
+# the change in tps relative to the first.
+
+set -euo pipefail
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 results.csv [results.csv ...]" >&2
+	exit 64
+fi
+
+awk -F, '
+FNR == 1 { nfiles++; next }
+{
+	key = $2 "," $3 "," $4 "," $5
+	if (!(key in seen)) {
+		seen[key] = 1
+		keys[++nkeys] = key
+	}
+	label[nfiles] = $1
+	tps[key, nfiles] = $6
+	p99[key, nfiles] = $8
+}
+END {
+	printf "%-16s %7s %7s %7s", "script", "clients", "value", "prefix"
+	for (f = 1; f <= nfiles; f++) {
+		printf " | %-24s", substr(label[f], 1, 24)
+	}
+	printf "\n"
+	printf "%-16s %7s %7s %7s", "", "", "", ""
+	for (f = 1; f <= nfiles; f++) {
+		printf " | %10s %7s %5s", "tps", "p99 ms", (f > 1 ? "diff" : "")
+	}
+	printf "\n"
+
+	for (k = 1; k <= nkeys; k++) {
+		split(keys[k], c, ",")
+		printf "%-16s %7s %7s %7s", c[1], c[2], c[3], c[4]
+		for (f = 1; f <= nfiles; f++) {
+			if (!((keys[k], f) in tps)) {
+				printf " | %10s %7s %5s", "-", "-", ""
+				continue
+			}
+			diff = ""
+			if (f > 1 && ((keys[k], 1) in tps) && tps[keys[k], 1] > 0) {
+				diff = sprintf("%+.0f%%", 100 * (tps[keys[k], f] - tps[keys[k], 1]) / tps[keys[k], 1])
+			}
+			printf " | %10.1f %7.2f %5s", tps[keys[k], f], p99[keys[k], f], diff
+		}
+		printf "\n"
+	}
+}' "$@"
@@ -0,0 +1,3 @@
+-- One of the :nkeys keys under :prefix, chosen uniformly
+\set i random(1, :nkeys)
+SELECT key, value FROM consul_kv_get(key := CAST(:prefix AS TEXT) || lpad(CAST(:i AS TEXT), 8, '0'));
@@ -0,0 +1,3 @@
+-- Every key under :prefix.  Values are summed so they are decoded, but not
+-- sent to the client.
+SELECT count(*), sum(length(value)) FROM consul_kv_get(key := CAST(:prefix AS TEXT), recurse := TRUE);
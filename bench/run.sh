@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+#
+# pg_consul/bench/run.sh	Measure SQL throughput and latency of pg_consul
+#				with pgbench
+#
+# Runs each pgbench script in this directory against a consul agent, or
+# against playground/consul-mock, for every combination of client count,
+# value size and prefix size, and appends one CSV row per run to
+# results/<label>.csv.  Compare builds with compare.sh.
+#
+# The database is taken from the usual PG* environment variables and needs
+# max_connections above the largest client count.
+
+set -euo pipefail
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+
+agent=127.0.0.1:8500
+mock=0
+clients="1 4 16 64 256 512"
+value_sizes="16 1024 16384"
+prefix_sizes="1 100 1000"
+scripts="kv_get_recurse kv_get_key status_leader status_peers"
+duration=10
+label=$(git -C "$BENCH_DIR" describe --always --dirty 2>/dev/null || echo unknown)
+results="$BENCH_DIR/results"
+
+usage() {
+	cat <<EOF
+Usage: $0 [options]
+  -a host:port   consul agent to benchmark against (default: $agent)
+  -m             start playground/consul-mock on the agent's port instead
+  -c "counts"    pgbench client counts (default: "$clients")
+  -v "sizes"     value sizes in bytes (default: "$value_sizes")
+  -p "sizes"     keys under each prefix (default: "$prefix_sizes")
+  -s "scripts"   scripts to run (default: "$scripts")
+  -T seconds     duration of each run (default: $duration)
+  -l label       name of this build in the results (default: $label)
+  -o dir         directory of results (default: $results)
+EOF
+	exit 64
+}
+
+while getopts "a:mc:v:p:s:T:l:o:h" opt; do
+	case $opt in
+	a) agent=$OPTARG ;;
+	m) mock=1 ;;
+	c) clients=$OPTARG ;;
+	v) value_sizes=$OPTARG ;;
+	p) prefix_sizes=$OPTARG ;;
+	s) scripts=$OPTARG ;;
+	T) duration=$OPTARG ;;
+	l) label=$OPTARG ;;
+	o) results=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+host=${agent%:*}
+port=${agent##*:}
+
+if [ "$mock" = 1 ]; then
+	make -s -C "$BENCH_DIR/../playground" consul-mock
+	"$BENCH_DIR/../playground/consul-mock" -b="$host" -p="$port" >/dev/null 2>&1 &
+	mock_pid=$!
+	trap 'kill $mock_pid 2>/dev/null' EXIT
+	sleep 1
+fi
+
+export PGOPTIONS="${PGOPTIONS:-} -c consul.agent_host=$host -c consul.agent_port=$port"
+psql -qX -c 'CREATE EXTENSION IF NOT EXISTS pg_consul' >/dev/null
+
+# Keys of the kv scripts are bench/v<value size>/p<prefix size>/<00000001...>,
+# written with /v1/txn in batches of at most 64 operations and ~256KiB.
+seed() {
+	local size=$1 keys=$2 prefix=$3
+	local value batch body i
+	value=$(head -c "$size" /dev/zero | tr '\0' x | base64 | tr -d '\n')
+	batch=$((256 * 1024 / (${#value} + 100)))
+	[ "$batch" -lt 1 ] && batch=1
+	[ "$batch" -gt 64 ] && batch=64
+
+	i=1
+	while [ "$i" -le "$keys" ]; do
+		body=""
+		for ((j = 0; j < batch && i <= keys; j++, i++)); do
+			body+="${body:+,}{\"KV\":{\"Verb\":\"set\",\"Key\":\"$(printf '%s%08d' "$prefix" "$i")\",\"Value\":\"$value\"}}"
+		done
+		printf '[%s]' "$body" | curl -sf -X PUT --data-binary @- "http://$agent/v1/txn" >/dev/null
+	done
+}
+
+# Run script with the given clients and pgbench variables, and print
+# "tps,latency avg (ms),latency p99 (ms)"
+run() {
+	local script=$1 nclients=$2
+	shift 2
+	local threads log out tps avg p99
+	threads=$(getconf _NPROCESSORS_ONLN)
+	[ "$nclients" -lt "$threads" ] && threads=$nclients
+
+	log=$(mktemp -d)
+	out=$(cd "$log" && pgbench -n -M prepared -c "$nclients" -j "$threads" -T "$duration" \
+		-f "$BENCH_DIR/$script.sql" --log --log-prefix=txn "$@" 2>&1) || {
+		echo "$out" >&2
+		rm -rf "$log"
+		return 1
+	}
+	tps=$(echo "$out" | awk '/^tps = / { print $3; exit }')
+	avg=$(echo "$out" | awk '/^latency average = / { print $4; exit }')
+	# Column 3 of the transaction log is the latency in microseconds
+	p99=$(cat "$log"/txn.* | awk '{ print $3 }' | sort -n |
+		awk '{ v[NR] = $1 } END { if (NR > 0) { i = int(NR * 0.99); if (i < 1) i = 1; printf "%.3f", v[i] / 1000 } }')
+	rm -rf "$log"
+	echo "$tps,$avg,$p99"
+}
+
+mkdir -p "$results"
+csv="$results/$label.csv"
+[ -f "$csv" ] || echo "label,script,clients,value_size,prefix_size,tps,latency_avg_ms,latency_p99_ms" > "$csv"
+
+for script in $scripts; do
+	case $script in
+	kv_*)
+		for size in $value_sizes; do
+			for keys in $prefix_sizes; do
+				prefix="bench/v$size/p$keys/"
+				seed "$size" "$keys" "$prefix"
+				for n in $clients; do
+					echo "$script clients=$n value_size=$size prefix_size=$keys" >&2
+					echo "$label,$script,$n,$size,$keys,$(run "$script" "$n" -D prefix="$prefix" -D nkeys="$keys")" >> "$csv"
+				done
+			done
+		done
+		;;
+	*)
+		for n in $clients; do
+			echo "$script clients=$n" >&2
+			echo "$label,$script,$n,,,$(run "$script" "$n")" >> "$csv"
+		done
+		;;
+	esac
+done
+
+echo "Results in $csv" >&2
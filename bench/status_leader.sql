@@ -0,0 +1 @@
+SELECT consul_status_leader();
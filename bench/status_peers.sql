@@ -0,0 +1 @@
+SELECT host, port, leader FROM consul_status_peers();
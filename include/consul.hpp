@@ -2,8 +2,15 @@
 #define CONSUL_HPP
 
 #include "consul/agent.hpp"
+#include "consul/agent_pool.hpp"
+#include "consul/json_arena.hpp"
+#include "consul/json_document.hpp"
+#include "consul/json_value.hpp"
 #include "consul/kv_pairs.hpp"
+#include "consul/kv_pairs_view.hpp"
+#include "consul/latency_histogram.hpp"
 #include "consul/peer.hpp"
 #include "consul/peers.hpp"
+#include "consul/query_meta.hpp"
 
 #endif // CONSUL_HPP
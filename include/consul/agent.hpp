@@ -7,8 +7,8 @@
 
 #include "boost/algorithm/string.hpp"
 #include "boost/lexical_cast.hpp"
-#include "json11.hpp"
 
+#include "consul/json_value.hpp"
 #include "consul/kv_pair.hpp"
 
 namespace consul {
@@ -25,6 +25,22 @@ public:
   static constexpr const PortT DEFAULT_PORT_MIN = std::numeric_limits<PortT>::min() + 1;
   static constexpr const PortT DEFAULT_PORT_MAX = std::numeric_limits<PortT>::max();
 
+  // Consistency modes for reads.  DEFAULT reads are forwarded to the leader
+  // but may be stale during a leader election, STALE reads may be answered
+  // by any server and CONSISTENT reads force the leader to verify it is
+  // still the leader before answering.
+  enum class ConsistencyT : char { DEFAULT, STALE, CONSISTENT };
+
+  // The query parameter that selects mode, or nullptr for DEFAULT.
+  static const char* ConsistencyParam(const ConsistencyT mode) noexcept {
+    switch (mode) {
+    case ConsistencyT::STALE:      return "stale";
+    case ConsistencyT::CONSISTENT: return "consistent";
+    case ConsistencyT::DEFAULT:    break;
+    }
+    return nullptr;
+  }
+
   using TimeoutT = std::uint16_t;
   static constexpr const TimeoutT DEFAULT_TIMEOUT_MS = 1000;
   static constexpr const TimeoutT DEFAULT_TIMEOUT_MS_MIN = std::numeric_limits<TimeoutT>::min() + 1;
@@ -35,6 +51,10 @@ public:
   PortT port() const noexcept { return port_; }
   TimeoutT timeoutMs() const noexcept { return timeout_ms_; }
   bool leader() const noexcept { return leader_; }
+  bool tls() const noexcept { return tls_; }
+
+  // URL scheme used to talk to the agent
+  const char* scheme() const noexcept { return (tls_ ? "https" : "http"); }
 
   Agent() : host_{DEFAULT_HOST}, port_{DEFAULT_PORT} {}
   Agent(HostT host) : host_{host}, port_{DEFAULT_PORT} {}
@@ -52,7 +72,7 @@ public:
   const UrlT& kvEndpointUrlPrefix() noexcept {
     if (kvEndpointUrlPrefix_.empty()) {
       std::ostringstream url;
-      url << "http://" << host_ << ":" << port_ << "/v1/kv/";
+      url << scheme() << "://" << host_ << ":" << port_ << "/v1/kv/";
       kvEndpointUrlPrefix_ = url.str();
     }
     return kvEndpointUrlPrefix_;
@@ -61,7 +81,7 @@ public:
   const UrlT nodesUrl() noexcept {
     if (nodesUrl_.empty()) {
       std::ostringstream url;
-      url << "http://" << host_ << ":" << port_ << "/v1/catalog/nodes";
+      url << scheme() << "://" << host_ << ":" << port_ << "/v1/catalog/nodes";
       nodesUrl_ = url.str();
     }
     return nodesUrl_;
@@ -71,7 +91,7 @@ public:
     try {
       if (selfUrl_.empty()) {
         std::ostringstream url;
-        url << "http://" << host_ << ":" << port_ << "/v1/agent/self";
+        url << scheme() << "://" << host_ << ":" << port_ << "/v1/agent/self";
         selfUrl_ = url.str();
       }
     } catch (const std::exception& e) {
@@ -84,7 +104,7 @@ public:
     try {
       if (leaderUrl_.empty()) {
         std::ostringstream url;
-        url << "http://" << host_ << ":" << port_ << "/v1/status/leader";
+        url << scheme() << "://" << host_ << ":" << port_ << "/v1/status/leader";
         leaderUrl_ = url.str();
       }
     } catch (const std::exception& e) {
@@ -97,7 +117,7 @@ public:
     try {
       if (peersUrl_.empty()) {
         std::ostringstream url;
-        url << "http://" << host_ << ":" << port_ << "/v1/status/peers";
+        url << scheme() << "://" << host_ << ":" << port_ << "/v1/status/peers";
         peersUrl_ = url.str();
       }
     } catch (const std::exception& e) {
@@ -106,11 +126,25 @@ public:
     return peersUrl_;
   }
 
-  std::string json() const { return json11::Json(*this).dump(); };
-  json11::Json to_json() const {
+  const UrlT& txnUrl() noexcept {
+    try {
+      if (txnUrl_.empty()) {
+        std::ostringstream url;
+        url << scheme() << "://" << host_ << ":" << port_ << "/v1/txn";
+        txnUrl_ = url.str();
+      }
+    } catch (const std::exception& e) {
+      txnUrl_ = std::string();
+    }
+    return txnUrl_;
+  }
+
+  std::string json() const {
     std::ostringstream ss;
     ss << host_ << ":" << port_;
-    return json11::Json{ss.str()};
+    std::string out;
+    JsonValue::DumpString(out, ss.str());
+    return out;
   }
 
   std::string portStr() const noexcept {
@@ -150,6 +184,12 @@ public:
     }
   }
 
+  bool setTls(const bool tls) noexcept {
+    invalidateMemoizedUrls();
+    tls_ = tls;
+    return true;
+  }
+
   bool setTimeoutMs(const TimeoutT timeout_ms) noexcept {
     timeout_ms_ = timeout_ms;
     return true;
@@ -197,6 +237,7 @@ private:
     nodesUrl_.clear();
     peersUrl_.clear();
     selfUrl_.clear();
+    txnUrl_.clear();
   }
 
   TimeoutT timeout_ms_ = DEFAULT_TIMEOUT_MS;
@@ -204,6 +245,7 @@ private:
   ClusterT cluster_;
   PortT port_ = DEFAULT_PORT;
   bool leader_ = false;
+  bool tls_ = false;
 
   // A collection of memoized URLs.  Assuming the backend will be long lived
   // and the URL won't change often.
@@ -212,6 +254,7 @@ private:
   UrlT nodesUrl_;
   UrlT peersUrl_;
   UrlT selfUrl_;
+  UrlT txnUrl_;
 };
 
 
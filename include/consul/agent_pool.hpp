@@ -0,0 +1,254 @@
+#ifndef CONSUL_AGENT_POOL_HPP
+#define CONSUL_AGENT_POOL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/lexical_cast.hpp"
+
+#include "consul/agent.hpp"
+
+namespace consul {
+
+// A set of consul agents that requests can fail over between.  Each agent's
+// latency and error rate are tracked as EWMAs and every request is sent to
+// the agent with the best score.  Agents that fail repeatedly are ejected for
+// an exponentially increasing backoff period and must answer a probe before
+// they are used again.
+class AgentPool final {
+public:
+  using AgentsT = std::vector<Agent>;
+  using SizeT = AgentsT::size_type;
+  using ClockT = std::chrono::steady_clock;
+  using BackoffT = std::chrono::milliseconds;
+
+  static constexpr const char LIST_SEPARATOR = ',';
+  static constexpr const char PORT_SEPARATOR = ':';
+
+  // Consecutive transport failures before an agent is ejected
+  static constexpr const std::uint32_t EJECT_AFTER_ERRORS = 3;
+  static constexpr const BackoffT::rep EJECT_BACKOFF_MS = 1000;
+  static constexpr const BackoffT::rep EJECT_BACKOFF_MAX_MS = 30000;
+
+  // Weight of the most recent sample in the latency and error rate EWMAs
+  static constexpr const double EWMA_ALPHA = 0.2;
+  // How strongly a recent error rate penalizes an agent's latency score
+  static constexpr const double ERROR_RATE_PENALTY = 10.0;
+
+  struct Stats final {
+    double latencyMs = 0.0;
+    double errorRate = 0.0;
+    std::uint64_t requests = 0;
+    std::uint64_t errors = 0;
+    std::uint32_t consecutiveErrors = 0;
+    std::uint32_t ejections = 0;
+    bool ejected = false;
+    ClockT::time_point ejectedUntil;
+  };
+
+  AgentPool() {}
+  AgentPool(const Agent& agent) : agents_{agent}, stats_(1) {}
+
+  // Parse a list of agents of the form "host[:port][,host[:port]...]".
+  // Agents without a port use defaultPort.
+  static bool InitFromList(AgentPool& pool, const std::string& list, const Agent::PortT defaultPort, std::string& err) noexcept {
+    try {
+      std::vector<std::string> toks;
+      boost::split(toks, list, boost::is_any_of(std::string(1, LIST_SEPARATOR)));
+
+      AgentsT agents;
+      for (auto& tok : toks) {
+        boost::trim(tok);
+        if (tok.empty()) {
+          continue;
+        }
+
+        Agent agent{tok, defaultPort};
+        const auto portPos = tok.rfind(PORT_SEPARATOR);
+        if (portPos != std::string::npos) {
+          agent.setHost(tok.substr(0, portPos));
+          const auto portStr = tok.substr(portPos + 1);
+          Agent::PortT port = 0;
+          try {
+            port = ::boost::lexical_cast<Agent::PortT>(portStr);
+          } catch (const ::boost::bad_lexical_cast&) {
+          }
+
+          if (port == 0) {
+            std::ostringstream ss;
+            ss << "Invalid port \"" << portStr << "\" for agent \"" << tok << "\"";
+            err = ss.str();
+            return false;
+          }
+          agent.setPort(port);
+        }
+
+        if (agent.host().empty()) {
+          std::ostringstream ss;
+          ss << "Missing host for agent \"" << tok << "\"";
+          err = ss.str();
+          return false;
+        }
+
+        agents.push_back(agent);
+      }
+
+      if (agents.empty()) {
+        err = "Expected at least one agent";
+        return false;
+      }
+
+      pool.agents_ = std::move(agents);
+      pool.stats_.assign(pool.agents_.size(), Stats{});
+      pool.next_ = 0;
+      return true;
+    } catch (const std::exception& e) {
+      err = e.what();
+      return false;
+    }
+  }
+
+  Agent& agent(const SizeT i) noexcept { return agents_[i]; }
+  const AgentsT& agents() const noexcept { return agents_; }
+  const Stats& stats(const SizeT i) const noexcept { return stats_[i]; }
+  SizeT size() const noexcept { return agents_.size(); }
+  bool empty() const noexcept { return agents_.empty(); }
+
+  // An agent is usable unless it has been ejected.  An ejected agent whose
+  // backoff has expired needs a successful probe before it is usable again.
+  bool available(const SizeT i) const noexcept { return !stats_[i].ejected; }
+  bool needsProbe(const SizeT i, const ClockT::time_point now) const noexcept {
+    return stats_[i].ejected && now >= stats_[i].ejectedUntil;
+  }
+
+  // Lower is better.  Agents that have not been used yet score 0 so that
+  // every agent is given a chance to report its latency.
+  double score(const SizeT i) const noexcept {
+    const auto& s = stats_[i];
+    return s.latencyMs * (1.0 + ERROR_RATE_PENALTY * s.errorRate);
+  }
+
+  // Index of the best agent not in skip (may be empty).  If every candidate
+  // has been ejected, the one closest to the end of its backoff is returned
+  // so the caller still has somewhere to send the request.  Ties rotate
+  // between agents to spread load.
+  SizeT pick(const std::vector<bool>& skip = std::vector<bool>()) noexcept {
+    const SizeT n = agents_.size();
+    SizeT best = n, fallback = n;
+    for (SizeT j = 0; j < n; ++j) {
+      const SizeT i = (next_ + j) % n;
+      if (i < skip.size() && skip[i]) {
+        continue;
+      }
+
+      if (available(i)) {
+        if (best == n || score(i) < score(best)) {
+          best = i;
+        }
+      } else if (fallback == n || stats_[i].ejectedUntil < stats_[fallback].ejectedUntil) {
+        fallback = i;
+      }
+    }
+    next_ = (n > 0 ? (next_ + 1) % n : 0);
+    return (best != n ? best : fallback);
+  }
+
+  void recordSuccess(const SizeT i, const ClockT::duration latency) noexcept {
+    auto& s = stats_[i];
+    const double ms = std::chrono::duration<double, std::milli>(latency).count();
+    s.latencyMs = (s.requests == 0 ? ms : EWMA_ALPHA * ms + (1.0 - EWMA_ALPHA) * s.latencyMs);
+    s.errorRate = (1.0 - EWMA_ALPHA) * s.errorRate;
+    s.requests++;
+    s.consecutiveErrors = 0;
+    s.ejections = 0;
+    s.ejected = false;
+  }
+
+  void recordFailure(const SizeT i, const ClockT::time_point now) noexcept {
+    auto& s = stats_[i];
+    s.errorRate = EWMA_ALPHA + (1.0 - EWMA_ALPHA) * s.errorRate;
+    s.requests++;
+    s.errors++;
+    s.consecutiveErrors++;
+
+    // A failed probe re-ejects immediately with a longer backoff.
+    if (s.ejected || s.consecutiveErrors >= EJECT_AFTER_ERRORS) {
+      const auto shift = (s.ejections < 16 ? s.ejections : 16);
+      auto backoffMs = EJECT_BACKOFF_MS << shift;
+      if (backoffMs > EJECT_BACKOFF_MAX_MS) {
+        backoffMs = EJECT_BACKOFF_MAX_MS;
+      }
+      s.ejections++;
+      s.ejected = true;
+      s.ejectedUntil = now + BackoffT(backoffMs);
+    }
+  }
+
+  // Probe every ejected agent whose backoff has expired.  probeFn(Agent&)
+  // returns a response with a status_code member (e.g. cpr::Response); any
+  // HTTP response, even an error, proves the agent is reachable.
+  template <typename ProbeFnT>
+  void probe(ProbeFnT probeFn) {
+    const auto now = ClockT::now();
+    for (SizeT i = 0; i < agents_.size(); ++i) {
+      if (!needsProbe(i, now)) {
+        continue;
+      }
+
+      const auto start = ClockT::now();
+      const auto r = probeFn(agents_[i]);
+      if (r.status_code == 0) {
+        recordFailure(i, ClockT::now());
+      } else {
+        recordSuccess(i, ClockT::now() - start);
+      }
+    }
+  }
+
+  // Send a request to the best agent and fail over to the next best agent
+  // on transport failure (status_code == 0), trying each agent at most once.
+  // requestFn(Agent&) returns a response with a status_code member.
+  template <typename RequestFnT>
+  auto request(RequestFnT requestFn) -> decltype(requestFn(std::declval<Agent&>())) {
+    decltype(requestFn(std::declval<Agent&>())) r{};
+    std::vector<bool> tried(agents_.size(), false);
+    for (SizeT attempt = 0; attempt < agents_.size(); ++attempt) {
+      const auto i = pick(tried);
+      tried[i] = true;
+
+      const auto start = ClockT::now();
+      r = requestFn(agents_[i]);
+      if (r.status_code != 0) {
+        recordSuccess(i, ClockT::now() - start);
+        return r;
+      }
+      recordFailure(i, ClockT::now());
+    }
+    return r;
+  }
+
+  std::string str() const {
+    std::ostringstream ss;
+    for (SizeT i = 0; i < agents_.size(); ++i) {
+      if (i > 0) {
+        ss << LIST_SEPARATOR;
+      }
+      ss << agents_[i].str();
+    }
+    return ss.str();
+  }
+
+private:
+  AgentsT agents_;
+  std::vector<Stats> stats_;
+  SizeT next_ = 0;
+};
+
+} // namespace consul
+
+#endif // CONSUL_AGENT_POOL_HPP
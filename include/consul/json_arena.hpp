@@ -0,0 +1,116 @@
+#ifndef CONSUL_JSON_ARENA_HPP
+#define CONSUL_JSON_ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+
+namespace consul {
+
+// Source of the blocks a JsonArena carves up.  Defaults to malloc(3); the
+// extension substitutes a PostgreSQL MemoryContext.  allocFn returns nullptr
+// on failure.
+struct JsonAllocator final {
+  using AllocFn = void* (*)(void* ctx, std::size_t size);
+  using FreeFn  = void  (*)(void* ctx, void* ptr);
+
+  static void* MallocAlloc(void*, const std::size_t size) noexcept { return std::malloc(size); }
+  static void  MallocFree(void*, void* ptr) noexcept { std::free(ptr); }
+
+  AllocFn allocFn = &MallocAlloc;
+  FreeFn  freeFn  = &MallocFree;
+  void*   ctx     = nullptr;
+};
+
+
+// Bump allocator for the nodes of a JsonDocument.  Memory is only released,
+// all at once, when the arena is destroyed.  Allocations larger than half a
+// block get a block of their own so the current block isn't wasted.
+class JsonArena final {
+public:
+  static constexpr const std::size_t BLOCK_SIZE = 8192;
+
+  explicit JsonArena(const JsonAllocator& alloc = JsonAllocator()) noexcept : alloc_{alloc} {}
+  JsonArena(const JsonArena&) = delete;
+  JsonArena& operator=(const JsonArena&) = delete;
+  ~JsonArena() { release(); }
+
+  // Returns nullptr if a block can't be allocated.  Blocks are assumed to be
+  // aligned for any of the JSON node types, as malloc(3) and palloc() are.
+  void* allocate(const std::size_t size, const std::size_t align = alignof(void*)) noexcept {
+    if (head_ != nullptr) {
+      const std::size_t off = AlignUp(used_, align);
+      if (off <= head_->size && size <= head_->size - off) {
+        used_ = off + size;
+        return reinterpret_cast<char*>(head_) + off;
+      }
+    }
+
+    const std::size_t off = AlignUp(sizeof(Block), align);
+    if (size > BLOCK_SIZE / 2 && head_ != nullptr) {
+      Block* b = newBlock(off + size);
+      if (b == nullptr) {
+        return nullptr;
+      }
+      b->next = head_->next;
+      head_->next = b;
+      return reinterpret_cast<char*>(b) + off;
+    }
+
+    Block* b = newBlock(off + size > BLOCK_SIZE ? off + size : BLOCK_SIZE);
+    if (b == nullptr) {
+      return nullptr;
+    }
+    b->next = head_;
+    head_ = b;
+    used_ = off + size;
+    return reinterpret_cast<char*>(b) + off;
+  }
+
+  template <typename T>
+  T* allocateArray(const std::size_t n) noexcept {
+    return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // Number of blocks and the bytes they span
+  std::size_t blocks() const noexcept { return blocks_; }
+  std::size_t bytes() const noexcept { return bytes_; }
+
+private:
+  struct Block {
+    Block* next;
+    std::size_t size;
+  };
+
+  static std::size_t AlignUp(const std::size_t n, const std::size_t align) noexcept {
+    return (n + align - 1) & ~(align - 1);
+  }
+
+  Block* newBlock(const std::size_t size) noexcept {
+    Block* b = static_cast<Block*>(alloc_.allocFn(alloc_.ctx, size));
+    if (b != nullptr) {
+      b->next = nullptr;
+      b->size = size;
+      blocks_++;
+      bytes_ += size;
+    }
+    return b;
+  }
+
+  void release() noexcept {
+    while (head_ != nullptr) {
+      Block* next = head_->next;
+      alloc_.freeFn(alloc_.ctx, head_);
+      head_ = next;
+    }
+  }
+
+  JsonAllocator alloc_;
+  Block* head_ = nullptr;
+  std::size_t used_ = 0;
+  std::size_t blocks_ = 0;
+  std::size_t bytes_ = 0;
+};
+
+} // namespace consul
+
+#endif // CONSUL_JSON_ARENA_HPP
@@ -0,0 +1,362 @@
+#ifndef CONSUL_JSON_CURSOR_HPP
+#define CONSUL_JSON_CURSOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/utility/string_ref.hpp"
+
+#include "consul/json_index.hpp"
+
+namespace consul {
+
+// Forward-only JSON reader that parses a mutable buffer in place.  Strings are
+// unescaped into the buffer itself (an unescaped string is never longer than
+// its escaped form), so every string returned is a view into the buffer and
+// nothing is allocated.  The buffer must outlive the views.
+//
+// Given a JsonIndex of the same buffer, strings without escapes are found by
+// their quotes in the index rather than by scanning them.
+class JsonCursor final {
+public:
+  using StringT = ::boost::string_ref;
+
+  JsonCursor(char* begin, char* end, const JsonIndex* index = nullptr) noexcept
+    : p_{begin}, begin_{begin}, end_{end}, index_{index} {}
+
+  // Skip whitespace and return the next character without consuming it, or
+  // '\0' at the end of the input.
+  char peek() noexcept {
+    skipWs();
+    return (p_ < end_ ? *p_ : '\0');
+  }
+
+  // Consume c if it is the next character
+  bool consume(const char c) noexcept {
+    if (peek() != c) {
+      return false;
+    }
+    ++p_;
+    return true;
+  }
+
+  bool expect(const char c, std::string& err) noexcept {
+    if (consume(c)) {
+      return true;
+    }
+    char what[] = "expected ' '";
+    what[10] = c;
+    return fail(what, err);
+  }
+
+  bool atEnd() noexcept {
+    skipWs();
+    return p_ >= end_;
+  }
+
+  // Parse the literal null
+  bool null() noexcept {
+    return literal("null");
+  }
+
+  // Parse the literal true or false
+  bool boolean(bool& out) noexcept {
+    if (literal("true")) {
+      out = true;
+      return true;
+    }
+    if (literal("false")) {
+      out = false;
+      return true;
+    }
+    return false;
+  }
+
+  bool string(StringT& out, std::string& err) noexcept {
+    if (!expect('"', err)) {
+      return false;
+    }
+    if (index_ != nullptr && indexedString(out)) {
+      return true;
+    }
+
+    char* const start = p_;
+    char* w = p_;
+    while (p_ < end_) {
+      const char c = *p_++;
+      if (c == '"') {
+        out = StringT(start, static_cast<std::size_t>(w - start));
+        return true;
+      }
+
+      if (static_cast<unsigned char>(c) < 0x20) {
+        return fail("control character in string", err);
+      }
+
+      if (c != '\\') {
+        *w++ = c;
+        continue;
+      }
+
+      if (p_ >= end_) {
+        break;
+      }
+      switch (*p_++) {
+      case '"':  *w++ = '"';  break;
+      case '\\': *w++ = '\\'; break;
+      case '/':  *w++ = '/';  break;
+      case 'b':  *w++ = '\b'; break;
+      case 'f':  *w++ = '\f'; break;
+      case 'n':  *w++ = '\n'; break;
+      case 'r':  *w++ = '\r'; break;
+      case 't':  *w++ = '\t'; break;
+      case 'u': {
+        std::uint32_t cp = 0;
+        if (!hex4(cp)) {
+          return fail("invalid \\u escape", err);
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          std::uint32_t lo = 0;
+          if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u') {
+            return fail("unpaired surrogate in \\u escape", err);
+          }
+          p_ += 2;
+          if (!hex4(lo) || lo < 0xDC00 || lo > 0xDFFF) {
+            return fail("invalid surrogate pair in \\u escape", err);
+          }
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+        }
+        w = utf8(w, cp);
+        break;
+      }
+      default:
+        return fail("invalid escape in string", err);
+      }
+    }
+
+    return fail("unterminated string", err);
+  }
+
+  bool uint64(std::uint64_t& out, std::string& err) noexcept {
+    skipWs();
+    if (p_ >= end_ || *p_ < '0' || *p_ > '9') {
+      return fail("expected an unsigned integer", err);
+    }
+
+    std::uint64_t v = 0;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      const std::uint64_t d = static_cast<std::uint64_t>(*p_ - '0');
+      if (v > (std::numeric_limits<std::uint64_t>::max() - d) / 10) {
+        return fail("integer out of range", err);
+      }
+      v = v * 10 + d;
+      ++p_;
+    }
+
+    if (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+      return fail("expected an integer", err);
+    }
+    out = v;
+    return true;
+  }
+
+  // Parse a number of any kind and return its text
+  bool number(StringT& out, std::string& err) noexcept {
+    skipWs();
+    char* const start = p_;
+    if (p_ < end_ && *p_ == '-') {
+      ++p_;
+    }
+
+    if (p_ < end_ && *p_ == '0') {
+      ++p_;
+    } else if (!digits()) {
+      return fail("expected a number", err);
+    }
+
+    if (p_ < end_ && *p_ == '.') {
+      ++p_;
+      if (!digits()) {
+        return fail("expected a digit after the decimal point", err);
+      }
+    }
+
+    if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+      ++p_;
+      if (p_ < end_ && (*p_ == '+' || *p_ == '-')) {
+        ++p_;
+      }
+      if (!digits()) {
+        return fail("expected a digit in the exponent", err);
+      }
+    }
+
+    out = StringT(start, static_cast<std::size_t>(p_ - start));
+    return true;
+  }
+
+  // Skip over the next value of any type
+  bool skip(std::string& err) noexcept {
+    switch (peek()) {
+    case '"': {
+      StringT s;
+      return string(s, err);
+    }
+    case '{':
+    case '[': {
+      const char close = (*p_ == '{' ? '}' : ']');
+      const bool isObject = (*p_ == '{');
+      ++p_;
+      if (consume(close)) {
+        return true;
+      }
+      do {
+        if (isObject) {
+          StringT name;
+          if (!string(name, err) || !expect(':', err)) {
+            return false;
+          }
+        }
+        if (!skip(err)) {
+          return false;
+        }
+      } while (consume(','));
+      return expect(close, err);
+    }
+    case 't': return literal("true") || fail("invalid literal", err);
+    case 'f': return literal("false") || fail("invalid literal", err);
+    case 'n': return literal("null") || fail("invalid literal", err);
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9': {
+      StringT n;
+      return number(n, err);
+    }
+    default:
+      return fail("unexpected character", err);
+    }
+  }
+
+  std::size_t offset() const noexcept { return static_cast<std::size_t>(p_ - begin_); }
+
+  // Set err to what, at the current offset, and return false.  If there
+  // isn't the memory to format it, err is set to "out of memory" instead,
+  // which fits in any std::string without allocating.
+  bool fail(const char* what, std::string& err) const noexcept {
+    try {
+      std::ostringstream ss;
+      ss << what << " at offset " << offset();
+      err = ss.str();
+    } catch (...) {
+      err.assign("out of memory");
+    }
+    return false;
+  }
+
+private:
+  void skipWs() noexcept {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      ++p_;
+    }
+  }
+
+  // Look up the closing quote of the string whose opening quote was just
+  // consumed.  Fails, leaving the cursor where it was, if the string isn't in
+  // the index or needs unescaping.
+  bool indexedString(StringT& out) noexcept {
+    const std::vector<JsonIndex::OffsetT>& quotes = index_->quotes();
+    const std::size_t open = offset() - 1;
+    while (nextQuote_ < quotes.size() && quotes[nextQuote_] < open) {
+      ++nextQuote_;
+    }
+    if (nextQuote_ + 1 >= quotes.size() || quotes[nextQuote_] != open) {
+      return false;
+    }
+
+    const std::size_t close = quotes[nextQuote_ + 1];
+    if (close >= static_cast<std::size_t>(end_ - begin_) || index_->special(open + 1, close)) {
+      return false;
+    }
+
+    out = StringT(begin_ + open + 1, close - open - 1);
+    p_ = begin_ + close + 1;
+    nextQuote_ += 2;
+    return true;
+  }
+
+  bool literal(const char* lit) noexcept {
+    skipWs();
+    char* q = p_;
+    for (; *lit != '\0'; ++lit, ++q) {
+      if (q >= end_ || *q != *lit) {
+        return false;
+      }
+    }
+    p_ = q;
+    return true;
+  }
+
+  // Consume one or more digits
+  bool digits() noexcept {
+    const char* const start = p_;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      ++p_;
+    }
+    return p_ != start;
+  }
+
+  bool hex4(std::uint32_t& out) noexcept {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *p_++;
+      v <<= 4;
+      if (c >= '0' && c <= '9') {
+        v |= static_cast<std::uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        v |= static_cast<std::uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        v |= static_cast<std::uint32_t>(c - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    out = v;
+    return true;
+  }
+
+  static char* utf8(char* w, const std::uint32_t cp) noexcept {
+    if (cp < 0x80) {
+      *w++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      *w++ = static_cast<char>(0xC0 | (cp >> 6));
+      *w++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      *w++ = static_cast<char>(0xE0 | (cp >> 12));
+      *w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      *w++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      *w++ = static_cast<char>(0xF0 | (cp >> 18));
+      *w++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      *w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      *w++ = static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return w;
+  }
+
+  char* p_;
+  char* const begin_;
+  char* const end_;
+  const JsonIndex* const index_;
+  std::size_t nextQuote_ = 0;
+};
+
+} // namespace consul
+
+#endif // CONSUL_JSON_CURSOR_HPP
@@ -0,0 +1,220 @@
+#ifndef CONSUL_JSON_DOCUMENT_HPP
+#define CONSUL_JSON_DOCUMENT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "consul/json_arena.hpp"
+#include "consul/json_cursor.hpp"
+#include "consul/json_value.hpp"
+
+namespace consul {
+
+// A parsed JSON response.  Every node lives in one JsonArena and strings are
+// unescaped in place in the document's copy of the input, so parsing costs a
+// handful of allocations regardless of the size of the response.
+class JsonDocument final {
+public:
+  // Bounds the parser's recursion
+  static constexpr const int MAX_DEPTH = 200;
+
+  explicit JsonDocument(const JsonAllocator& alloc = JsonAllocator()) noexcept : arena_{alloc} {}
+  JsonDocument(const JsonDocument&) = delete;
+  JsonDocument& operator=(const JsonDocument&) = delete;
+
+  // Parse a copy of json, made in the arena
+  static bool Parse(JsonDocument& doc, const char* json, const std::size_t len, std::string& err) noexcept {
+    if (len >= std::numeric_limits<JsonValue::SizeT>::max()) {
+      err = "JSON document too large";
+      return false;
+    }
+
+    char* buf = doc.arena_.allocateArray<char>(len + 1);
+    if (buf == nullptr) {
+      err = "out of memory";
+      return false;
+    }
+    std::memcpy(buf, json, len);
+    buf[len] = '\0';
+    return doc.parse(buf, len, err);
+  }
+
+  static bool Parse(JsonDocument& doc, const std::string& json, std::string& err) noexcept {
+    return Parse(doc, json.data(), json.size(), err);
+  }
+
+  // Parse json in place without copying it
+  static bool Parse(JsonDocument& doc, std::string&& json, std::string& err) noexcept {
+    if (json.size() >= std::numeric_limits<JsonValue::SizeT>::max()) {
+      err = "JSON document too large";
+      return false;
+    }
+
+    doc.buf_ = std::move(json);
+    return doc.parse(&doc.buf_[0], doc.buf_.size(), err);
+  }
+
+  const JsonValue& root() const noexcept { return root_; }
+  const JsonArena& arena() const noexcept { return arena_; }
+
+private:
+  bool parse(char* buf, const std::size_t len, std::string& err) noexcept {
+    JsonCursor cur{buf, buf + len};
+    try {
+      if (!parseValue(cur, root_, 0, err)) {
+        return false;
+      }
+    } catch (const std::bad_alloc&) {
+      err = "out of memory";
+      return false;
+    }
+
+    if (!cur.atEnd()) {
+      return cur.fail("unexpected trailing data", err);
+    }
+    return true;
+  }
+
+  // Children are collected on the items_ and members_ stacks and copied into
+  // the arena once the array or object is complete.
+  bool parseValue(JsonCursor& cur, JsonValue& out, const int depth, std::string& err) {
+    switch (cur.peek()) {
+    case '{': {
+      if (depth >= MAX_DEPTH) {
+        return cur.fail("exceeded maximum nesting depth", err);
+      }
+      cur.consume('{');
+
+      const std::size_t base = members_.size();
+      if (!cur.consume('}')) {
+        do {
+          JsonMember m;
+          if (!cur.string(m.key, err) || !cur.expect(':', err) ||
+              !parseValue(cur, m.value, depth + 1, err)) {
+            return false;
+          }
+          members_.push_back(m);
+        } while (cur.consume(','));
+
+        if (!cur.expect('}', err)) {
+          return false;
+        }
+      }
+
+      const std::size_t n = members_.size() - base;
+      JsonMember* members = nullptr;
+      if (n > 0) {
+        members = arena_.allocateArray<JsonMember>(n);
+        if (members == nullptr) {
+          err = "out of memory";
+          return false;
+        }
+        std::copy(members_.begin() + base, members_.end(), members);
+        members_.resize(base);
+      }
+
+      out.type_ = JsonValue::Type::OBJECT;
+      out.ptr_ = members;
+      out.size_ = static_cast<JsonValue::SizeT>(n);
+      return true;
+    }
+
+    case '[': {
+      if (depth >= MAX_DEPTH) {
+        return cur.fail("exceeded maximum nesting depth", err);
+      }
+      cur.consume('[');
+
+      const std::size_t base = items_.size();
+      if (!cur.consume(']')) {
+        do {
+          JsonValue v;
+          if (!parseValue(cur, v, depth + 1, err)) {
+            return false;
+          }
+          items_.push_back(v);
+        } while (cur.consume(','));
+
+        if (!cur.expect(']', err)) {
+          return false;
+        }
+      }
+
+      const std::size_t n = items_.size() - base;
+      JsonValue* items = nullptr;
+      if (n > 0) {
+        items = arena_.allocateArray<JsonValue>(n);
+        if (items == nullptr) {
+          err = "out of memory";
+          return false;
+        }
+        std::copy(items_.begin() + base, items_.end(), items);
+        items_.resize(base);
+      }
+
+      out.type_ = JsonValue::Type::ARRAY;
+      out.ptr_ = items;
+      out.size_ = static_cast<JsonValue::SizeT>(n);
+      return true;
+    }
+
+    case '"': {
+      JsonValue::StringT s;
+      if (!cur.string(s, err)) {
+        return false;
+      }
+      out.type_ = JsonValue::Type::STRING;
+      out.ptr_ = s.data();
+      out.size_ = static_cast<JsonValue::SizeT>(s.size());
+      return true;
+    }
+
+    case 't':
+    case 'f':
+      if (!cur.boolean(out.bool_)) {
+        return cur.fail("invalid literal", err);
+      }
+      out.type_ = JsonValue::Type::BOOL;
+      return true;
+
+    case 'n':
+      if (!cur.null()) {
+        return cur.fail("invalid literal", err);
+      }
+      out.type_ = JsonValue::Type::NUL;
+      return true;
+
+    case '\0':
+      if (cur.atEnd()) {
+        return cur.fail("unexpected end of input", err);
+      }
+      return cur.fail("unexpected character", err);
+
+    default: {
+      JsonValue::StringT n;
+      if (!cur.number(n, err)) {
+        return false;
+      }
+      out.type_ = JsonValue::Type::NUMBER;
+      out.ptr_ = n.data();
+      out.size_ = static_cast<JsonValue::SizeT>(n.size());
+      return true;
+    }
+    }
+  }
+
+  JsonArena arena_;
+  std::string buf_;
+  JsonValue root_;
+  std::vector<JsonValue> items_;
+  std::vector<JsonMember> members_;
+};
+
+} // namespace consul
+
+#endif // CONSUL_JSON_DOCUMENT_HPP
@@ -0,0 +1,234 @@
+#ifndef CONSUL_JSON_INDEX_HPP
+#define CONSUL_JSON_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONSUL_JSON_INDEX_X86 1
+#endif
+
+namespace consul {
+
+// Structural index of a JSON buffer: the offset of every unescaped quote, and
+// a bitmap of the bytes (backslashes and control characters) that force a
+// string to be unescaped.  Built in 64 byte blocks, with AVX2 or SSE2 where
+// available, so that a JsonCursor can step from a string's opening quote to
+// its closing quote instead of scanning the string a byte at a time.
+//
+// Only worth building for large responses, and even then only measurably
+// faster when they hold large values (see playground/consul-json-bench), so
+// KVPairs and KVPairsView build one only when asked to.
+class JsonIndex final {
+public:
+  using OffsetT = std::uint32_t;
+
+  // Responses smaller than this are always parsed without an index
+  static constexpr const std::size_t MIN_SIZE = 64 * 1024;
+
+  enum class Impl : std::uint8_t { SCALAR, SSE2, AVX2 };
+
+  static const char* ImplStr(const Impl impl) noexcept {
+    switch (impl) {
+    case Impl::SCALAR: return "scalar";
+    case Impl::SSE2:   return "sse2";
+    case Impl::AVX2:   return "avx2";
+    }
+    return "UNKNOWN";
+  }
+
+  // The fastest implementation supported by this CPU
+  static Impl BestImpl() noexcept {
+#if defined(CONSUL_JSON_INDEX_X86) && defined(__GNUC__)
+    static const Impl best = (__builtin_cpu_supports("avx2") ? Impl::AVX2 :
+                              __builtin_cpu_supports("sse2") ? Impl::SSE2 : Impl::SCALAR);
+    return best;
+#else
+    return Impl::SCALAR;
+#endif
+  }
+
+  static bool Build(JsonIndex& idx, const char* buf, const std::size_t len, std::string& err) noexcept {
+    return Build(idx, buf, len, BestImpl(), err);
+  }
+
+  static bool Build(JsonIndex& idx, const char* buf, const std::size_t len, const Impl impl,
+                    std::string& err) noexcept {
+    idx.quotes_.clear();
+    idx.special_.clear();
+    idx.len_ = 0;
+    if (len >= std::numeric_limits<OffsetT>::max()) {
+      err = "JSON document too large to index";
+      return false;
+    }
+
+    try {
+      const std::size_t blocks = (len + 63) / 64;
+      idx.special_.resize(blocks);
+      // A KV pair has ~16 quotes per 200 bytes
+      idx.quotes_.reserve(len / 12);
+
+      std::uint64_t prevEscaped = 0;
+      for (std::size_t b = 0; b < blocks; ++b) {
+        const char* block = buf + b * 64;
+        char tail[64];
+        if (len - b * 64 < 64) {
+          std::memset(tail, ' ', sizeof(tail));
+          std::memcpy(tail, block, len - b * 64);
+          block = tail;
+        }
+
+        Masks m;
+        Classify(block, impl, m);
+        idx.special_[b] = m.backslash | m.control;
+
+        std::uint64_t quotes = m.quote & ~Escaped(m.backslash, prevEscaped);
+        if (quotes == 0) {
+          continue;
+        }
+
+        const std::size_t n = idx.quotes_.size();
+        idx.quotes_.resize(n + static_cast<std::size_t>(__builtin_popcountll(quotes)));
+        OffsetT* out = &idx.quotes_[n];
+        const OffsetT base = static_cast<OffsetT>(b * 64);
+        while (quotes != 0) {
+          *out++ = base + static_cast<OffsetT>(__builtin_ctzll(quotes));
+          quotes &= quotes - 1;
+        }
+      }
+    } catch (const std::bad_alloc&) {
+      err = "out of memory";
+      return false;
+    }
+
+    idx.len_ = len;
+    return true;
+  }
+
+  const std::vector<OffsetT>& quotes() const noexcept { return quotes_; }
+  std::size_t size() const noexcept { return len_; }
+
+  // True if [begin, end) contains a backslash or control character
+  bool special(const std::size_t begin, const std::size_t end) const noexcept {
+    if (begin >= end) {
+      return false;
+    }
+
+    const std::size_t first = begin / 64;
+    const std::size_t last = (end - 1) / 64;
+    for (std::size_t w = first; w <= last; ++w) {
+      std::uint64_t bits = special_[w];
+      if (w == first) {
+        bits &= ~std::uint64_t{0} << (begin % 64);
+      }
+      if (w == last && end % 64 != 0) {
+        bits &= ~(~std::uint64_t{0} << (end % 64));
+      }
+      if (bits != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  struct Masks {
+    std::uint64_t quote;
+    std::uint64_t backslash;
+    std::uint64_t control;
+  };
+
+  static void Classify(const char* block, const Impl impl, Masks& m) noexcept {
+#ifdef CONSUL_JSON_INDEX_X86
+    if (impl == Impl::AVX2) {
+      ClassifyAVX2(block, m);
+      return;
+    }
+    if (impl == Impl::SSE2) {
+      ClassifySSE2(block, m);
+      return;
+    }
+#else
+    (void)impl;
+#endif
+    ClassifyScalar(block, m);
+  }
+
+  static void ClassifyScalar(const char* block, Masks& m) noexcept {
+    m.quote = m.backslash = m.control = 0;
+    for (int i = 0; i < 64; ++i) {
+      const unsigned char c = static_cast<unsigned char>(block[i]);
+      const std::uint64_t bit = std::uint64_t{1} << i;
+      if (c == '"') {
+        m.quote |= bit;
+      } else if (c == '\\') {
+        m.backslash |= bit;
+      } else if (c < 0x20) {
+        m.control |= bit;
+      }
+    }
+  }
+
+#ifdef CONSUL_JSON_INDEX_X86
+  static void ClassifySSE2(const char* block, Masks& m) noexcept {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i maxControl = _mm_set1_epi8(0x1f);
+    m.quote = m.backslash = m.control = 0;
+    for (int i = 0; i < 4; ++i) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+      // c <= 0x1f iff max(c, 0x1f) == 0x1f, unsigned
+      const __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(v, maxControl), maxControl);
+      const int shift = i * 16;
+      m.quote |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+      m.backslash |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))) << shift;
+      m.control |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(control))) << shift;
+    }
+  }
+
+  __attribute__((target("avx2")))
+  static void ClassifyAVX2(const char* block, Masks& m) noexcept {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i maxControl = _mm256_set1_epi8(0x1f);
+    m.quote = m.backslash = m.control = 0;
+    for (int i = 0; i < 2; ++i) {
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+      const __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(v, maxControl), maxControl);
+      const int shift = i * 32;
+      m.quote |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))) << shift;
+      m.backslash |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)))) << shift;
+      m.control |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(control))) << shift;
+    }
+  }
+#endif
+
+  // Bits of the characters escaped by a backslash: those following an odd
+  // length run of backslashes.  prevEscaped carries a run that ends the
+  // previous block.
+  static std::uint64_t Escaped(std::uint64_t backslash, std::uint64_t& prevEscaped) noexcept {
+    static constexpr const std::uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+    backslash &= ~prevEscaped;
+    const std::uint64_t followsEscape = (backslash << 1) | prevEscaped;
+    const std::uint64_t oddStarts = backslash & ~EVEN_BITS & ~followsEscape;
+    const std::uint64_t evenStartRuns = oddStarts + backslash;
+    prevEscaped = (evenStartRuns < oddStarts ? 1 : 0);
+    const std::uint64_t invert = evenStartRuns << 1;
+    return (EVEN_BITS ^ invert) & followsEscape;
+  }
+
+  std::vector<OffsetT> quotes_;
+  std::vector<std::uint64_t> special_;
+  std::size_t len_ = 0;
+};
+
+} // namespace consul
+
+#endif // CONSUL_JSON_INDEX_HPP
@@ -0,0 +1,181 @@
+#ifndef CONSUL_JSON_SCHEMA_HPP
+#define CONSUL_JSON_SCHEMA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "consul/json_cursor.hpp"
+
+namespace consul {
+
+// Hash of a member name's length and its first, middle and last characters.
+// A JsonSchema searches for a seed under which its field names don't collide.
+constexpr std::uint32_t JsonSchemaHash(const char* s, const std::size_t len, const std::uint32_t seed) noexcept {
+  std::uint32_t h = (seed ^ static_cast<std::uint32_t>(len)) * 0x01000193u;
+  if (len > 0) {
+    h = (h ^ static_cast<unsigned char>(s[0])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(s[len / 2])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(s[len - 1])) * 0x01000193u;
+  }
+  return h ^ (h >> 15);
+}
+
+// The smallest power of two with room for twice n fields
+constexpr std::size_t JsonSchemaSlots(const std::size_t n) noexcept {
+  std::size_t slots = 1;
+  while (slots < 2 * n) {
+    slots <<= 1;
+  }
+  return slots;
+}
+
+
+// One member of a JSON object and the function that decodes its value into a
+// T.  The JsonDecode*() templates below cover the common member types.
+template <typename T>
+struct JsonField final {
+  using DecodeFn = bool (*)(T& obj, JsonCursor& cur, std::string& err);
+
+  template <std::size_t L>
+  constexpr JsonField(const char (&name_)[L], const DecodeFn decode_) noexcept
+    : name{name_}, len{L - 1}, decode{decode_} {}
+
+  const char* name;
+  std::size_t len;
+  DecodeFn decode;
+};
+
+
+// An unsigned integer, parsed exactly
+template <typename T, std::uint64_t T::*M>
+bool JsonDecodeUInt64(T& obj, JsonCursor& cur, std::string& err) noexcept {
+  return cur.uint64(obj.*M, err);
+}
+
+// A string copied out of the response.  null leaves the member empty.
+template <typename T, std::string T::*M>
+bool JsonDecodeString(T& obj, JsonCursor& cur, std::string& err) {
+  JsonCursor::StringT s;
+  if (cur.null()) {
+    return true;
+  }
+  if (!cur.string(s, err)) {
+    return false;
+  }
+  (obj.*M).assign(s.data(), s.size());
+  return true;
+}
+
+// A view of a string in the response buffer.  null leaves the member empty.
+template <typename T, JsonCursor::StringT T::*M>
+bool JsonDecodeView(T& obj, JsonCursor& cur, std::string& err) noexcept {
+  return cur.null() || cur.string(obj.*M, err);
+}
+
+
+// Single pass decoder for JSON objects of type T, generated at compile time
+// from a table of JsonFields.  Member names are dispatched through a perfect
+// hash, so each member costs one hash and one memcmp().  Unknown members are
+// skipped.  Error messages are only formatted on failure.
+//
+// Declare the table and schema as function-local constexpr statics and check
+// that a perfect hash was found:
+//
+//   static constexpr JsonField<Foo> fields[] = {
+//     { "Index", &JsonDecodeUInt64<Foo, &Foo::index_> },
+//   };
+//   static constexpr JsonSchema<Foo, 1> schema{fields};
+//   static_assert(schema.valid(), "no perfect hash for Foo's fields");
+template <typename T, std::size_t N>
+class JsonSchema final {
+public:
+  using StringT = JsonCursor::StringT;
+
+  static constexpr const std::size_t SLOTS = JsonSchemaSlots(N);
+
+  // Seeds tried before giving up.  Only names that agree in length and in
+  // their first, middle and last characters can't be separated.
+  static constexpr const std::uint32_t MAX_SEED = 4096;
+
+  explicit constexpr JsonSchema(const JsonField<T> (&fields)[N]) noexcept
+    : fields_{fields}, seed_{FindSeed(fields)}, slots_{} {
+    for (std::size_t i = 0; i < N; ++i) {
+      slots_[Slot(fields[i].name, fields[i].len, seed_)] = static_cast<std::uint8_t>(i + 1);
+    }
+  }
+
+  constexpr bool valid() const noexcept { return seed_ != 0; }
+
+  const JsonField<T>* find(const StringT& name) const noexcept {
+    const std::uint8_t i = slots_[Slot(name.data(), name.size(), seed_)];
+    if (i == 0) {
+      return nullptr;
+    }
+
+    const JsonField<T>& f = fields_[i - 1];
+    return (f.len == name.size() && std::memcmp(f.name, name.data(), f.len) == 0 ? &f : nullptr);
+  }
+
+  // Decode the object at cur into obj.  members is set to the number of
+  // members in the object, known or not.
+  bool decode(T& obj, JsonCursor& cur, std::size_t& members, std::string& err) const {
+    members = 0;
+    if (!cur.expect('{', err)) {
+      return false;
+    }
+    if (cur.consume('}')) {
+      return true;
+    }
+
+    do {
+      StringT name;
+      if (!cur.string(name, err) || !cur.expect(':', err)) {
+        return false;
+      }
+
+      const JsonField<T>* f = find(name);
+      if (!(f != nullptr ? f->decode(obj, cur, err) : cur.skip(err))) {
+        std::string what = name.to_string();
+        what.append(": ").append(err);
+        err = what;
+        return false;
+      }
+      members++;
+    } while (cur.consume(','));
+
+    return cur.expect('}', err);
+  }
+
+private:
+  static_assert(N > 0 && N < 256, "a JsonSchema needs between 1 and 255 fields");
+
+  static constexpr std::size_t Slot(const char* s, const std::size_t len, const std::uint32_t seed) noexcept {
+    return JsonSchemaHash(s, len, seed) & (SLOTS - 1);
+  }
+
+  static constexpr std::uint32_t FindSeed(const JsonField<T> (&fields)[N]) noexcept {
+    for (std::uint32_t seed = 1; seed < MAX_SEED; ++seed) {
+      bool used[SLOTS] = {};
+      bool perfect = true;
+      for (std::size_t i = 0; i < N && perfect; ++i) {
+        const std::size_t slot = Slot(fields[i].name, fields[i].len, seed);
+        perfect = !used[slot];
+        used[slot] = true;
+      }
+      if (perfect) {
+        return seed;
+      }
+    }
+    return 0;
+  }
+
+  const JsonField<T>* fields_;
+  std::uint32_t seed_;
+  std::uint8_t slots_[SLOTS];
+};
+
+} // namespace consul
+
+#endif // CONSUL_JSON_SCHEMA_HPP
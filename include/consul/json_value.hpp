@@ -0,0 +1,237 @@
+#ifndef CONSUL_JSON_VALUE_HPP
+#define CONSUL_JSON_VALUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "consul/json_cursor.hpp"
+
+namespace consul {
+
+struct JsonMember;
+
+// A node of a JsonDocument.  Strings and numbers are views into the
+// document's buffer, arrays and objects are flat arrays in its arena.  Values
+// are only valid for the lifetime of their JsonDocument.
+class JsonValue final {
+public:
+  using StringT = JsonCursor::StringT;
+  using SizeT   = std::uint32_t;
+
+  enum class Type : std::uint8_t { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  static const char* TypeStr(const Type type) noexcept {
+    switch (type) {
+    case Type::NUL:    return "null";
+    case Type::BOOL:   return "bool";
+    case Type::NUMBER: return "number";
+    case Type::STRING: return "string";
+    case Type::ARRAY:  return "array";
+    case Type::OBJECT: return "object";
+    }
+    return "UNKNOWN";
+  }
+
+  // Returned for missing array items and object members
+  static const JsonValue& Null() noexcept {
+    static const JsonValue null;
+    return null;
+  }
+
+  Type type() const noexcept { return type_; }
+  const char* typeStr() const noexcept { return TypeStr(type_); }
+  bool is_null() const noexcept { return type_ == Type::NUL; }
+  bool is_bool() const noexcept { return type_ == Type::BOOL; }
+  bool is_number() const noexcept { return type_ == Type::NUMBER; }
+  bool is_string() const noexcept { return type_ == Type::STRING; }
+  bool is_array() const noexcept { return type_ == Type::ARRAY; }
+  bool is_object() const noexcept { return type_ == Type::OBJECT; }
+
+  bool bool_value() const noexcept { return type_ == Type::BOOL && bool_; }
+
+  // The unescaped string, or an empty string for other types
+  StringT string_value() const noexcept {
+    return (type_ == Type::STRING ? StringT(static_cast<const char*>(ptr_), size_) : StringT());
+  }
+
+  // The number as it appeared in the document
+  StringT number_text() const noexcept {
+    return (type_ == Type::NUMBER ? StringT(static_cast<const char*>(ptr_), size_) : StringT());
+  }
+
+  // Exact conversion of a non-negative integer.  Fails for other numbers,
+  // including those with a fraction or exponent, and on overflow.
+  bool uint64_value(std::uint64_t& out) const noexcept {
+    if (type_ != Type::NUMBER || size_ == 0) {
+      return false;
+    }
+
+    const char* p = static_cast<const char*>(ptr_);
+    std::uint64_t v = 0;
+    for (SizeT i = 0; i < size_; ++i) {
+      if (p[i] < '0' || p[i] > '9') {
+        return false;
+      }
+      const std::uint64_t d = static_cast<std::uint64_t>(p[i] - '0');
+      if (v > (std::numeric_limits<std::uint64_t>::max() - d) / 10) {
+        return false;
+      }
+      v = v * 10 + d;
+    }
+    out = v;
+    return true;
+  }
+
+  double number_value() const noexcept {
+    // The document NUL terminates its buffer, and a number is always followed
+    // by a character that can't continue it.
+    return (type_ == Type::NUMBER ? std::strtod(static_cast<const char*>(ptr_), nullptr) : 0.0);
+  }
+
+  // Number of array items or object members
+  SizeT size() const noexcept { return (is_array() || is_object() ? size_ : 0); }
+
+  const JsonValue* items() const noexcept {
+    return (is_array() ? static_cast<const JsonValue*>(ptr_) : nullptr);
+  }
+  const JsonValue* begin() const noexcept { return items(); }
+  const JsonValue* end() const noexcept { return items() + size(); }
+
+  inline const JsonMember* members() const noexcept;
+
+  const JsonValue& operator[](const SizeT i) const noexcept {
+    return (is_array() && i < size_ ? items()[i] : Null());
+  }
+
+  // Member lookup by linear scan.  consul objects have few, short keys, for
+  // which comparing lengths first beats hashing.
+  inline const JsonValue* find(const StringT& key) const noexcept;
+
+  const JsonValue& operator[](const StringT& key) const noexcept {
+    const JsonValue* v = find(key);
+    return (v != nullptr ? *v : Null());
+  }
+
+  // Serialize with ", " and ": " separators
+  inline void dump(std::string& out) const;
+  std::string dump() const {
+    std::string out;
+    dump(out);
+    return out;
+  }
+
+  // Quote and escape str, as json11 does (see LICENSE), so that output is
+  // unchanged from the json11 based CLIs
+  static void DumpString(std::string& out, const StringT& str) {
+    out += '"';
+    for (std::size_t i = 0; i < str.size(); ++i) {
+      const char ch = str[i];
+      switch (ch) {
+      case '\\': out += "\\\\"; break;
+      case '"':  out += "\\\""; break;
+      case '\b': out += "\\b";  break;
+      case '\f': out += "\\f";  break;
+      case '\n': out += "\\n";  break;
+      case '\r': out += "\\r";  break;
+      case '\t': out += "\\t";  break;
+      default:
+        if (static_cast<std::uint8_t>(ch) <= 0x1f) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(ch));
+          out += buf;
+        } else if (static_cast<std::uint8_t>(ch) == 0xe2 && i + 2 < str.size() &&
+                   static_cast<std::uint8_t>(str[i + 1]) == 0x80 &&
+                   (static_cast<std::uint8_t>(str[i + 2]) == 0xa8 || static_cast<std::uint8_t>(str[i + 2]) == 0xa9)) {
+          // U+2028 and U+2029 aren't valid in JavaScript strings
+          out += (static_cast<std::uint8_t>(str[i + 2]) == 0xa8 ? "\\u2028" : "\\u2029");
+          i += 2;
+        } else {
+          out += ch;
+        }
+      }
+    }
+    out += '"';
+  }
+
+private:
+  friend class JsonDocument;
+
+  const void* ptr_ = nullptr;
+  SizeT size_ = 0;
+  Type type_ = Type::NUL;
+  bool bool_ = false;
+};
+
+
+struct JsonMember final {
+  JsonValue::StringT key;
+  JsonValue value;
+};
+
+
+const JsonMember*
+JsonValue::members() const noexcept {
+  return (is_object() ? static_cast<const JsonMember*>(ptr_) : nullptr);
+}
+
+
+const JsonValue*
+JsonValue::find(const StringT& key) const noexcept {
+  const JsonMember* m = members();
+  for (SizeT i = 0; i < size(); ++i) {
+    if (m[i].key.size() == key.size() && std::memcmp(m[i].key.data(), key.data(), key.size()) == 0) {
+      return &m[i].value;
+    }
+  }
+  return nullptr;
+}
+
+
+void
+JsonValue::dump(std::string& out) const {
+  switch (type_) {
+  case Type::NUL:
+    out += "null";
+    break;
+  case Type::BOOL:
+    out += (bool_ ? "true" : "false");
+    break;
+  case Type::NUMBER:
+    out.append(static_cast<const char*>(ptr_), size_);
+    break;
+  case Type::STRING:
+    DumpString(out, string_value());
+    break;
+  case Type::ARRAY:
+    out += '[';
+    for (SizeT i = 0; i < size_; ++i) {
+      if (i > 0) {
+        out += ", ";
+      }
+      items()[i].dump(out);
+    }
+    out += ']';
+    break;
+  case Type::OBJECT:
+    out += '{';
+    for (SizeT i = 0; i < size_; ++i) {
+      if (i > 0) {
+        out += ", ";
+      }
+      DumpString(out, members()[i].key);
+      out += ": ";
+      members()[i].value.dump(out);
+    }
+    out += '}';
+    break;
+  }
+}
+
+} // namespace consul
+
+#endif // CONSUL_JSON_VALUE_HPP
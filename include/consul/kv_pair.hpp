@@ -1,11 +1,19 @@
 #ifndef CONSUL_KV_PAIR_HPP
 #define CONSUL_KV_PAIR_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sstream>
 #include <string>
 
 #include "b64/decode.hpp"
 #include "b64/encode.hpp"
-#include "json11.hpp"
+#include "boost/lexical_cast.hpp"
+
+#include "consul/json_cursor.hpp"
+#include "consul/json_schema.hpp"
+#include "consul/json_value.hpp"
 
 namespace consul {
 
@@ -40,153 +48,35 @@ public:
     return str;
   }
 
-  static bool InitFromJson(KVPair& kvp, const json11::Json& obj, std::string& err) noexcept {
-    auto objMap = obj.object_items();
-    if (objMap.empty()) {
-      err = "Unexpected empty object in KV Pair response";
+  // Throws std::bad_alloc if an error message can't be formatted
+  static bool InitFromJson(KVPair& kvp, JsonCursor& cur, std::string& err) {
+    static constexpr JsonField<KVPair> fields[] = {
+      { "CreateIndex", &JsonDecodeUInt64<KVPair, &KVPair::createIndex_> },
+      { "ModifyIndex", &JsonDecodeUInt64<KVPair, &KVPair::modifyIndex_> },
+      { "LockIndex",   &JsonDecodeUInt64<KVPair, &KVPair::lockIndex_> },
+      { "Flags",       &JsonDecodeUInt64<KVPair, &KVPair::flags_> },
+      { "Key",         &JsonDecodeString<KVPair, &KVPair::key_> },
+      // null when the key isn't locked
+      { "Session",     &JsonDecodeString<KVPair, &KVPair::session_> },
+      { "Value",       &KVPair::DecodeValue },
+    };
+    static constexpr JsonSchema<KVPair, 7> schema{fields};
+    static_assert(schema.valid(), "no perfect hash for KVPair's fields");
+
+    std::size_t members = 0;
+    try {
+      if (!schema.decode(kvp, cur, members, err)) {
+        return false;
+      }
+    } catch (const std::bad_alloc&) {
+      err = "out of memory";
       return false;
     }
 
-    { // CreateIndex
-      auto it = objMap.find("CreateIndex");
-      if (it != objMap.end()) {
-        if (!it->second.is_number()) {
-          std::ostringstream ss;
-          ss << "CreateIndex's value is not a number: " << json11::Json::TypeStr(it->second);
-          err = ss.str();
-          return false;
-        }
-
-        try {
-          kvp.createIndex_ = ::boost::lexical_cast<IndexT>(it->second.int_value());
-        } catch(const ::boost::bad_lexical_cast &) {
-          std::ostringstream ss;
-          ss << "CreateIndex is not a valid Index: " << it->second.dump();
-          err = ss.str();
-          return false;
-        }
-      }
-    } // CreateIndex
-
-    { // ModifyIndex
-      auto it = objMap.find("ModifyIndex");
-      if (it != objMap.end()) {
-        if (!it->second.is_number()) {
-          std::ostringstream ss;
-          ss << "ModifyIndex's value is not a number: " << json11::Json::TypeStr(it->second);
-          err = ss.str();
-          return false;
-        }
-
-        try {
-          kvp.modifyIndex_ = ::boost::lexical_cast<IndexT>(it->second.int_value());
-        } catch(const ::boost::bad_lexical_cast &) {
-          std::ostringstream ss;
-          ss << "ModifyIndex is not a valid Index: " << it->second.dump();
-          err = ss.str();
-          return false;
-        }
-      }
-    } // ModifyIndex
-
-    // LockIndex
-    {
-      auto it = objMap.find("LockIndex");
-      if (it != objMap.end()) {
-        if (!it->second.is_number()) {
-          std::ostringstream ss;
-          ss << "LockIndex's value is not a number: " << json11::Json::TypeStr(it->second);
-          err = ss.str();
-          return false;
-        }
-
-        try {
-          kvp.lockIndex_ = ::boost::lexical_cast<IndexT>(it->second.int_value());
-        } catch(const ::boost::bad_lexical_cast &) {
-          std::ostringstream ss;
-          ss << "LockIndex is not a valid Index: " << it->second.dump();
-          err = ss.str();
-          return false;
-        }
-      }
-    } // LockIndex
-
-    // Flags
-    {
-      auto it = objMap.find("Flags");
-      if (it != objMap.end()) {
-        if (!it->second.is_number()) {
-          std::ostringstream ss;
-          ss << "Flags's value is not a number: " << json11::Json::TypeStr(it->second);
-          err = ss.str();
-          return false;
-        }
-
-        try {
-          kvp.flags_ = ::boost::lexical_cast<FlagsT>(it->second.int_value());
-        } catch(const ::boost::bad_lexical_cast &) {
-          std::ostringstream ss;
-          ss << "Flags is not valid: " << it->second.dump();
-          err = ss.str();
-          return false;
-        }
-      }
-    } // Flags
-
-    // Session
-    {
-      auto it = objMap.find("Session");
-      if (it != objMap.end()) {
-        if (!it->second.is_string()) {
-          std::ostringstream ss;
-          ss << "Session's value is not a string: " << typeid(it->second.type()).name();
-          err = ss.str();
-          return false;
-        }
-
-        kvp.session_ = it->second.string_value();
-      }
-    } // Session
-
-    // Key
-    {
-      auto it = objMap.find("Key");
-      if (it != objMap.end()) {
-        if (!it->second.is_string()) {
-          std::ostringstream ss;
-          ss << "Key's value is not a string: " << typeid(it->second.type()).name();
-          err = ss.str();
-          return false;
-        }
-
-        kvp.key_ = it->second.string_value();
-      } else {
-        // FIXME(seanc@): To throw, or not throw... that is the question when
-        // there's a protocol violation.
-      }
-    } // Key
-
-    // Value
-    {
-      auto it = objMap.find("Value");
-      if (it != objMap.end()) {
-        if (!it->second.is_string()) {
-          std::ostringstream ss;
-          ss << "Value's value is not a string: " << typeid(it->second.type()).name();
-          err = ss.str();
-          return false;
-        }
-
-        base64::decoder D;
-        std::istringstream iss{it->second.string_value()};
-        std::ostringstream oss;
-        D.decode(iss, oss);
-        kvp.value_ = oss.str();
-      } else {
-        // FIXME(seanc@): To throw, or not throw... that is the question when
-        // there's a protocol violation.
-      }
-    } // Value
+    if (members == 0) {
+      err = "Unexpected empty object in KV Pair response";
+      return false;
+    }
     return true;
   }
 
@@ -211,19 +101,26 @@ public:
   KeyT key() const noexcept { return key_; }
   ValueT value() const noexcept { return value_; }
 
-  std::string json() const { return json11::Json(*this).dump(); };
-  json11::Json to_json() const {
-    std::map<std::string, std::string> m = {
-      { "CreateIndex", ::boost::lexical_cast<ValueT>(createIndex_) },
-      { "ModifyIndex", ::boost::lexical_cast<ValueT>(modifyIndex_) },
-      { "LockIndex", ::boost::lexical_cast<ValueT>(lockIndex_) },
-      { "Flags", ::boost::lexical_cast<ValueT>(flags_) },
-      { "Session", session_ },
-      { "Key", key_ },
-      { "Value", valueEncoded() }
-    };
-
-    return json11::Json{m};
+  // Members in sorted order and every value a string, as the CLIs have always
+  // printed them
+  std::string json() const {
+    std::string out;
+    out += "{\"CreateIndex\": ";
+    JsonValue::DumpString(out, IndexStr(createIndex_));
+    out += ", \"Flags\": ";
+    JsonValue::DumpString(out, FlagsStr(flags_));
+    out += ", \"Key\": ";
+    JsonValue::DumpString(out, key_);
+    out += ", \"LockIndex\": ";
+    JsonValue::DumpString(out, IndexStr(lockIndex_));
+    out += ", \"ModifyIndex\": ";
+    JsonValue::DumpString(out, IndexStr(modifyIndex_));
+    out += ", \"Session\": ";
+    JsonValue::DumpString(out, session_);
+    out += ", \"Value\": ";
+    JsonValue::DumpString(out, valueEncoded());
+    out += "}";
+    return out;
   }
 
   std::string valueEncoded() const noexcept {
@@ -241,10 +138,29 @@ public:
   }
 
 private:
-  IndexT   createIndex_;
-  IndexT   modifyIndex_;
-  IndexT   lockIndex_;
-  FlagsT   flags_;
+  // null for keys without a value
+  static bool DecodeValue(KVPair& kvp, JsonCursor& cur, std::string& err) {
+    JsonCursor::StringT encoded;
+    if (cur.null()) {
+      return true;
+    }
+    if (!cur.string(encoded, err)) {
+      return false;
+    }
+
+    kvp.value_.resize(encoded.size() / 4 * 3 + 3);
+    base64::base64_decodestate state;
+    base64::base64_init_decodestate(&state);
+    const int len = base64::base64_decode_block(encoded.data(), static_cast<int>(encoded.size()),
+                                                &kvp.value_[0], &state);
+    kvp.value_.resize(static_cast<std::size_t>(len));
+    return true;
+  }
+
+  IndexT   createIndex_ = 0;
+  IndexT   modifyIndex_ = 0;
+  IndexT   lockIndex_ = 0;
+  FlagsT   flags_ = 0;
   KeyT     key_;
   SessionT session_;
   ValueT   value_;
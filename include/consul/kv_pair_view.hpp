@@ -0,0 +1,112 @@
+#ifndef CONSUL_KV_PAIR_VIEW_HPP
+#define CONSUL_KV_PAIR_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "b64/decode.hpp"
+
+#include "consul/json_cursor.hpp"
+#include "consul/json_schema.hpp"
+
+namespace consul {
+
+// A KV pair whose key, session and value are views into the response buffer
+// owned by a KVPairsView.  The value is base64 decoded in place the first time
+// it is accessed.
+class KVPairView final {
+public:
+  using ViewT  = JsonCursor::StringT;
+  using IndexT = std::uint64_t;
+  using FlagsT = std::uint64_t;
+
+  // Throws std::bad_alloc if an error message can't be formatted
+  static bool InitFromJson(KVPairView& kvp, JsonCursor& cur, std::string& err) {
+    static constexpr JsonField<KVPairView> fields[] = {
+      { "CreateIndex", &JsonDecodeUInt64<KVPairView, &KVPairView::createIndex_> },
+      { "ModifyIndex", &JsonDecodeUInt64<KVPairView, &KVPairView::modifyIndex_> },
+      { "LockIndex",   &JsonDecodeUInt64<KVPairView, &KVPairView::lockIndex_> },
+      { "Flags",       &JsonDecodeUInt64<KVPairView, &KVPairView::flags_> },
+      { "Key",         &JsonDecodeView<KVPairView, &KVPairView::key_> },
+      { "Session",     &JsonDecodeView<KVPairView, &KVPairView::session_> },
+      { "Value",       &KVPairView::DecodeValue },
+    };
+    static constexpr JsonSchema<KVPairView, 7> schema{fields};
+    static_assert(schema.valid(), "no perfect hash for KVPairView's fields");
+
+    std::size_t members = 0;
+    if (!schema.decode(kvp, cur, members, err)) {
+      return false;
+    }
+    if (members == 0) {
+      err = "Unexpected empty object in KV Pair response";
+      return false;
+    }
+    return true;
+  }
+
+  IndexT createIndex() const noexcept { return createIndex_; }
+  IndexT modifyIndex() const noexcept { return modifyIndex_; }
+  IndexT lockIndex() const noexcept { return lockIndex_; }
+  FlagsT flags() const noexcept { return flags_; }
+
+  ViewT key() const noexcept { return key_; }
+  ViewT session() const noexcept { return session_; }
+
+  // The decoded value, followed by a NUL.  Decoding overwrites the base64 text
+  // in the response buffer, which is safe because the decoded value (and its
+  // NUL) is always shorter.
+  ViewT value() const noexcept {
+    if (!valueDecoded_ && value_.empty()) {
+      value_ = ViewT("", 0);
+    } else if (!valueDecoded_) {
+      // base64_decode_block() can't decode in place: it writes its saved
+      // state to the output before reading any input.
+      char* const data = const_cast<char*>(value_.data());
+      std::size_t size = 0;
+      unsigned int bits = 0;
+      int numBits = 0;
+      for (const char c : value_) {
+        const int sextet = base64::base64_decode_value(c);
+        if (sextet < 0) {
+          continue;
+        }
+        bits = (bits << 6) | static_cast<unsigned int>(sextet);
+        numBits += 6;
+        if (numBits >= 8) {
+          numBits -= 8;
+          data[size++] = static_cast<char>((bits >> numBits) & 0xFF);
+        }
+      }
+      data[size] = '\0';
+      value_ = ViewT(data, size);
+    }
+    valueDecoded_ = true;
+    return value_;
+  }
+
+private:
+  // null for keys without a value
+  static bool DecodeValue(KVPairView& kvp, JsonCursor& cur, std::string& err) noexcept {
+    ViewT encoded;
+    if (!cur.null() && !cur.string(encoded, err)) {
+      return false;
+    }
+    kvp.value_ = encoded;
+    return true;
+  }
+
+  IndexT createIndex_ = 0;
+  IndexT modifyIndex_ = 0;
+  IndexT lockIndex_ = 0;
+  FlagsT flags_ = 0;
+  ViewT  key_;
+  ViewT  session_;
+  mutable ViewT value_;
+  mutable bool  valueDecoded_ = false;
+};
+
+} // namespace consul
+
+#endif // CONSUL_KV_PAIR_VIEW_HPP
@@ -1,13 +1,14 @@
 #ifndef CONSUL_KV_PAIRS_HPP
 #define CONSUL_KV_PAIRS_HPP
 
+#include <cstddef>
+#include <new>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "b64/decode.hpp"
-#include "b64/encode.hpp"
-#include "json11.hpp"
-
+#include "consul/json_cursor.hpp"
+#include "consul/json_index.hpp"
 #include "consul/kv_pair.hpp"
 
 namespace consul {
@@ -16,42 +17,62 @@ class KVPairs final {
 public:
   using KVPairsT = std::vector<KVPair>;
 
-  static bool InitFromJson(KVPairs& kvps, std::string json, std::string& err) noexcept {
-    auto jr = json11::Json::parse(json, err);
-    if (!err.empty()) {
-      std::ostringstream ss;
-      ss << "Parsing JSON failed: " << err;
-      err = ss.str();
-      return false;
-    }
+  // Decodes json in place, in a single pass.  index is as for KVPairsView.
+  static bool InitFromJson(KVPairs& kvps, std::string json, std::string& err,
+                           const bool index = false) noexcept {
+    char* const begin = &json[0];
+    const std::size_t len = json.size();
 
-    if (!jr.is_array()) {
-      std::ostringstream ss;
-      ss << "Expected array, received " << json11::Json::TypeStr(jr) << " as input.";
-      err = ss.str();
+    JsonIndex idx;
+    std::string indexErr;
+    const bool indexed = (index && len >= JsonIndex::MIN_SIZE && JsonIndex::Build(idx, begin, len, indexErr));
+    JsonCursor cur{begin, begin + len, indexed ? &idx : nullptr};
+    if (!cur.expect('[', err)) {
+      err = "Parsing JSON failed: " + err;
       return false;
     }
 
-    const auto arr = jr.array_items();
-    for (auto& obj : arr) {
-      KVPair kvp;
-      if (KVPair::InitFromJson(kvp, obj, err)) {
-        kvps.objs_.push_back(kvp);
-      } else {
-        std::ostringstream ss;
-        ss << "Parsing JSON Objects failed: " << err;
-        err = ss.str();
-        return false;
+    try {
+      if (!cur.consume(']')) {
+        do {
+          KVPair kvp;
+          if (!KVPair::InitFromJson(kvp, cur, err)) {
+            err = "Parsing JSON Objects failed: " + err;
+            return false;
+          }
+          kvps.objs_.push_back(std::move(kvp));
+        } while (cur.consume(','));
+
+        if (!cur.expect(']', err)) {
+          err = "Parsing JSON failed: " + err;
+          return false;
+        }
       }
+    } catch (const std::bad_alloc&) {
+      err = "out of memory";
+      return false;
     }
 
+    if (!cur.atEnd()) {
+      cur.fail("Parsing JSON failed: trailing data", err);
+      return false;
+    }
     return true;
   }
 
   const KVPairsT& objs() const noexcept { return objs_; }
   KVPairsT::size_type size() const noexcept { return objs_.size(); }
-  std::string json() const { return json11::Json(*this).dump(); };
-  json11::Json to_json() const { return json11::Json::array{objs_}; }
+  std::string json() const {
+    std::string out = "[";
+    for (const auto& kvp : objs_) {
+      if (out.size() > 1) {
+        out += ", ";
+      }
+      out += kvp.json();
+    }
+    out += "]";
+    return out;
+  }
 
 private:
   KVPairsT objs_;
@@ -0,0 +1,98 @@
+#ifndef CONSUL_KV_PAIRS_VIEW_HPP
+#define CONSUL_KV_PAIRS_VIEW_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "consul/json_cursor.hpp"
+#include "consul/json_index.hpp"
+#include "consul/kv_pair_view.hpp"
+
+namespace consul {
+
+// The KV pairs of a /v1/kv/ response, parsed in place.  Owns the response
+// body, which every KVPairView points into, and therefore can be neither
+// copied nor moved once initialized.  The KVPairViews are stored with Alloc.
+template <typename Alloc = std::allocator<KVPairView>>
+class BasicKVPairsView final {
+public:
+  using KVPairsT = std::vector<KVPairView, Alloc>;
+
+  explicit BasicKVPairsView(const Alloc& alloc = Alloc()) : objs_{alloc} {}
+  BasicKVPairsView(const BasicKVPairsView&) = delete;
+  BasicKVPairsView& operator=(const BasicKVPairsView&) = delete;
+
+  // With index, responses of JsonIndex::MIN_SIZE or more are indexed before
+  // they are parsed.  That only pays off for responses with large values, so
+  // it is off unless asked for.
+  static bool InitFromJson(BasicKVPairsView& kvps, std::string&& json, std::string& err,
+                           const bool index = false) noexcept {
+    kvps.objs_.clear();
+    kvps.buf_ = std::move(json);
+
+    char* const begin = &kvps.buf_[0];
+    const std::size_t len = kvps.buf_.size();
+
+    // Without an index (or if building it fails) the cursor scans every
+    // string.
+    JsonIndex idx;
+    std::string indexErr;
+    const bool indexed = (index && len >= JsonIndex::MIN_SIZE && JsonIndex::Build(idx, begin, len, indexErr));
+    JsonCursor cur{begin, begin + len, indexed ? &idx : nullptr};
+    if (!cur.expect('[', err)) {
+      std::ostringstream ss;
+      ss << "Parsing JSON failed: " << err;
+      err = ss.str();
+      return false;
+    }
+
+    try {
+      if (!cur.consume(']')) {
+        do {
+          KVPairView kvp;
+          if (!KVPairView::InitFromJson(kvp, cur, err)) {
+            std::ostringstream ss;
+            ss << "Parsing JSON Objects failed: " << err;
+            err = ss.str();
+            return false;
+          }
+          kvps.objs_.push_back(kvp);
+        } while (cur.consume(','));
+
+        if (!cur.expect(']', err)) {
+          std::ostringstream ss;
+          ss << "Parsing JSON failed: " << err;
+          err = ss.str();
+          return false;
+        }
+      }
+    } catch (const std::bad_alloc&) {
+      err = "out of memory";
+      return false;
+    }
+
+    if (!cur.atEnd()) {
+      cur.fail("Parsing JSON failed: trailing data", err);
+      return false;
+    }
+    return true;
+  }
+
+  const KVPairsT& objs() const noexcept { return objs_; }
+  typename KVPairsT::size_type size() const noexcept { return objs_.size(); }
+
+private:
+  std::string buf_;
+  KVPairsT objs_;
+};
+
+using KVPairsView = BasicKVPairsView<>;
+
+} // namespace consul
+
+#endif // CONSUL_KV_PAIRS_VIEW_HPP
@@ -0,0 +1,95 @@
+#ifndef CONSUL_LATENCY_HISTOGRAM_HPP
+#define CONSUL_LATENCY_HISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace consul {
+
+// Histogram of request latencies in microseconds with log-linear buckets
+// (four buckets per power of two, i.e. <= 25% error).  Counts are halved
+// every DECAY_AFTER samples so percentiles track recent behavior.  Plain
+// data without any allocation so it can be placed in shared memory.
+struct LatencyHistogram final {
+  using CountT = std::uint64_t;
+  using LatencyT = std::uint64_t;
+
+  static constexpr const std::size_t SUB_BUCKET_BITS = 2;
+  static constexpr const std::size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  // Covers latencies up to 2^32us (~71 minutes)
+  static constexpr const std::size_t NUM_BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+  static constexpr const CountT DECAY_AFTER = 4096;
+
+  CountT counts[NUM_BUCKETS];
+  CountT total;
+
+  void clear() noexcept {
+    for (auto& c : counts) {
+      c = 0;
+    }
+    total = 0;
+  }
+
+  static std::size_t Bucket(LatencyT us) noexcept {
+    if (us < SUB_BUCKETS) {
+      return static_cast<std::size_t>(us);
+    }
+
+    std::size_t octave = 0;
+    for (LatencyT v = us; v > 1; v >>= 1) {
+      octave++;
+    }
+    const auto sub = static_cast<std::size_t>(us >> (octave - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    const auto bucket = (octave - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    return (bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1);
+  }
+
+  // Largest latency that falls into bucket
+  static LatencyT UpperBound(const std::size_t bucket) noexcept {
+    if (bucket < SUB_BUCKETS) {
+      return static_cast<LatencyT>(bucket);
+    }
+
+    const auto octave = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const auto sub = bucket % SUB_BUCKETS;
+    return ((static_cast<LatencyT>(SUB_BUCKETS + sub + 1)) << (octave - SUB_BUCKET_BITS)) - 1;
+  }
+
+  void record(const LatencyT us) noexcept {
+    if (total >= DECAY_AFTER) {
+      total = 0;
+      for (auto& c : counts) {
+        c /= 2;
+        total += c;
+      }
+    }
+    counts[Bucket(us)]++;
+    total++;
+  }
+
+  // Upper bound of the bucket containing the pct-th percentile, or 0 if no
+  // samples have been recorded.
+  LatencyT percentile(const double pct) const noexcept {
+    if (total == 0) {
+      return 0;
+    }
+
+    auto rank = static_cast<CountT>(pct / 100.0 * static_cast<double>(total) + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+
+    CountT seen = 0;
+    for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return UpperBound(i);
+      }
+    }
+    return UpperBound(NUM_BUCKETS - 1);
+  }
+};
+
+} // namespace consul
+
+#endif // CONSUL_LATENCY_HISTOGRAM_HPP
@@ -7,7 +7,8 @@
 
 #include "boost/algorithm/string.hpp"
 #include "boost/lexical_cast.hpp"
-#include "json11.hpp"
+
+#include "consul/json_document.hpp"
 
 namespace consul {
 struct Peer final {
@@ -23,7 +24,7 @@ public:
   Peer() {}
   Peer(HostT host_, PortT port_) : host{host_}, port{port_} {}
 
-  static bool InitFromJson(Peer& peer, const json11::Json& json, std::string& err) {
+  static bool InitFromJson(Peer& peer, const JsonValue& json, std::string& err) {
     if (!json.is_string()) {
       err = "Expected a JSON string object as input";
       return false;
@@ -34,16 +35,17 @@ public:
     // the peer's leader state to false and move on, but return true.  We
     // successfully parsed nothing, meaning no leader, but no error in the
     // API call.
-    if (json.string_value().size() == 0) {
+    const auto hostPort = json.string_value();
+    if (hostPort.size() == 0) {
       peer.leader = false;
       return true;
     }
 
     std::vector<std::string> toks;
-    boost::split(toks, json.string_value(), boost::is_any_of(":"), boost::token_compress_on);
+    boost::split(toks, hostPort, boost::is_any_of(":"), boost::token_compress_on);
     if (toks.size() != 2) {
       std::ostringstream errMsg;
-      errMsg << "Expected a host:port pattern from string \"" << json.string_value() << "\"";
+      errMsg << "Expected a host:port pattern from string \"" << hostPort << "\"";
       err = errMsg.str();
       return false;
     }
@@ -65,25 +67,24 @@ public:
     return true;
   }
 
-  static bool InitFromJson(Peer& peer, const std::string& json_, std::string& err) {
-    using json11::Json;
-
-    auto jr = Json::parse(json_, err);
-    if (!err.empty()) {
+  static bool InitFromJson(Peer& peer, const std::string& json_, std::string& err,
+                           const JsonAllocator& alloc = JsonAllocator()) {
+    JsonDocument doc{alloc};
+    if (!JsonDocument::Parse(doc, json_, err)) {
       std::ostringstream errMsg;
       errMsg << "Failed to parse JSON from (" << json_ << "): " << err;
       err = errMsg.str();
       return false;
     }
 
-    if (!jr.is_string()) {
+    if (!doc.root().is_string()) {
       std::ostringstream errMsg;
-      errMsg << "Expected a JSON string (" << json_ << "): " << err;
+      errMsg << "Expected a JSON string (" << json_ << "): " << doc.root().typeStr();
       err = errMsg.str();
       return false;
     }
 
-    return InitFromJson(peer, jr, err);
+    return InitFromJson(peer, doc.root(), err);
   }
 
   static bool InitFromJson(Peer& peer, const std::string& json_) {
@@ -91,11 +92,10 @@ public:
     return InitFromJson(peer, json_, err);
   }
 
-  std::string json() const { return json11::Json(*this).dump(); };
-  json11::Json to_json() const {
-    std::ostringstream ss;
-    ss << host << ":" << port;
-    return json11::Json{ss.str()};
+  std::string json() const {
+    std::string out;
+    JsonValue::DumpString(out, str());
+    return out;
   }
 
   std::string portStr() const noexcept {
@@ -1,10 +1,11 @@
 #ifndef CONSUL_PEERS_HPP
 #define CONSUL_PEERS_HPP
 
+#include <sstream>
+#include <string>
 #include <vector>
 
-#include "json11.hpp"
-
+#include "consul/json_document.hpp"
 #include "consul/peer.hpp"
 
 namespace consul {
@@ -13,38 +14,31 @@ struct Peers {
   using PeersT = std::vector<::consul::Peer>;
   PeersT peers;
 
-  static bool InitFromJson(Peers& peers, const std::string& json, std::string& err) {
-    auto jr = json11::Json::parse(json, err);
-    if (!err.empty()) {
+  static bool InitFromJson(Peers& peers, const std::string& json, std::string& err,
+                           const JsonAllocator& alloc = JsonAllocator()) {
+    JsonDocument doc{alloc};
+    if (!JsonDocument::Parse(doc, json, err)) {
       std::ostringstream ss;
       ss << "Parsing JSON failed: " << err;
       err = ss.str();
       return false;
     }
 
+    const JsonValue& jr = doc.root();
     if (!jr.is_array()) {
       std::ostringstream ss;
-      ss << "Expected array, received ";
-
-      if (jr.is_null()) {           ss << "null";
-      } else if (jr.is_number()) {  ss << "number";
-      } else if (jr.is_bool()) {    ss << "bool";
-      } else if (jr.is_string()) {  ss << "string";
-      } else if (jr.is_object()) {  ss << "object";
-      } else if (jr.is_array()) {   ss << "array";   // for completeness
-      } else {                      ss << "UNKNOWN"; /* lolwut??!! */ }
-
-      ss << " as input.";
+      ss << "Expected array, received " << jr.typeStr() << " as input.";
+      err = ss.str();
       return false;
     }
 
-    auto arr = jr.array_items();
-    if (arr.empty()) {
+    if (jr.size() == 0) {
       err = "Unexpected empty array of peers";
       return false;
     }
 
-    for (auto &jsPeer: arr) {
+    peers.peers.reserve(peers.peers.size() + jr.size());
+    for (auto &jsPeer: jr) {
       ::consul::Peer peer;
       if (!::consul::Peer::InitFromJson(peer, jsPeer, err)) {
         std::ostringstream ss;
@@ -0,0 +1,57 @@
+#ifndef CONSUL_QUERY_META_HPP
+#define CONSUL_QUERY_META_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "boost/lexical_cast.hpp"
+
+namespace consul {
+
+// Metadata consul attaches to every read as X-Consul-* response headers.
+struct QueryMeta final {
+  using IndexT = std::uint64_t;
+  using LastContactT = std::uint64_t;
+
+  static constexpr const char* INDEX_HEADER = "X-Consul-Index";
+  static constexpr const char* KNOWN_LEADER_HEADER = "X-Consul-KnownLeader";
+  static constexpr const char* LAST_CONTACT_HEADER = "X-Consul-LastContact";
+
+  // Raft index of the data returned
+  IndexT index = 0;
+  // Time in ms since the answering server was last contacted by the leader
+  LastContactT lastContactMs = 0;
+  // True if the answering server currently knows who the leader is
+  bool knownLeader = true;
+
+  // HeaderMapT is any std::map-like container keyed by header name, e.g.
+  // cpr::Header.  Missing headers leave the defaults in place.
+  template <typename HeaderMapT>
+  static bool InitFromHeaders(QueryMeta& meta, const HeaderMapT& headers, std::string& err) noexcept {
+    try {
+      auto it = headers.find(INDEX_HEADER);
+      if (it != headers.end()) {
+        meta.index = ::boost::lexical_cast<IndexT>(it->second);
+      }
+
+      it = headers.find(LAST_CONTACT_HEADER);
+      if (it != headers.end()) {
+        meta.lastContactMs = ::boost::lexical_cast<LastContactT>(it->second);
+      }
+
+      it = headers.find(KNOWN_LEADER_HEADER);
+      if (it != headers.end()) {
+        meta.knownLeader = (it->second == "true");
+      }
+    } catch (const ::boost::bad_lexical_cast& e) {
+      err = "Invalid X-Consul-* response header";
+      return false;
+    }
+
+    return true;
+  }
+};
+
+} // namespace consul
+
+#endif // CONSUL_QUERY_META_HPP
@@ -4,6 +4,7 @@
 #include "api.h"
 #include "auth.h"
 #include "cprtypes.h"
+#include "multi.h"
 #include "response.h"
 #include "session.h"
 
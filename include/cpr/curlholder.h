@@ -13,6 +13,10 @@ struct CurlHolder {
     char error[CURL_ERROR_SIZE];
 };
 
+struct ShareHolder {
+    CURLSH* handle;
+};
+
 } // namespace cpr
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef CPR_ENCODING_H
+#define CPR_ENCODING_H
+
+#include <string>
+
+namespace cpr {
+
+// Content encodings to request with Accept-Encoding, e.g. "gzip, deflate".
+// Responses are decoded by libcurl as they arrive.  The empty string asks for
+// every encoding libcurl was built with.
+class AcceptEncoding {
+  public:
+    AcceptEncoding(const std::string& p_encodings = "") : encodings(p_encodings) {}
+
+    std::string encodings;
+};
+
+} // namespace cpr
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CPR_MULTI_H
+#define CPR_MULTI_H
+
+#include <memory>
+
+#include "session.h"
+
+namespace cpr {
+
+// Drives several Sessions concurrently from a single thread using curl_multi.
+// Sessions are prepared (e.g. Session::PrepareGet()) before being added and
+// must outlive their membership in the Multi.  Removing a Session before it
+// is done cancels its transfer.
+class Multi {
+  public:
+    Multi();
+    ~Multi();
+
+    void Add(Session& session);
+    void Remove(Session& session);
+
+    // Advance all transfers without blocking.  Returns the number of
+    // transfers still running.
+    int Perform();
+    // Wait up to timeout_ms for activity on any transfer.
+    void Poll(const long& timeout_ms);
+    // A Session whose transfer is done, or nullptr.  The Session is removed
+    // from the Multi and its Response can be collected with Complete().
+    Session* NextDone();
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> pimpl_;
+};
+
+} // namespace cpr
+
+#endif
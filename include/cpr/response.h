@@ -24,6 +24,10 @@ class Response {
     Url url;
     double elapsed;
     Cookies cookies;
+    // Bytes received for the body as sent, i.e. before any Content-Encoding
+    // is decoded into text, and for the headers.
+    long long downloaded_bytes = 0;
+    long long header_bytes = 0;
 };
 
 } // namespace cpr
@@ -8,15 +8,20 @@
 #include "cookies.h"
 #include "cprtypes.h"
 #include "digest.h"
+#include "encoding.h"
 #include "multipart.h"
 #include "parameters.h"
 #include "payload.h"
 #include "proxies.h"
 #include "response.h"
+#include "share.h"
+#include "ssl.h"
 #include "timeout.h"
 
 namespace cpr {
 
+struct CurlHolder;
+
 class Session {
   public:
     Session();
@@ -27,6 +32,11 @@ class Session {
     void SetParameters(Parameters&& parameters);
     void SetHeader(const Header& header);
     void SetTimeout(const Timeout& timeout);
+    void SetConnectTimeout(const ConnectTimeout& timeout);
+    void SetShare(const Share& share);
+    void SetSslOptions(const SslOptions& options);
+    void SetHttpVersion(const HttpVersion& version);
+    void SetAcceptEncoding(const AcceptEncoding& encoding);
     void SetAuth(const Authentication& auth);
     void SetDigest(const Digest& auth);
     void SetPayload(Payload&& payload);
@@ -47,6 +57,11 @@ class Session {
     void SetOption(Parameters&& parameters);
     void SetOption(const Header& header);
     void SetOption(const Timeout& timeout);
+    void SetOption(const ConnectTimeout& timeout);
+    void SetOption(const Share& share);
+    void SetOption(const SslOptions& options);
+    void SetOption(const HttpVersion& version);
+    void SetOption(const AcceptEncoding& encoding);
     void SetOption(const Authentication& auth);
     void SetOption(const Digest& auth);
     void SetOption(Payload&& payload);
@@ -69,6 +84,14 @@ class Session {
     Response Post();
     Response Put();
 
+    // Used with cpr::Multi: PrepareGet() and PreparePut() configure a GET or
+    // PUT without performing it and Complete() collects the Response once the
+    // transfer is done.  A Session may alternate between the two.
+    void PrepareGet();
+    void PreparePut();
+    Response Complete();
+    CurlHolder* GetCurlHolder();
+
   private:
     class Impl;
     std::unique_ptr<Impl> pimpl_;
@@ -0,0 +1,31 @@
+#ifndef CPR_SHARE_H
+#define CPR_SHARE_H
+
+#include <memory>
+
+namespace cpr {
+
+struct ShareHolder;
+
+// State shared between the Sessions it is set on: the DNS cache, TLS session
+// cache and connection cache, so later requests skip name resolution and
+// reuse open connections.  Not thread-safe: every Session using a Share must
+// be driven from the same thread.  The Share must outlive those Sessions.
+class Share {
+  public:
+    Share();
+    ~Share();
+
+    Share(const Share&) = delete;
+    Share& operator=(const Share&) = delete;
+
+    ShareHolder* GetShareHolder() const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> pimpl_;
+};
+
+} // namespace cpr
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CPR_SSL_H
+#define CPR_SSL_H
+
+#include <string>
+
+namespace cpr {
+
+// TLS settings for https:// URLs.  Empty paths keep libcurl's defaults, i.e.
+// the system CA bundle and no client certificate.
+class SslOptions {
+  public:
+    SslOptions() {}
+    SslOptions(const std::string& p_ca_file, const std::string& p_cert_file, const std::string& p_key_file)
+            : ca_file(p_ca_file), cert_file(p_cert_file), key_file(p_key_file) {}
+
+    std::string ca_file;
+    std::string cert_file;
+    std::string key_file;
+};
+
+// HTTP version to use.  HTTP_2_TLS negotiates HTTP/2 with ALPN on https://
+// URLs, which lets concurrent requests in a Multi share one connection, and
+// keeps HTTP/1.1 for http:// URLs.
+enum class HttpVersion { DEFAULT, HTTP_1_1, HTTP_2_TLS };
+
+} // namespace cpr
+
+#endif
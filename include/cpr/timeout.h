@@ -10,6 +10,13 @@ class Timeout {
     long ms;
 };
 
+class ConnectTimeout {
+  public:
+    ConnectTimeout(const long& timeout) : ms(timeout) {}
+
+    long ms;
+};
+
 } // namespace cpr
 
 #endif
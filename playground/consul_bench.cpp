@@ -0,0 +1,628 @@
+/*-------------------------------------------------------------------------
+ *
+ * consul_bench.cpp	Load generator for consul's KV, txn and status
+ *			endpoints
+ *
+ * Copyright (c) 2015, Groupon, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+extern "C" {
+#include <sysexits.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "b64/encode.hpp"
+#include "cpr/cpr.h"
+#include "cpr/multi.h"
+#define ELPP_NO_DEFAULT_LOG_FILE
+#define ELPP_STACKTRACE_ON_CRASH
+#define ELPP_STL_LOGGING
+#define ELPP_THREAD_SAFE
+#include "easylogging++.h"
+#include "tclap/CmdLine.h"
+
+#include "consul/agent.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static constexpr const char* COMMAND_HELP_MSG =
+    u8"consul-bench drives KV, txn and status requests against a consul agent "
+    u8"with a fixed number of concurrent connections, optionally at a target "
+    u8"rate, and reports throughput and the latency distribution.";
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+
+// Latency histogram in microseconds laid out like HdrHistogram's: 2^SUB_BITS
+// linear buckets per power of two, so values are recorded within 1%.  Unlike
+// consul::LatencyHistogram nothing decays; every sample is kept.
+class Histogram final {
+public:
+  using ValueT = std::uint64_t;
+
+  static constexpr const unsigned SUB_BITS = 7;
+  static constexpr const ValueT SUB_BUCKETS = ValueT{1} << SUB_BITS;
+
+  Histogram() : counts_((64 - SUB_BITS + 1) * SUB_BUCKETS) {}
+
+  void record(const ValueT v) noexcept {
+    counts_[Index(v)]++;
+    total_++;
+    sum_ += static_cast<double>(v);
+    sumSq_ += static_cast<double>(v) * static_cast<double>(v);
+    min_ = std::min(min_, v);
+    max_ = std::max(max_, v);
+  }
+
+  std::uint64_t count() const noexcept { return total_; }
+  ValueT min() const noexcept { return total_ > 0 ? min_ : 0; }
+  ValueT max() const noexcept { return max_; }
+  double mean() const noexcept { return total_ > 0 ? sum_ / total_ : 0.0; }
+  double stddev() const noexcept {
+    if (total_ == 0) {
+      return 0.0;
+    }
+    const double m = mean();
+    return std::sqrt(std::max(0.0, sumSq_ / total_ - m * m));
+  }
+
+  // Highest value equivalent to the pct-th percentile sample
+  ValueT percentile(const double pct) const noexcept {
+    if (total_ == 0) {
+      return 0;
+    }
+
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(pct / 100.0 * total_)));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(HighestEquivalent(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  // Number of samples <= v
+  std::uint64_t countAtOrBelow(const ValueT v) const noexcept {
+    std::uint64_t seen = 0;
+    const std::size_t last = Index(v);
+    for (std::size_t i = 0; i <= last; ++i) {
+      seen += counts_[i];
+    }
+    return seen;
+  }
+
+private:
+  static std::size_t Index(const ValueT v) noexcept {
+    if (v < 2 * SUB_BUCKETS) {
+      return static_cast<std::size_t>(v);
+    }
+    const unsigned shift = 63 - static_cast<unsigned>(__builtin_clzll(v)) - SUB_BITS;
+    return static_cast<std::size_t>(shift * SUB_BUCKETS + (v >> shift));
+  }
+
+  static ValueT HighestEquivalent(const std::size_t i) noexcept {
+    if (i < 2 * SUB_BUCKETS) {
+      return static_cast<ValueT>(i);
+    }
+    const std::size_t shift = i / SUB_BUCKETS - 1;
+    const ValueT mantissa = static_cast<ValueT>(i - shift * SUB_BUCKETS);
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t total_ = 0;
+  double sum_ = 0.0;
+  double sumSq_ = 0.0;
+  ValueT min_ = ~ValueT{0};
+  ValueT max_ = 0;
+};
+
+
+// Picks the index of the key each request operates on
+class KeyChooser final {
+public:
+  enum class Distribution : char { UNIFORM, ZIPFIAN };
+
+  KeyChooser(const Distribution dist, const std::size_t n, const double theta, const std::uint64_t seed)
+    : dist_{dist}, n_{n}, theta_{theta}, rng_{seed}, uniform_{0, n - 1} {
+    if (dist_ == Distribution::ZIPFIAN) {
+      // Gray et al., "Quickly Generating Billion-Record Synthetic
+      // Databases", as used by YCSB
+      for (std::size_t i = 1; i <= n_; ++i) {
+        zetan_ += 1.0 / std::pow(static_cast<double>(i), theta_);
+      }
+      const double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta_);
+      alpha_ = 1.0 / (1.0 - theta_);
+      eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+    }
+  }
+
+  std::size_t next() {
+    if (dist_ == Distribution::UNIFORM) {
+      return uniform_(rng_);
+    }
+
+    const double u = unit_(rng_);
+    const double uz = u * zetan_;
+    std::size_t rank;
+    if (uz < 1.0) {
+      rank = 0;
+    } else if (uz < 1.0 + std::pow(0.5, theta_)) {
+      rank = 1;
+    } else {
+      rank = static_cast<std::size_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    }
+
+    // Scatter the popular ranks across the keyspace (FNV-1a of the rank)
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+      h = (h ^ ((rank >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+    }
+    return static_cast<std::size_t>(h % n_);
+  }
+
+private:
+  Distribution dist_;
+  std::size_t n_;
+  double theta_;
+  double zetan_ = 0.0;
+  double alpha_ = 0.0;
+  double eta_ = 0.0;
+  std::mt19937_64 rng_;
+  std::uniform_int_distribution<std::size_t> uniform_;
+  std::uniform_real_distribution<double> unit_{0.0, 1.0};
+};
+
+
+enum class Workload : char { KV, TXN, LEADER, PEERS };
+
+struct Options {
+  Workload workload = Workload::KV;
+  std::size_t connections = 16;
+  double rate = 0.0;
+  std::chrono::milliseconds duration{10000};
+  std::size_t keys = 10000;
+  std::string prefix = "bench/";
+  KeyChooser::Distribution distribution = KeyChooser::Distribution::UNIFORM;
+  double theta = 0.99;
+  std::size_t valueSize = 128;
+  double readPct = 90.0;
+  std::size_t txnOps = 8;
+  bool populate = false;
+  bool histogram = false;
+};
+
+std::string
+keyName(const Options& opts, const std::size_t i) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%08zu", i);
+  return opts.prefix + buf;
+}
+
+std::string
+base64Encode(const std::string& in) {
+  std::string out(in.size() * 2 + 4, '\0');
+  ::base64::base64_encodestate state;
+  ::base64::base64_init_encodestate(&state);
+  int len = ::base64::base64_encode_block(in.data(), static_cast<int>(in.size()), &out[0], &state);
+  len += ::base64::base64_encode_blockend(&out[len], &state);
+  out.resize(static_cast<std::size_t>(len));
+  // libb64 wraps its output, which consul doesn't accept
+  out.erase(std::remove(out.begin(), out.end(), '\n'), out.end());
+  return out;
+}
+
+
+// One connection to the agent and the request in flight on it
+struct Conn {
+  cpr::Session session;
+  Clock::time_point intended;
+  bool busy = false;
+};
+
+struct Results {
+  Histogram latency;
+  std::map<long, std::uint64_t> statuses;
+  std::uint64_t errors = 0;
+  std::uint64_t reads = 0;
+  std::uint64_t writes = 0;
+  std::uint64_t bytes = 0;
+  std::chrono::nanoseconds elapsed{0};
+};
+
+
+// Write every key once, in /v1/txn batches of 64 operations
+bool
+populate(::consul::Agent& agent, const Options& opts, const std::string& encoded) {
+  for (std::size_t i = 0; i < opts.keys; ) {
+    std::ostringstream body;
+    body << "[";
+    for (std::size_t j = 0; j < 64 && i < opts.keys; ++j, ++i) {
+      body << (j > 0 ? "," : "") << R"({"KV":{"Verb":"set","Key":")" << keyName(opts, i)
+           << R"(","Value":")" << encoded << R"("}})";
+    }
+    body << "]";
+
+    auto r = cpr::Put(cpr::Url{agent.txnUrl()}, cpr::Body{body.str()}, cpr::Timeout{agent.timeoutMs()});
+    if (r.status_code != 200) {
+      LOG(ERROR) << "Populating " << opts.prefix << " failed with status " << r.status_code << ": " << r.text;
+      return false;
+    }
+  }
+  return true;
+}
+
+
+class Bench final {
+public:
+  Bench(::consul::Agent& agent, const Options& opts)
+    : agent_(agent), opts_(opts),
+      keys_{opts.distribution, opts.keys, opts.theta, std::random_device{}()},
+      rng_{std::random_device{}()} {
+    std::string value(opts.valueSize, '\0');
+    for (std::size_t i = 0; i < value.size(); ++i) {
+      value[i] = static_cast<char>('a' + i % 26);
+    }
+    value_ = value;
+    encoded_ = base64Encode(value);
+  }
+
+  const std::string& encodedValue() const noexcept { return encoded_; }
+
+  void run(Results& res) {
+    std::vector<std::unique_ptr<Conn>> conns;
+    std::map<cpr::Session*, Conn*> bySession;
+    for (std::size_t i = 0; i < opts_.connections; ++i) {
+      conns.emplace_back(new Conn);
+      conns.back()->session.SetTimeout(cpr::Timeout{agent_.timeoutMs()});
+      bySession[&conns.back()->session] = conns.back().get();
+    }
+
+    // With a target rate, request i is due at start + i / rate and its
+    // latency is measured from then, so that time spent waiting for a free
+    // connection is counted (i.e. no coordinated omission).
+    const auto start = Clock::now();
+    const auto end = start + opts_.duration;
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(opts_.rate > 0 ? 1.0 / opts_.rate : 0.0));
+    auto nextDue = start;
+
+    cpr::Multi multi;
+    std::size_t inflight = 0;
+    for (;;) {
+      auto now = Clock::now();
+      for (auto& c : conns) {
+        if (c->busy || now >= end || (opts_.rate > 0 && nextDue > now)) {
+          continue;
+        }
+        c->intended = (opts_.rate > 0 ? nextDue : now);
+        nextDue += interval;
+        prepare(*c, res);
+        multi.Add(c->session);
+        c->busy = true;
+        inflight++;
+      }
+
+      if (inflight == 0 && now >= end) {
+        break;
+      }
+
+      multi.Perform();
+      bool completed = false;
+      while (cpr::Session* s = multi.NextDone()) {
+        Conn* c = bySession[s];
+        auto r = s->Complete();
+        now = Clock::now();
+        res.latency.record(static_cast<Histogram::ValueT>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - c->intended).count()));
+        res.statuses[r.status_code]++;
+        if (r.status_code != 200) {
+          res.errors++;
+        }
+        res.bytes += r.text.size();
+        c->busy = false;
+        inflight--;
+        completed = true;
+      }
+
+      if (!completed) {
+        long waitMs = 1;
+        if (opts_.rate > 0 && inflight < conns.size()) {
+          waitMs = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(nextDue - Clock::now()).count());
+        }
+        multi.Poll(std::min<long>(waitMs, 10));
+      }
+    }
+    res.elapsed = Clock::now() - start;
+  }
+
+private:
+  bool isRead() {
+    return pct_(rng_) < opts_.readPct;
+  }
+
+  void prepare(Conn& c, Results& res) {
+    cpr::Session& s = c.session;
+    s.SetParameters(cpr::Parameters{});
+
+    switch (opts_.workload) {
+    case Workload::KV: {
+      s.SetUrl(cpr::Url{agent_.kvUrl(keyName(opts_, keys_.next()))});
+      if (!agent_.cluster().empty()) {
+        s.SetParameters(cpr::Parameters{{"dc", agent_.cluster()}});
+      }
+      if (isRead()) {
+        res.reads++;
+        s.PrepareGet();
+      } else {
+        res.writes++;
+        s.SetBody(cpr::Body{value_});
+        s.PreparePut();
+      }
+      break;
+    }
+
+    case Workload::TXN: {
+      std::ostringstream body;
+      body << "[";
+      for (std::size_t i = 0; i < opts_.txnOps; ++i) {
+        body << (i > 0 ? "," : "");
+        if (isRead()) {
+          res.reads++;
+          body << R"({"KV":{"Verb":"get","Key":")" << keyName(opts_, keys_.next()) << R"("}})";
+        } else {
+          res.writes++;
+          body << R"({"KV":{"Verb":"set","Key":")" << keyName(opts_, keys_.next())
+               << R"(","Value":")" << encoded_ << R"("}})";
+        }
+      }
+      body << "]";
+      s.SetUrl(cpr::Url{agent_.txnUrl()});
+      if (!agent_.cluster().empty()) {
+        s.SetParameters(cpr::Parameters{{"dc", agent_.cluster()}});
+      }
+      s.SetBody(cpr::Body{body.str()});
+      s.PreparePut();
+      break;
+    }
+
+    case Workload::LEADER:
+      res.reads++;
+      s.SetUrl(cpr::Url{agent_.statusLeaderUrl()});
+      s.PrepareGet();
+      break;
+
+    case Workload::PEERS:
+      res.reads++;
+      s.SetUrl(cpr::Url{agent_.statusPeersUrl()});
+      s.PrepareGet();
+      break;
+    }
+  }
+
+  ::consul::Agent& agent_;
+  const Options& opts_;
+  KeyChooser keys_;
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<double> pct_{0.0, 100.0};
+  std::string value_;
+  std::string encoded_;
+};
+
+
+void
+report(const Options& opts, const Results& res) {
+  const double secs = std::chrono::duration<double>(res.elapsed).count();
+  const auto& h = res.latency;
+  const auto ms = [](const double us) { return us / 1000.0; };
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "Requests:   " << h.count() << " in " << secs << "s, "
+            << (secs > 0 ? h.count() / secs : 0.0) << " req/s, "
+            << (secs > 0 ? res.bytes / secs / (1024 * 1024) : 0.0) << " MiB/s received" << std::endl
+            << "Operations: " << res.reads << " reads, " << res.writes << " writes" << std::endl
+            << "Errors:     " << res.errors << std::endl
+            << "Status:    ";
+  for (const auto& s : res.statuses) {
+    std::cout << " " << (s.first == 0 ? std::string("transport") : std::to_string(s.first)) << "=" << s.second;
+  }
+  std::cout << std::endl << std::endl;
+
+  std::cout << "Latency (ms): min " << ms(h.min()) << ", mean " << ms(h.mean())
+            << ", stddev " << ms(h.stddev()) << ", max " << ms(h.max()) << std::endl;
+  for (const double p : {50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 99.999, 100.0}) {
+    std::cout << "  " << std::setw(8) << std::setprecision(3) << p << "%  "
+              << std::setw(10) << ms(h.percentile(p)) << std::endl;
+  }
+
+  if (!opts.histogram || h.count() == 0) {
+    return;
+  }
+
+  // HdrHistogram's percentile distribution: five steps per halving of the
+  // distance to 100%
+  std::cout << std::endl
+            << std::setw(12) << "Value" << std::setw(15) << "Percentile"
+            << std::setw(11) << "TotalCount" << std::setw(18) << "1/(1-Percentile)" << std::endl << std::endl;
+  for (int halves = 0; ; ++halves) {
+    const double remaining = 100.0 / std::pow(2.0, halves);
+    bool done = false;
+    for (int step = 0; step < 5 && !done; ++step) {
+      const double pct = 100.0 - remaining + step * remaining / 10.0;
+      const auto v = h.percentile(pct);
+      const auto n = h.countAtOrBelow(v);
+      const double frac = static_cast<double>(n) / h.count();
+      std::cout << std::setw(12) << std::setprecision(3) << ms(v)
+                << std::setw(15) << std::setprecision(12) << frac
+                << std::setw(11) << n;
+      if (frac < 1.0) {
+        std::cout << std::setw(18) << std::setprecision(2) << 1.0 / (1.0 - frac);
+      }
+      std::cout << std::endl;
+      done = (n >= h.count());
+    }
+    if (done) {
+      break;
+    }
+  }
+  std::cout << std::setprecision(3)
+            << "#[Mean    = " << std::setw(12) << ms(h.mean()) << ", StdDeviation   = " << std::setw(12) << ms(h.stddev()) << "]" << std::endl
+            << "#[Max     = " << std::setw(12) << ms(h.max()) << ", Total count    = " << std::setw(12) << h.count() << "]" << std::endl;
+}
+
+} // namespace
+
+
+int
+main(int argc, char* argv[]) {
+  el::Configurations defaultConf;
+  defaultConf.setToDefault();
+  defaultConf.setGlobally(el::ConfigurationType::ToFile, std::string("false"));
+  defaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, std::string("true"));
+  el::Loggers::reconfigureLogger("default", defaultConf);
+  if (::isatty(::fileno(stdout)))
+    el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
+
+  ::consul::Agent agent;
+  Options opts;
+
+  try {
+    TCLAP::CmdLine cmd(COMMAND_HELP_MSG, '=', "0.1");
+
+    TCLAP::SwitchArg histogramArg("g", "histogram", "Print the full latency distribution", false);
+    cmd.add(histogramArg);
+
+    TCLAP::SwitchArg populateArg("P", "populate", "Write every key under the prefix before the run", false);
+    cmd.add(populateArg);
+
+    TCLAP::ValueArg<std::size_t> txnOpsArg("o", "txn-ops", "Operations per transaction of the txn workload (at most 64)", false, opts.txnOps, "count");
+    cmd.add(txnOpsArg);
+
+    TCLAP::ValueArg<double> readPctArg("R", "read-pct", "Percent of KV operations that are reads", false, opts.readPct, "percent");
+    cmd.add(readPctArg);
+
+    TCLAP::ValueArg<std::size_t> valueSizeArg("s", "value-size", "Size in bytes of the values written", false, opts.valueSize, "bytes");
+    cmd.add(valueSizeArg);
+
+    TCLAP::ValueArg<double> thetaArg("z", "zipf-theta", "Skew of the zipfian distribution, in (0, 1)", false, opts.theta, "theta");
+    cmd.add(thetaArg);
+
+    std::vector<std::string> dists{"uniform", "zipfian"};
+    TCLAP::ValuesConstraint<std::string> distConstraint(dists);
+    TCLAP::ValueArg<std::string> distArg("D", "distribution", "Distribution of the keys operated on", false, "uniform", &distConstraint);
+    cmd.add(distArg);
+
+    TCLAP::ValueArg<std::string> prefixArg("k", "prefix", "Prefix of the keys operated on", false, opts.prefix, "prefix");
+    cmd.add(prefixArg);
+
+    TCLAP::ValueArg<std::size_t> keysArg("K", "keys", "Number of distinct keys operated on", false, opts.keys, "count");
+    cmd.add(keysArg);
+
+    TCLAP::ValueArg<double> durationArg("t", "duration", "Length of the run in seconds", false, 10.0, "seconds");
+    cmd.add(durationArg);
+
+    TCLAP::ValueArg<double> rateArg("r", "rate", "Target requests per second across all connections; 0 sends as fast as possible", false, opts.rate, "req/s");
+    cmd.add(rateArg);
+
+    TCLAP::ValueArg<std::size_t> connsArg("n", "connections", "Number of concurrent connections", false, opts.connections, "count");
+    cmd.add(connsArg);
+
+    std::vector<std::string> workloads{"kv", "txn", "leader", "peers"};
+    TCLAP::ValuesConstraint<std::string> workloadConstraint(workloads);
+    TCLAP::ValueArg<std::string> workloadArg("w", "workload", "Requests to send: KV GET/PUT, /v1/txn, /v1/status/leader or /v1/status/peers", false, "kv", &workloadConstraint);
+    cmd.add(workloadArg);
+
+    TCLAP::ValueArg<std::string> clusterArg("c", "cluster", "consul Cluster (i.e. '?dc=<cluster>')", false, "", "dc1");
+    cmd.add(clusterArg);
+
+    TCLAP::ValueArg<consul::Agent::TimeoutT> timeoutArg("T", "timeout", "Timeout (ms) of each request", false, agent.timeoutMs(), "ms");
+    cmd.add(timeoutArg);
+
+    TCLAP::ValueArg<consul::Agent::PortT> portArg("p", "port", "Port number of consul agent", false, agent.port(), "port");
+    cmd.add(portArg);
+
+    TCLAP::ValueArg<consul::Agent::HostT> hostArg("H", "host", "Hostname of consul agent", false, agent.host().c_str(), "hostname");
+    cmd.add(hostArg);
+
+    cmd.parse(argc, argv);
+
+    agent.setHost(hostArg.getValue());
+    agent.setPort(portArg.getValue());
+    agent.setTimeoutMs(timeoutArg.getValue());
+    if (clusterArg.isSet()) {
+      agent.setCluster(clusterArg.getValue());
+    }
+
+    const auto& w = workloadArg.getValue();
+    opts.workload = (w == "txn" ? Workload::TXN : w == "leader" ? Workload::LEADER :
+                     w == "peers" ? Workload::PEERS : Workload::KV);
+    opts.connections = connsArg.getValue();
+    opts.rate = rateArg.getValue();
+    opts.duration = std::chrono::milliseconds{static_cast<long long>(durationArg.getValue() * 1000)};
+    opts.keys = keysArg.getValue();
+    opts.prefix = prefixArg.getValue();
+    opts.distribution = (distArg.getValue() == "zipfian" ? KeyChooser::Distribution::ZIPFIAN :
+                         KeyChooser::Distribution::UNIFORM);
+    opts.theta = thetaArg.getValue();
+    opts.valueSize = valueSizeArg.getValue();
+    opts.readPct = readPctArg.getValue();
+    opts.txnOps = txnOpsArg.getValue();
+    opts.populate = populateArg.getValue();
+    opts.histogram = histogramArg.getValue();
+
+    if (opts.connections < 1 || opts.keys < 1 || opts.rate < 0 || opts.duration.count() <= 0) {
+      LOG(ERROR) << "--connections, --keys and --duration must be positive and --rate non-negative";
+      return EX_USAGE;
+    }
+    if (opts.txnOps < 1 || opts.txnOps > 64) {
+      LOG(ERROR) << "--txn-ops must be between 1 and 64";
+      return EX_USAGE;
+    }
+    if (opts.distribution == KeyChooser::Distribution::ZIPFIAN && (opts.theta <= 0.0 || opts.theta >= 1.0)) {
+      LOG(ERROR) << "--zipf-theta must be between 0 and 1";
+      return EX_USAGE;
+    }
+  } catch (TCLAP::ArgException &e)  {
+    LOG(FATAL) << e.error() << " for arg " << e.argId();
+    return EX_USAGE;
+  }
+
+  try {
+    Bench bench{agent, opts};
+    if (opts.populate) {
+      LOG(INFO) << "Writing " << opts.keys << " keys under " << opts.prefix;
+      if (!populate(agent, opts, bench.encodedValue())) {
+        return EX_TEMPFAIL;
+      }
+    }
+
+    Results res;
+    bench.run(res);
+    report(opts, res);
+    return (res.errors > 0 ? EX_TEMPFAIL : EX_OK);
+  } catch (std::exception& e) {
+    LOG(FATAL) << "cpr threw an exception: " << e.what();
+    return EX_SOFTWARE;
+  }
+}
@@ -0,0 +1,206 @@
+/*-------------------------------------------------------------------------
+ *
+ * consul_json_bench.cpp	Benchmark parsing of /v1/kv/ responses with and
+ *				without a JsonIndex
+ *
+ * Copyright (c) 2015, Groupon, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+extern "C" {
+#include <sysexits.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define ELPP_NO_DEFAULT_LOG_FILE
+#define ELPP_STACKTRACE_ON_CRASH
+#define ELPP_STL_LOGGING
+#define ELPP_THREAD_SAFE
+#include "easylogging++.h"
+#include "tclap/CmdLine.h"
+
+#include "consul/json_cursor.hpp"
+#include "consul/json_index.hpp"
+#include "consul/kv_pair_view.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static constexpr const char* COMMAND_HELP_MSG =
+    u8"consul-json-bench times the parsing of captured consul KV responses "
+    u8"(e.g. curl -o kv.json 'http://127.0.0.1:8500/v1/kv/?recurse') with the "
+    u8"scalar parser and with each JsonIndex implementation.";
+
+namespace {
+
+// A recursive GET of n keys, shaped like consul's own responses.  Values are
+// valueSize bytes of base64, or a short JSON document if valueSize is 0.
+std::string
+syntheticResponse(const std::size_t n, const std::size_t valueSize) {
+  const std::string value = (valueSize > 0 ? std::string(valueSize, 'A') :
+                             std::string("eyJlbmFibGVkIjogdHJ1ZSwgInJlcGxpY2FzIjogM30="));
+  std::ostringstream ss;
+  ss << "[";
+  for (std::size_t i = 0; i < n; ++i) {
+    if (i > 0) {
+      ss << ",";
+    }
+    ss << "{\"LockIndex\":0,\"Key\":\"service/web/" << i << "/config\",\"Flags\":" << i
+       << ",\"Value\":\"" << value << "\",\"CreateIndex\":" << 100 + i
+       << ",\"ModifyIndex\":" << 200 + i << "}";
+  }
+  ss << "]";
+  return ss.str();
+}
+
+// Parse json in place, the way KVPairsView does.  impl < 0 parses without an
+// index.
+bool
+parse(std::string& json, const int impl, std::vector<::consul::KVPairView>& kvps,
+      std::vector<std::string>& keys, std::string& err) {
+  char* const begin = &json[0];
+  ::consul::JsonIndex index;
+  if (impl >= 0 &&
+      !::consul::JsonIndex::Build(index, begin, json.size(),
+                                  static_cast<::consul::JsonIndex::Impl>(impl), err)) {
+    return false;
+  }
+
+  ::consul::JsonCursor cur{begin, begin + json.size(), impl >= 0 ? &index : nullptr};
+  kvps.clear();
+  keys.clear();
+  if (!cur.expect('[', err)) {
+    return false;
+  }
+  if (!cur.consume(']')) {
+    do {
+      ::consul::KVPairView kvp;
+      if (!::consul::KVPairView::InitFromJson(kvp, cur, err)) {
+        return false;
+      }
+      kvps.push_back(kvp);
+      keys.push_back(kvp.key().to_string());
+    } while (cur.consume(','));
+    if (!cur.expect(']', err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+
+int
+main(int argc, char* argv[]) {
+  el::Configurations defaultConf;
+  defaultConf.setToDefault();
+  defaultConf.setGlobally(el::ConfigurationType::ToFile, std::string("false"));
+  defaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, std::string("true"));
+  el::Loggers::reconfigureLogger("default", defaultConf);
+  if (::isatty(::fileno(stdout)))
+    el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
+
+  std::vector<std::pair<std::string, std::string>> inputs;
+  std::size_t iterations = 0;
+
+  try {
+    TCLAP::CmdLine cmd(COMMAND_HELP_MSG, '=', "0.1");
+
+    TCLAP::ValueArg<std::size_t> iterationsArg("i", "iterations", "Times each response is parsed per implementation", false, 21, "count");
+    cmd.add(iterationsArg);
+
+    TCLAP::ValueArg<std::size_t> keysArg("n", "keys", "Number of keys in the synthetic response used when no files are given", false, 100000, "count");
+    cmd.add(keysArg);
+
+    TCLAP::ValueArg<std::size_t> valueSizeArg("s", "value-size", "Size of the values in the synthetic response, 0 for a short JSON document", false, 0, "bytes");
+    cmd.add(valueSizeArg);
+
+    TCLAP::MultiArg<std::string> fileArg("f", "file", "Captured /v1/kv/ response", false, "path");
+    cmd.add(fileArg);
+
+    cmd.parse(argc, argv);
+
+    iterations = iterationsArg.getValue();
+    for (const auto& path : fileArg.getValue()) {
+      std::ifstream in{path, std::ios::binary};
+      if (!in) {
+        LOG(ERROR) << "Unable to open " << path;
+        return EX_NOINPUT;
+      }
+      std::ostringstream ss;
+      ss << in.rdbuf();
+      inputs.emplace_back(path, ss.str());
+    }
+    if (inputs.empty()) {
+      std::ostringstream name;
+      name << "synthetic (" << keysArg.getValue() << " keys";
+      if (valueSizeArg.getValue() > 0) {
+        name << ", " << valueSizeArg.getValue() << " byte values";
+      }
+      name << ")";
+      inputs.emplace_back(name.str(), syntheticResponse(keysArg.getValue(), valueSizeArg.getValue()));
+    }
+  } catch (TCLAP::ArgException &e)  {
+    LOG(FATAL) << e.error() << " for arg " << e.argId();
+    return EX_USAGE;
+  }
+
+  const int bestImpl = static_cast<int>(::consul::JsonIndex::BestImpl());
+  for (const auto& input : inputs) {
+    std::cout << input.first << ": " << input.second.size() << " bytes" << std::endl;
+
+    std::vector<std::string> expected;
+    for (int impl = -1; impl <= bestImpl; ++impl) {
+      std::vector<::consul::KVPairView> kvps;
+      std::vector<std::string> keys;
+      std::string err;
+
+      // Parsing is in place, so each iteration gets a fresh copy, made
+      // outside of the timed region
+      std::vector<double> times;
+      for (std::size_t i = 0; i < std::max<std::size_t>(iterations, 1); ++i) {
+        std::string json{input.second};
+        const auto start = std::chrono::steady_clock::now();
+        if (!parse(json, impl, kvps, keys, err)) {
+          LOG(ERROR) << "Parsing " << input.first << " failed: " << err;
+          return EX_DATAERR;
+        }
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      }
+      std::sort(times.begin(), times.end());
+
+      if (impl < 0) {
+        expected = keys;
+      } else if (keys != expected) {
+        LOG(ERROR) << "Keys parsed with the " << ::consul::JsonIndex::ImplStr(static_cast<::consul::JsonIndex::Impl>(impl))
+                   << " index differ from the scalar parser's";
+        return EX_SOFTWARE;
+      }
+
+      // The fastest run is the least disturbed by the rest of the machine
+      const double best = times.front();
+      const double median = times[times.size() / 2];
+      std::cout << "  " << std::setw(8) << std::left
+                << (impl < 0 ? "none" : ::consul::JsonIndex::ImplStr(static_cast<::consul::JsonIndex::Impl>(impl)))
+                << std::right << std::fixed << std::setprecision(3)
+                << std::setw(10) << best * 1e3 << " ms best"
+                << std::setw(10) << median * 1e3 << " ms median"
+                << std::setw(10) << (best > 0 ? input.second.size() / best / (1024 * 1024) : 0.0) << " MiB/s"
+                << "  (" << kvps.size() << " keys)" << std::endl;
+    }
+  }
+
+  return EX_OK;
+}
@@ -29,6 +29,7 @@ extern "C" {
 #include "tclap/CmdLine.h"
 
 #include "consul/agent.hpp"
+#include "consul/agent_pool.hpp"
 #include "consul/kv_pairs.hpp"
 
 INITIALIZE_EASYLOGGINGPP
@@ -49,6 +50,7 @@ main(int argc, char* argv[]) {
     el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
 
   ::consul::Agent agent;
+  ::consul::AgentPool pool;
   ::consul::KVPair::ValueT value;
   TCLAP::ValueArg<::consul::KVPair::IndexT>
       casArg("C", "cas", "Check-and-Set index. When performing a PUT or DELETE, only operate if the ModifyIndex matches the passed in CAS value",
@@ -89,6 +91,9 @@ main(int argc, char* argv[]) {
     TCLAP::SwitchArg debugArg("d", "debug", "Print additional information with debugging", false);
     cmd.add(debugArg);
 
+    TCLAP::ValueArg<std::string> agentsArg("A", "agents", "Comma separated list of consul agents (host[:port]) to fail over between", false, "", "host[:port],...");
+    cmd.add(agentsArg);
+
     TCLAP::ValueArg<consul::Agent::PortT> portArg("p", "port", "Port number of consul agent", false, agent.port(), "port");
     cmd.add(portArg);
 
@@ -130,6 +135,16 @@ main(int argc, char* argv[]) {
       agent.setPort(portArg.getValue());
     }
 
+    if (agentsArg.isSet()) {
+      std::string err;
+      if (!::consul::AgentPool::InitFromList(pool, agentsArg.getValue(), agent.port(), err)) {
+        LOG(ERROR) << "Invalid agent list: " << err;
+        return EX_USAGE;
+      }
+    } else {
+      pool = ::consul::AgentPool{agent};
+    }
+
     if (decodeArg.isSet()) {
       base64::decoder D;
       const std::string testInput{decodeArg.getValue()};
@@ -232,10 +247,14 @@ main(int argc, char* argv[]) {
       }
 
       if (methodType == MethodType::GET) {
-        auto r = cpr::Get(cpr::Url{kvUrl},
-                          cpr::Header{{"Connection", "close"}},
-                          cpr::Timeout{agent.timeoutMs()},
-                          params);
+        // Reads are idempotent and can fail over between agents
+        auto r = pool.request([&](::consul::Agent& a) {
+            return cpr::Get(cpr::Url{a.kvUrl(key)},
+                            cpr::Header{{"Connection", "close"}},
+                            cpr::Timeout{agent.timeoutMs()},
+                            params);
+          });
+        LOG_IF(debugFlag, INFO) << "Agents: " << pool.str();
         if (r.status_code != 200) {
           LOG(ERROR) << "consul agent returned error " << r.status_code;
           return EX_TEMPFAIL;
@@ -244,7 +263,7 @@ main(int argc, char* argv[]) {
 
         consul::KVPairs kvps;
         std::string err;
-        if (!::consul::KVPairs::InitFromJson(kvps, r.text, err)) {
+        if (!::consul::KVPairs::InitFromJson(kvps, std::move(r.text), err)) {
           LOG(ERROR) << "Failed to load KVPair(s) from JSON: " << err;
           return EX_PROTOCOL;
         }
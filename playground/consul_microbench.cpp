@@ -0,0 +1,478 @@
+/*-------------------------------------------------------------------------
+ *
+ * consul_microbench.cpp	Micro-benchmarks of the per-row decode path:
+ *				JSON parsing, KV pair decoding, base64, cpr's
+ *				helpers and the copies made when building tuples
+ *
+ * Copyright (c) 2015, Groupon, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+extern "C" {
+#include <sysexits.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define ELPP_NO_DEFAULT_LOG_FILE
+#define ELPP_STACKTRACE_ON_CRASH
+#define ELPP_STL_LOGGING
+#define ELPP_THREAD_SAFE
+#include "easylogging++.h"
+#include "tclap/CmdLine.h"
+
+#include "b64/decode.hpp"
+#include "b64/encode.hpp"
+#include "consul/json_document.hpp"
+#include "consul/kv_pairs.hpp"
+#include "consul/kv_pairs_view.hpp"
+#include "cpr/util.h"
+
+INITIALIZE_EASYLOGGINGPP
+
+static constexpr const char* COMMAND_HELP_MSG =
+    u8"consul-microbench times the pieces of pg_consul that dominate the cost "
+    u8"of each returned row and reports ns, allocations and bytes allocated "
+    u8"per operation.  Results can be saved as JSON and compared against a "
+    u8"saved baseline.";
+
+
+// Every operator new is counted.  JSON arena blocks are counted by
+// CountingAllocator below, so allocations/op covers both.
+namespace {
+std::size_t allocCount = 0;
+std::size_t allocBytes = 0;
+} // namespace
+
+void*
+operator new(std::size_t size) {
+  allocCount++;
+  allocBytes += size;
+  if (void* p = std::malloc(size > 0 ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+
+namespace {
+
+void*
+countingAlloc(void*, const std::size_t size) noexcept {
+  allocCount++;
+  allocBytes += size;
+  return std::malloc(size);
+}
+
+void
+countingFree(void*, void* ptr) noexcept {
+  std::free(ptr);
+}
+
+::consul::JsonAllocator
+CountingAllocator() noexcept {
+  ::consul::JsonAllocator alloc;
+  alloc.allocFn = &countingAlloc;
+  alloc.freeFn = &countingFree;
+  return alloc;
+}
+
+
+struct Result {
+  std::string name;
+  std::size_t iterations = 0;
+  double nsPerOp = 0.0;
+  double allocsPerOp = 0.0;
+  double bytesPerOp = 0.0;
+};
+
+// Keeps the compiler from discarding a benchmark's work
+volatile std::size_t sink;
+
+// Number of rounds each benchmark is timed for, the fastest one being
+// reported.  Slower rounds are mostly other work on the machine.
+std::size_t rounds = 5;
+
+// Time n runs of fn
+Result
+runRound(const std::string& name, const std::size_t n, const std::function<void()>& fn, std::chrono::nanoseconds& elapsed) {
+  Result r;
+  r.name = name;
+  const std::size_t allocs = allocCount;
+  const std::size_t bytes = allocBytes;
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < n; ++i) {
+    fn();
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+
+  r.iterations = n;
+  r.nsPerOp = static_cast<double>(elapsed.count()) / n;
+  r.allocsPerOp = static_cast<double>(allocCount - allocs) / n;
+  r.bytesPerOp = static_cast<double>(allocBytes - bytes) / n;
+  return r;
+}
+
+// Find the number of iterations that takes at least minTime by doubling it,
+// then time that many for each of the rounds and report the fastest.
+Result
+run(const std::string& name, const std::chrono::nanoseconds minTime, const std::function<void()>& fn) {
+  std::chrono::nanoseconds elapsed{0};
+  Result best;
+  for (std::size_t n = 1; ; n *= 2) {
+    best = runRound(name, n, fn, elapsed);
+    if (elapsed >= minTime) {
+      break;
+    }
+  }
+
+  for (std::size_t i = 1; i < rounds; ++i) {
+    const Result r = runRound(name, best.iterations, fn, elapsed);
+    if (r.nsPerOp < best.nsPerOp) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+
+// A recursive GET of n keys, shaped like consul's own responses
+std::string
+syntheticResponse(const std::size_t n) {
+  std::ostringstream ss;
+  ss << "[";
+  for (std::size_t i = 0; i < n; ++i) {
+    if (i > 0) {
+      ss << ",";
+    }
+    ss << "{\"LockIndex\":0,\"Key\":\"service/web/" << i << "/config\",\"Flags\":" << i
+       << ",\"Value\":\"eyJlbmFibGVkIjogdHJ1ZSwgInJlcGxpY2FzIjogM30=\",\"CreateIndex\":" << 100 + i
+       << ",\"ModifyIndex\":" << 200 + i << "}";
+  }
+  ss << "]";
+  return ss.str();
+}
+
+// The headers of a typical /v1/kv/ response
+const char* const RESPONSE_HEADERS =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "X-Consul-Index: 475\r\n"
+    "X-Consul-Knownleader: true\r\n"
+    "X-Consul-Lastcontact: 0\r\n"
+    "Date: Mon, 02 Nov 2015 19:12:41 GMT\r\n"
+    "Content-Length: 1134\r\n"
+    "\r\n";
+
+// Copy str the way pg_consul_text_datum() builds a text Datum: up to its
+// first NUL, behind a varlena header.
+std::size_t
+textDatum(const ::consul::KVPairView::ViewT& str) {
+  const auto nul = str.find('\0');
+  const std::size_t len = (nul == ::consul::KVPairView::ViewT::npos ? str.size() : nul);
+  char* datum = new char[len + 4];
+  std::memcpy(datum + 4, str.data(), len);
+  const std::size_t n = static_cast<std::size_t>(datum[4 + len / 2]);
+  delete[] datum;
+  return n;
+}
+
+
+// Benchmarks of the response json, labelled label
+void
+benchResponse(const std::string& label, const std::string& json, const std::chrono::nanoseconds minTime,
+              std::vector<Result>& results) {
+  std::string err;
+
+  results.push_back(run("json/document/" + label, minTime, [&]() {
+    ::consul::JsonDocument doc{CountingAllocator()};
+    if (!::consul::JsonDocument::Parse(doc, json, err)) {
+      throw std::runtime_error(err);
+    }
+    sink = doc.root().size();
+  }));
+
+  results.push_back(run("kv/pairs/" + label, minTime, [&]() {
+    ::consul::KVPairs kvps;
+    if (!::consul::KVPairs::InitFromJson(kvps, json, err)) {
+      throw std::runtime_error(err);
+    }
+    sink = kvps.size();
+  }));
+
+  results.push_back(run("kv/pairs_view/" + label, minTime, [&]() {
+    ::consul::KVPairsView kvps;
+    if (!::consul::KVPairsView::InitFromJson(kvps, std::string(json), err)) {
+      throw std::runtime_error(err);
+    }
+    sink = kvps.size();
+  }));
+
+  // What consul_kv_get() does for every row of the response after it has
+  // been parsed, minus heap_form_tuple().  Values are base64 decoded in place
+  // on the first run only.
+  ::consul::KVPairsView parsed;
+  if (!::consul::KVPairsView::InitFromJson(parsed, std::string(json), err)) {
+    throw std::runtime_error(err);
+  }
+  results.push_back(run("kv/tuples/" + label, minTime, [&]() {
+    std::size_t n = 0;
+    for (const auto& kvp : parsed.objs()) {
+      n += textDatum(kvp.key());
+      n += textDatum(kvp.value());
+      n += textDatum(kvp.session());
+      n += kvp.flags() + kvp.createIndex() + kvp.modifyIndex() + kvp.lockIndex();
+    }
+    sink = n;
+  }));
+}
+
+
+void
+benchHelpers(const std::chrono::nanoseconds minTime, std::vector<Result>& results) {
+  std::string plain(1024, '\0');
+  for (std::size_t i = 0; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 131);
+  }
+
+  std::string encoded(2 * plain.size(), '\0');
+  {
+    ::base64::base64_encodestate state;
+    ::base64::base64_init_encodestate(&state);
+    int len = ::base64::base64_encode_block(plain.data(), static_cast<int>(plain.size()), &encoded[0], &state);
+    len += ::base64::base64_encode_blockend(&encoded[len], &state);
+    encoded.resize(static_cast<std::size_t>(len));
+  }
+
+  std::vector<char> out(2 * plain.size());
+  results.push_back(run("b64/encode/1KiB", minTime, [&]() {
+    ::base64::base64_encodestate state;
+    ::base64::base64_init_encodestate(&state);
+    int len = ::base64::base64_encode_block(plain.data(), static_cast<int>(plain.size()), out.data(), &state);
+    len += ::base64::base64_encode_blockend(out.data() + len, &state);
+    sink = static_cast<std::size_t>(len);
+  }));
+
+  results.push_back(run("b64/decode/1KiB", minTime, [&]() {
+    ::base64::base64_decodestate state;
+    ::base64::base64_init_decodestate(&state);
+    sink = static_cast<std::size_t>(::base64::base64_decode_block(encoded.data(), static_cast<int>(encoded.size()),
+                                                                  out.data(), &state));
+  }));
+
+  const std::string key = "service/web frontend/config?v=1&dc=pgc1";
+  results.push_back(run("cpr/urlEncode", minTime, [&]() {
+    sink = ::cpr::util::urlEncode(key).size();
+  }));
+
+  const std::string headers = RESPONSE_HEADERS;
+  results.push_back(run("cpr/parseHeader", minTime, [&]() {
+    sink = ::cpr::util::parseHeader(headers).size();
+  }));
+}
+
+
+// Baseline results, keyed by name
+bool
+readBaseline(const std::string& path, std::vector<Result>& baseline, std::string& err) {
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    err = "unable to open " + path;
+    return false;
+  }
+  std::ostringstream ss;
+  ss << in.rdbuf();
+
+  ::consul::JsonDocument doc;
+  if (!::consul::JsonDocument::Parse(doc, ss.str(), err)) {
+    return false;
+  }
+
+  const auto& benchmarks = doc.root()["benchmarks"];
+  for (const auto& b : benchmarks) {
+    Result r;
+    r.name = b["name"].string_value().to_string();
+    r.nsPerOp = b["ns_per_op"].number_value();
+    r.allocsPerOp = b["allocs_per_op"].number_value();
+    r.bytesPerOp = b["bytes_per_op"].number_value();
+    baseline.push_back(r);
+  }
+  return true;
+}
+
+void
+writeResults(std::ostream& out, const std::vector<Result>& results) {
+  out << "{\n  \"benchmarks\": [\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << "    {\"name\": \"" << r.name << "\", "
+        << std::fixed << std::setprecision(1)
+        << "\"ns_per_op\": " << r.nsPerOp << ", "
+        << "\"allocs_per_op\": " << r.allocsPerOp << ", "
+        << "\"bytes_per_op\": " << r.bytesPerOp << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+} // namespace
+
+
+int
+main(int argc, char* argv[]) {
+  el::Configurations defaultConf;
+  defaultConf.setToDefault();
+  defaultConf.setGlobally(el::ConfigurationType::ToFile, std::string("false"));
+  defaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, std::string("true"));
+  el::Loggers::reconfigureLogger("default", defaultConf);
+  if (::isatty(::fileno(stdout)))
+    el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
+
+  std::vector<std::pair<std::string, std::string>> inputs;
+  std::chrono::nanoseconds minTime;
+  std::string baselinePath;
+  std::string outputPath;
+  double threshold = 0.0;
+
+  try {
+    TCLAP::CmdLine cmd(COMMAND_HELP_MSG, '=', "0.1");
+
+    TCLAP::ValueArg<std::string> baselineArg("b", "baseline", "Compare against the results saved in this file, which must come from the same machine and build flags", false, "", "path");
+    cmd.add(baselineArg);
+
+    TCLAP::ValueArg<std::size_t> roundsArg("c", "rounds", "Rounds each benchmark is timed for, reporting the fastest", false, rounds, "count");
+    cmd.add(roundsArg);
+
+    TCLAP::MultiArg<std::string> fileArg("f", "file", "Captured /v1/kv/?recurse response to benchmark in addition to the synthetic ones", false, "path");
+    cmd.add(fileArg);
+
+    TCLAP::MultiArg<std::size_t> keysArg("n", "keys", "Number of keys in a synthetic response (default: 1, 1000 and 1000000)", false, "count");
+    cmd.add(keysArg);
+
+    TCLAP::ValueArg<std::string> outputArg("o", "output", "Save the results as JSON, e.g. as a new baseline", false, "", "path");
+    cmd.add(outputArg);
+
+    TCLAP::ValueArg<int> timeArg("t", "time", "Minimum time (ms) each benchmark runs for", false, 200, "ms");
+    cmd.add(timeArg);
+
+    TCLAP::ValueArg<double> thresholdArg("r", "regression", "Percent slower than the baseline, in ns/op, that counts as a regression", false, 20.0, "percent");
+    cmd.add(thresholdArg);
+
+    cmd.parse(argc, argv);
+
+    baselinePath = baselineArg.getValue();
+    outputPath = outputArg.getValue();
+    minTime = std::chrono::milliseconds{timeArg.getValue()};
+    threshold = thresholdArg.getValue();
+    rounds = std::max(roundsArg.getValue(), static_cast<std::size_t>(1));
+
+    std::vector<std::size_t> keys = keysArg.getValue();
+    if (keys.empty()) {
+      keys = {1, 1000, 1000000};
+    }
+    for (const auto n : keys) {
+      inputs.emplace_back(std::to_string(n), syntheticResponse(n));
+    }
+
+    for (const auto& path : fileArg.getValue()) {
+      std::ifstream in{path, std::ios::binary};
+      if (!in) {
+        LOG(ERROR) << "Unable to open " << path;
+        return EX_NOINPUT;
+      }
+      std::ostringstream ss;
+      ss << in.rdbuf();
+      inputs.emplace_back(path.substr(path.find_last_of('/') + 1), ss.str());
+    }
+  } catch (TCLAP::ArgException &e)  {
+    LOG(FATAL) << e.error() << " for arg " << e.argId();
+    return EX_USAGE;
+  }
+
+  std::vector<Result> results;
+  try {
+    for (const auto& input : inputs) {
+      benchResponse(input.first, input.second, minTime, results);
+    }
+    benchHelpers(minTime, results);
+  } catch (const std::runtime_error& e) {
+    LOG(ERROR) << "Benchmark failed: " << e.what();
+    return EX_DATAERR;
+  }
+
+  std::vector<Result> baseline;
+  if (!baselinePath.empty()) {
+    std::string err;
+    if (!readBaseline(baselinePath, baseline, err)) {
+      LOG(ERROR) << "Reading baseline " << baselinePath << " failed: " << err;
+      return EX_DATAERR;
+    }
+  }
+
+  std::cout << std::left << std::setw(28) << "benchmark" << std::right
+            << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op" << std::setw(14) << "bytes/op";
+  if (!baseline.empty()) {
+    std::cout << std::setw(10) << "delta";
+  }
+  std::cout << std::endl;
+
+  std::size_t regressions = 0;
+  for (const auto& r : results) {
+    std::cout << std::left << std::setw(28) << r.name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << r.nsPerOp << std::setw(12) << r.allocsPerOp << std::setw(14) << r.bytesPerOp;
+
+    const auto base = std::find_if(baseline.begin(), baseline.end(),
+                                   [&](const Result& b) { return b.name == r.name; });
+    if (base != baseline.end() && base->nsPerOp > 0) {
+      const double delta = 100.0 * (r.nsPerOp - base->nsPerOp) / base->nsPerOp;
+      const bool regressed = (delta > threshold || r.allocsPerOp > base->allocsPerOp);
+      std::cout << std::setw(9) << std::showpos << delta << std::noshowpos << "%" << (regressed ? "  REGRESSION" : "");
+      if (regressed) {
+        regressions++;
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  if (!outputPath.empty()) {
+    std::ofstream out{outputPath};
+    writeResults(out, results);
+    if (!out) {
+      LOG(ERROR) << "Unable to write " << outputPath;
+      return EX_CANTCREAT;
+    }
+  }
+
+  if (regressions > 0) {
+    LOG(ERROR) << regressions << " benchmark(s) regressed against " << baselinePath;
+    return EX_SOFTWARE;
+  }
+  return EX_OK;
+}
@@ -0,0 +1,945 @@
+/*-------------------------------------------------------------------------
+ *
+ * consul_mock.cpp	Mock consul agent for regression and load tests
+ *
+ * Serves /v1/kv/, /v1/txn, /v1/status/ and /v1/agent/self over HTTP/1.1
+ * from an in-memory KV store seeded with the keys the regression tests
+ * expect, so that neither a consul binary nor a cluster is needed.
+ * Latency, errors and large responses can be injected.
+ *
+ * Copyright (c) 2015, Groupon, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sysexits.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "b64/decode.hpp"
+#define ELPP_NO_DEFAULT_LOG_FILE
+#define ELPP_STACKTRACE_ON_CRASH
+#define ELPP_STL_LOGGING
+#define ELPP_THREAD_SAFE
+#include "easylogging++.h"
+#include "tclap/CmdLine.h"
+
+#include "consul/json_document.hpp"
+#include "consul/json_value.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static constexpr const char* COMMAND_HELP_MSG =
+    u8"consul-mock serves a subset of the consul HTTP API (/v1/kv/, /v1/txn, "
+    u8"/v1/status/ and /v1/agent/self) from an in-memory KV store, with optional "
+    u8"latency, error and large payload injection.";
+
+namespace {
+
+using IndexT = std::uint64_t;
+
+// Longest a blocking query may wait, as in consul
+static constexpr const std::chrono::milliseconds MAX_WAIT{10 * 60 * 1000};
+static constexpr const std::chrono::milliseconds DEFAULT_WAIT{5 * 60 * 1000};
+
+// Operations allowed in one /v1/txn request, as in consul
+static constexpr const std::size_t MAX_TXN_OPS = 64;
+
+struct Options {
+  std::string datacenter = "pgc1";
+  std::string node = "server1";
+  std::string leader = "127.0.0.1:8300";
+  int latencyMs = 0;
+  int jitterMs = 0;
+  double errorRate = 0.0;
+  int errorStatus = 500;
+  std::string faultPrefix = "/";
+  IndexT lastContactMs = 0;
+  bool debug = false;
+};
+
+struct Entry {
+  IndexT createIndex = 0;
+  IndexT modifyIndex = 0;
+  IndexT lockIndex = 0;
+  std::uint64_t flags = 0;
+  std::string value;
+  std::string session;
+  bool hasValue = false;
+};
+
+using StoreT = std::map<std::string, Entry>;
+
+struct Request {
+  std::string method;
+  std::string path;
+  std::map<std::string, std::string> params;
+  std::map<std::string, std::string> headers;
+  std::string body;
+  bool keepAlive = true;
+};
+
+struct Response {
+  int status = 200;
+  std::string body;
+  std::vector<std::pair<std::string, std::string>> headers;
+};
+
+
+std::string
+base64Encode(const std::string& in) {
+  static constexpr const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((in.size() + 2) / 3 * 4);
+  std::size_t i = 0;
+  for (; i + 2 < in.size(); i += 3) {
+    const std::uint32_t n = (static_cast<std::uint8_t>(in[i]) << 16) |
+                            (static_cast<std::uint8_t>(in[i + 1]) << 8) |
+                            static_cast<std::uint8_t>(in[i + 2]);
+    out += alphabet[(n >> 18) & 0x3F];
+    out += alphabet[(n >> 12) & 0x3F];
+    out += alphabet[(n >> 6) & 0x3F];
+    out += alphabet[n & 0x3F];
+  }
+  if (i < in.size()) {
+    std::uint32_t n = static_cast<std::uint8_t>(in[i]) << 16;
+    if (i + 1 < in.size()) {
+      n |= static_cast<std::uint8_t>(in[i + 1]) << 8;
+    }
+    out += alphabet[(n >> 18) & 0x3F];
+    out += alphabet[(n >> 12) & 0x3F];
+    out += (i + 1 < in.size() ? alphabet[(n >> 6) & 0x3F] : '=');
+    out += '=';
+  }
+  return out;
+}
+
+
+std::string
+base64Decode(const ::consul::JsonValue::StringT& in) {
+  std::string out(in.size() / 4 * 3 + 3, '\0');
+  base64::base64_decodestate state;
+  base64::base64_init_decodestate(&state);
+  const int len = base64::base64_decode_block(in.data(), static_cast<int>(in.size()), &out[0], &state);
+  out.resize(static_cast<std::size_t>(len));
+  return out;
+}
+
+
+std::string
+percentDecode(const std::string& in) {
+  std::string out;
+  out.reserve(in.size());
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    if (in[i] == '%' && i + 2 < in.size() && std::isxdigit(in[i + 1]) && std::isxdigit(in[i + 2])) {
+      out += static_cast<char>(std::stoi(in.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else if (in[i] == '+') {
+      out += ' ';
+    } else {
+      out += in[i];
+    }
+  }
+  return out;
+}
+
+
+// Parse a consul duration ("10s", "250ms", "1m"); a bare number is seconds
+bool
+parseWait(const std::string& str, std::chrono::milliseconds& out) {
+  char* end = nullptr;
+  const double n = std::strtod(str.c_str(), &end);
+  if (end == str.c_str() || n < 0) {
+    return false;
+  }
+
+  const std::string unit{end};
+  double ms;
+  if (unit == "ms") {
+    ms = n;
+  } else if (unit == "s" || unit.empty()) {
+    ms = n * 1000;
+  } else if (unit == "m") {
+    ms = n * 60 * 1000;
+  } else if (unit == "h") {
+    ms = n * 60 * 60 * 1000;
+  } else {
+    return false;
+  }
+  out = std::min(std::chrono::milliseconds{static_cast<std::int64_t>(ms)}, MAX_WAIT);
+  return true;
+}
+
+
+// The KV store and its raft index.  Every write bumps the index and wakes the
+// blocking queries.
+class Store final {
+public:
+  void seed(const std::string& key, const std::string& value, const IndexT index) {
+    std::lock_guard<std::mutex> guard{mutex_};
+    Entry& e = kvs_[key];
+    e.createIndex = e.modifyIndex = index;
+    e.value = value;
+    e.hasValue = true;
+    index_ = std::max(index_, index);
+  }
+
+  // Wait until the index passes minIndex or the wait elapses
+  IndexT wait(const IndexT minIndex, const std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (minIndex > 0) {
+      changed_.wait_for(lock, wait, [&] { return index_ > minIndex; });
+    }
+    return index_;
+  }
+
+  // Apply fn to the store under the lock, waking blocking queries if the
+  // index moved
+  template <typename Fn>
+  auto apply(Fn fn) -> decltype(fn(std::declval<StoreT&>(), std::declval<IndexT&>())) {
+    std::lock_guard<std::mutex> guard{mutex_};
+    const IndexT before = index_;
+    auto result = fn(kvs_, index_);
+    if (index_ != before) {
+      changed_.notify_all();
+    }
+    return result;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  StoreT kvs_;
+  IndexT index_ = 1;
+};
+
+
+void
+dumpEntry(std::string& out, const std::string& key, const Entry& e, const bool withValue) {
+  std::ostringstream ss;
+  ss << "{\"LockIndex\":" << e.lockIndex << ",\"Key\":";
+  out += ss.str();
+  ::consul::JsonValue::DumpString(out, key);
+
+  ss.str("");
+  ss << ",\"Flags\":" << e.flags << ",\"Value\":";
+  out += ss.str();
+  if (withValue && e.hasValue) {
+    out += '"';
+    out += base64Encode(e.value);
+    out += '"';
+  } else {
+    out += "null";
+  }
+
+  if (!e.session.empty()) {
+    out += ",\"Session\":";
+    ::consul::JsonValue::DumpString(out, e.session);
+  }
+
+  ss.str("");
+  ss << ",\"CreateIndex\":" << e.createIndex << ",\"ModifyIndex\":" << e.modifyIndex << "}";
+  out += ss.str();
+}
+
+
+class Server final {
+public:
+  Server(const Options& opts, Store& store) : opts_(opts), store_(store), rng_{std::random_device{}()} {}
+
+  Response handle(const Request& req) {
+    Response res;
+    injectFaults(req, res);
+    if (res.status != 200) {
+      return res;
+    }
+
+    if (req.path.compare(0, 7, "/v1/kv/") == 0) {
+      kv(req, req.path.substr(7), res);
+    } else if (req.path == "/v1/txn") {
+      txn(req, res);
+    } else if (req.path == "/v1/status/leader") {
+      res.body = "\"" + opts_.leader + "\"";
+    } else if (req.path == "/v1/status/peers") {
+      res.body = "[\"" + opts_.leader + "\"]";
+    } else if (req.path == "/v1/agent/self") {
+      agentSelf(res);
+    } else {
+      res.status = 404;
+      res.body = "404 page not found";
+      return res;
+    }
+
+    if (res.status == 200 && res.headers.empty()) {
+      res.headers.emplace_back("Content-Type", "application/json");
+    }
+    return res;
+  }
+
+private:
+  void injectFaults(const Request& req, Response& res) {
+    if (req.path.compare(0, opts_.faultPrefix.size(), opts_.faultPrefix) != 0) {
+      return;
+    }
+
+    int delayMs = opts_.latencyMs;
+    bool fail = false;
+    {
+      std::lock_guard<std::mutex> guard{rngMutex_};
+      if (opts_.jitterMs > 0) {
+        delayMs += std::uniform_int_distribution<int>{0, opts_.jitterMs}(rng_);
+      }
+      fail = (opts_.errorRate > 0 && std::uniform_real_distribution<double>{0.0, 1.0}(rng_) < opts_.errorRate);
+    }
+
+    if (delayMs > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{delayMs});
+    }
+    if (fail) {
+      res.status = opts_.errorStatus;
+      res.body = "injected error";
+    }
+  }
+
+  void queryMeta(Response& res, const IndexT index) {
+    res.headers.emplace_back("Content-Type", "application/json");
+    res.headers.emplace_back("X-Consul-Index", std::to_string(index));
+    res.headers.emplace_back("X-Consul-KnownLeader", "true");
+    res.headers.emplace_back("X-Consul-LastContact", std::to_string(opts_.lastContactMs));
+  }
+
+  bool checkDatacenter(const Request& req, Response& res) {
+    const auto it = req.params.find("dc");
+    if (it != req.params.end() && !it->second.empty() && it->second != opts_.datacenter) {
+      res.status = 500;
+      res.body = "No path to datacenter";
+      return false;
+    }
+    return true;
+  }
+
+  void kv(const Request& req, const std::string& key, Response& res) {
+    if (!checkDatacenter(req, res)) {
+      return;
+    }
+
+    const bool recurse = (req.params.count("recurse") > 0);
+    if (req.method == "GET") {
+      IndexT minIndex = 0;
+      std::chrono::milliseconds wait = DEFAULT_WAIT;
+      auto it = req.params.find("index");
+      if (it != req.params.end()) {
+        minIndex = std::strtoull(it->second.c_str(), nullptr, 10);
+      }
+      it = req.params.find("wait");
+      if (it != req.params.end() && !parseWait(it->second, wait)) {
+        res.status = 400;
+        res.body = "Invalid wait time";
+        return;
+      }
+      store_.wait(minIndex, wait);
+
+      const bool keysOnly = (req.params.count("keys") > 0);
+      std::size_t found = 0;
+      const IndexT index = store_.apply([&](StoreT& kvs, IndexT& idx) {
+          res.body = "[";
+          auto first = (recurse || keysOnly ? kvs.lower_bound(key) : kvs.find(key));
+          for (auto i = first; i != kvs.end(); ++i) {
+            if (i->first.compare(0, key.size(), key) != 0 || (!recurse && !keysOnly && i->first != key)) {
+              break;
+            }
+            if (found++ > 0) {
+              res.body += ",";
+            }
+            if (keysOnly) {
+              ::consul::JsonValue::DumpString(res.body, i->first);
+            } else {
+              dumpEntry(res.body, i->first, i->second, true);
+            }
+          }
+          res.body += "]";
+          return idx;
+        });
+
+      queryMeta(res, index);
+      if (found == 0) {
+        res.status = 404;
+        res.body.clear();
+      }
+    } else if (req.method == "PUT") {
+      const bool ok = store_.apply([&](StoreT& kvs, IndexT& idx) {
+          return put(kvs, idx, req, key);
+        });
+      res.body = (ok ? "true" : "false");
+    } else if (req.method == "DELETE") {
+      const bool ok = store_.apply([&](StoreT& kvs, IndexT& idx) {
+          auto it = req.params.find("cas");
+          if (it != req.params.end()) {
+            auto e = kvs.find(key);
+            if (e == kvs.end() || e->second.modifyIndex != std::strtoull(it->second.c_str(), nullptr, 10)) {
+              return false;
+            }
+          }
+
+          bool deleted = false;
+          if (recurse) {
+            auto first = kvs.lower_bound(key);
+            auto last = first;
+            while (last != kvs.end() && last->first.compare(0, key.size(), key) == 0) {
+              ++last;
+            }
+            deleted = (first != last);
+            kvs.erase(first, last);
+          } else {
+            deleted = (kvs.erase(key) > 0);
+          }
+          if (deleted) {
+            ++idx;
+          }
+          return true;
+        });
+      res.body = (ok ? "true" : "false");
+    } else {
+      res.status = 405;
+      res.body = "Method not allowed";
+    }
+  }
+
+  // PUT /v1/kv/<key>, honoring ?cas=, ?flags=, ?acquire= and ?release=
+  static bool put(StoreT& kvs, IndexT& idx, const Request& req, const std::string& key) {
+    auto e = kvs.find(key);
+    auto it = req.params.find("cas");
+    if (it != req.params.end()) {
+      const IndexT cas = std::strtoull(it->second.c_str(), nullptr, 10);
+      if ((cas == 0 && e != kvs.end()) || (cas != 0 && (e == kvs.end() || e->second.modifyIndex != cas))) {
+        return false;
+      }
+    }
+
+    const auto acquire = req.params.find("acquire");
+    const auto release = req.params.find("release");
+    if (e != kvs.end() && acquire != req.params.end() &&
+        !e->second.session.empty() && e->second.session != acquire->second) {
+      return false;
+    }
+    if (release != req.params.end() && (e == kvs.end() || e->second.session != release->second)) {
+      return false;
+    }
+
+    Entry& entry = kvs[key];
+    ++idx;
+    if (entry.createIndex == 0) {
+      entry.createIndex = idx;
+    }
+    entry.modifyIndex = idx;
+    entry.value = req.body;
+    entry.hasValue = !req.body.empty();
+    it = req.params.find("flags");
+    if (it != req.params.end()) {
+      entry.flags = std::strtoull(it->second.c_str(), nullptr, 10);
+    }
+    if (acquire != req.params.end() && entry.session != acquire->second) {
+      entry.session = acquire->second;
+      entry.lockIndex++;
+    }
+    if (release != req.params.end()) {
+      entry.session.clear();
+    }
+    return true;
+  }
+
+  // PUT /v1/txn: KV operations applied atomically
+  void txn(const Request& req, Response& res) {
+    if (req.method != "PUT") {
+      res.status = 405;
+      res.body = "Method not allowed";
+      return;
+    }
+    if (!checkDatacenter(req, res)) {
+      return;
+    }
+
+    ::consul::JsonDocument doc;
+    std::string err;
+    if (!::consul::JsonDocument::Parse(doc, req.body, err) || !doc.root().is_array()) {
+      res.status = 400;
+      res.body = "Failed to parse body: " + (err.empty() ? std::string("expected an array") : err);
+      return;
+    }
+    if (doc.root().size() > MAX_TXN_OPS) {
+      res.status = 413;
+      res.body = "Transaction contains too many operations";
+      return;
+    }
+
+    const IndexT index = store_.apply([&](StoreT& kvs, IndexT& idx) {
+        // Operations are applied to a copy, which replaces the store only if
+        // they all succeed
+        StoreT next = kvs;
+        IndexT nextIdx = idx + 1;
+        std::string results, errors;
+        std::size_t opIndex = 0;
+        for (const auto& op : doc.root()) {
+          std::string what;
+          if (!txnOp(next, nextIdx, op["KV"], results, what)) {
+            if (!errors.empty()) {
+              errors += ",";
+            }
+            errors += "{\"OpIndex\":" + std::to_string(opIndex) + ",\"What\":";
+            ::consul::JsonValue::DumpString(errors, what);
+            errors += "}";
+          }
+          opIndex++;
+        }
+
+        if (!errors.empty()) {
+          res.status = 409;
+          res.body = "{\"Results\":null,\"Errors\":[" + errors + "]}";
+          return idx;
+        }
+
+        kvs.swap(next);
+        idx = nextIdx;
+        res.body = "{\"Results\":[" + results + "],\"Errors\":null}";
+        return idx;
+      });
+    queryMeta(res, index);
+  }
+
+  static bool txnOp(StoreT& kvs, const IndexT idx, const ::consul::JsonValue& op, std::string& results,
+                    std::string& what) {
+    if (!op.is_object()) {
+      what = "only KV operations are supported";
+      return false;
+    }
+
+    const std::string verb = op["Verb"].string_value().to_string();
+    const std::string key = op["Key"].string_value().to_string();
+    IndexT index = 0;
+    op["Index"].uint64_value(index);
+    auto e = kvs.find(key);
+
+    auto result = [&](const std::string& k, const Entry& entry, const bool withValue) {
+      if (!results.empty()) {
+        results += ",";
+      }
+      results += "{\"KV\":";
+      dumpEntry(results, k, entry, withValue);
+      results += "}";
+    };
+
+    if (verb == "get") {
+      if (e == kvs.end()) {
+        what = "key \"" + key + "\" doesn't exist";
+        return false;
+      }
+      result(e->first, e->second, true);
+    } else if (verb == "get-tree") {
+      for (auto i = kvs.lower_bound(key); i != kvs.end() && i->first.compare(0, key.size(), key) == 0; ++i) {
+        result(i->first, i->second, true);
+      }
+    } else if (verb == "set" || verb == "cas") {
+      if (verb == "cas" && ((index == 0 && e != kvs.end()) ||
+                            (index != 0 && (e == kvs.end() || e->second.modifyIndex != index)))) {
+        what = "failed to set key \"" + key + "\", index is stale";
+        return false;
+      }
+      Entry& entry = kvs[key];
+      if (entry.createIndex == 0) {
+        entry.createIndex = idx;
+      }
+      entry.modifyIndex = idx;
+      entry.hasValue = op["Value"].is_string();
+      entry.value = base64Decode(op["Value"].string_value());
+      op["Flags"].uint64_value(entry.flags);
+      result(key, entry, false);
+    } else if (verb == "check-index") {
+      if (e == kvs.end() || e->second.modifyIndex != index) {
+        what = "current modify index " + (e == kvs.end() ? std::string("0") : std::to_string(e->second.modifyIndex)) +
+               " for key \"" + key + "\" doesn't match";
+        return false;
+      }
+      result(e->first, e->second, false);
+    } else if (verb == "check-not-exists") {
+      if (e != kvs.end()) {
+        what = "key \"" + key + "\" exists";
+        return false;
+      }
+    } else if (verb == "delete") {
+      kvs.erase(key);
+    } else if (verb == "delete-tree") {
+      auto last = kvs.lower_bound(key);
+      while (last != kvs.end() && last->first.compare(0, key.size(), key) == 0) {
+        ++last;
+      }
+      kvs.erase(kvs.lower_bound(key), last);
+    } else if (verb == "delete-cas") {
+      if (e == kvs.end() || e->second.modifyIndex != index) {
+        what = "failed to delete key \"" + key + "\", index is stale";
+        return false;
+      }
+      kvs.erase(e);
+    } else {
+      what = "unknown KV verb \"" + verb + "\"";
+      return false;
+    }
+    return true;
+  }
+
+  void agentSelf(Response& res) {
+    std::string& out = res.body;
+    out = "{\"Config\":{\"Datacenter\":";
+    ::consul::JsonValue::DumpString(out, opts_.datacenter);
+    out += ",\"NodeName\":";
+    ::consul::JsonValue::DumpString(out, opts_.node);
+    out += ",\"Server\":true,\"Version\":\"mock\"},\"Member\":{\"Name\":";
+    ::consul::JsonValue::DumpString(out, opts_.node);
+    out += ",\"Addr\":\"127.0.0.1\",\"Port\":8301,\"Status\":1}}";
+  }
+
+  const Options& opts_;
+  Store& store_;
+  std::mutex rngMutex_;
+  std::mt19937 rng_;
+};
+
+
+const char*
+statusText(const int status) {
+  switch (status) {
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 409: return "Conflict";
+  case 413: return "Request Entity Too Large";
+  case 429: return "Too Many Requests";
+  case 500: return "Internal Server Error";
+  case 503: return "Service Unavailable";
+  default:  return "Unknown";
+  }
+}
+
+
+bool
+writeAll(const int fd, const std::string& data) {
+  std::size_t off = 0;
+  while (off < data.size()) {
+    const ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    off += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+
+// Read one request from fd.  buf carries bytes read past the end of the
+// previous request on a kept-alive connection.
+bool
+readRequest(const int fd, std::string& buf, Request& req) {
+  std::size_t headerEnd;
+  while ((headerEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+    char chunk[16384];
+    const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf.append(chunk, static_cast<std::size_t>(n));
+  }
+
+  std::istringstream head{buf.substr(0, headerEnd)};
+  std::string line, target, version;
+  std::getline(head, line);
+  std::istringstream requestLine{line};
+  requestLine >> req.method >> target >> version;
+
+  while (std::getline(head, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    const auto colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    std::string value = line.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+    req.headers[name] = value;
+  }
+
+  const auto q = target.find('?');
+  req.path = percentDecode(target.substr(0, q));
+  if (q != std::string::npos) {
+    std::istringstream query{target.substr(q + 1)};
+    std::string param;
+    while (std::getline(query, param, '&')) {
+      const auto eq = param.find('=');
+      req.params[percentDecode(param.substr(0, eq))] =
+          (eq == std::string::npos ? std::string() : percentDecode(param.substr(eq + 1)));
+    }
+  }
+
+  const auto connection = req.headers.find("connection");
+  req.keepAlive = (version == "HTTP/1.1");
+  if (connection != req.headers.end()) {
+    req.keepAlive = (connection->second == "keep-alive" ||
+                     (req.keepAlive && connection->second != "close"));
+  }
+
+  std::size_t contentLength = 0;
+  const auto cl = req.headers.find("content-length");
+  if (cl != req.headers.end()) {
+    contentLength = std::strtoull(cl->second.c_str(), nullptr, 10);
+  }
+
+  buf.erase(0, headerEnd + 4);
+  while (buf.size() < contentLength) {
+    char chunk[16384];
+    const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf.append(chunk, static_cast<std::size_t>(n));
+  }
+  req.body = buf.substr(0, contentLength);
+  buf.erase(0, contentLength);
+  return true;
+}
+
+
+void
+serveConnection(const int fd, Server& server, const bool debug) {
+  std::string buf;
+  for (;;) {
+    Request req;
+    if (!readRequest(fd, buf, req)) {
+      break;
+    }
+
+    const Response res = server.handle(req);
+    LOG_IF(debug, INFO) << req.method << " " << req.path << " " << res.status << " " << res.body.size();
+
+    std::ostringstream out;
+    out << "HTTP/1.1 " << res.status << " " << statusText(res.status) << "\r\n";
+    for (const auto& h : res.headers) {
+      out << h.first << ": " << h.second << "\r\n";
+    }
+    out << "Content-Length: " << res.body.size() << "\r\n"
+        << "Connection: " << (req.keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+    if (!writeAll(fd, out.str()) || !writeAll(fd, res.body) || !req.keepAlive) {
+      break;
+    }
+  }
+  ::close(fd);
+}
+
+
+// Seed lines are key=value; blank lines and lines starting with # are skipped
+bool
+seedFromFile(Store& store, const std::string& path, IndexT& index) {
+  std::ifstream in{path};
+  if (!in) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    const auto eq = line.find('=');
+    store.seed(line.substr(0, eq), (eq == std::string::npos ? std::string() : line.substr(eq + 1)), index++);
+  }
+  return true;
+}
+
+
+// The keys loaded by playground's load-test-keys target, at the indexes the
+// regression tests' expected output was recorded with
+void
+seedDefaults(Store& store, IndexT& index) {
+  store.seed("test", "test-value", 469);
+  store.seed("test/key1", "test1-value", 470);
+  store.seed("test/key2", "test2-value", 471);
+  store.seed("typed/bool", "true", 472);
+  store.seed("typed/int", "42", 473);
+  store.seed("typed/json", "{\"enabled\": true, \"replicas\": 3}", 474);
+  store.seed("typed/text", "test-value", 475);
+  index = 476;
+}
+
+} // namespace
+
+
+int
+main(int argc, char* argv[]) {
+  el::Configurations defaultConf;
+  defaultConf.setToDefault();
+  defaultConf.setGlobally(el::ConfigurationType::ToFile, std::string("false"));
+  defaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, std::string("true"));
+  el::Loggers::reconfigureLogger("default", defaultConf);
+  if (::isatty(::fileno(stdout)))
+    el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
+
+  Options opts;
+  Store store;
+  std::string bindAddr;
+  int port = 0;
+
+  try {
+    TCLAP::CmdLine cmd(COMMAND_HELP_MSG, '=', "0.1");
+
+    TCLAP::SwitchArg debugArg("d", "debug", "Log every request", false);
+    cmd.add(debugArg);
+
+    TCLAP::ValueArg<std::string> bindArg("b", "bind", "Address to listen on", false, "127.0.0.1", "address");
+    cmd.add(bindArg);
+
+    TCLAP::ValueArg<int> portArg("p", "port", "Port to listen on", false, 8500, "port");
+    cmd.add(portArg);
+
+    TCLAP::ValueArg<std::string> dcArg("c", "datacenter", "Datacenter reported by the agent; other ?dc= values fail", false, opts.datacenter, "dc");
+    cmd.add(dcArg);
+
+    TCLAP::ValueArg<std::string> leaderArg("L", "leader", "Address reported by /v1/status/leader and /v1/status/peers", false, opts.leader, "host:port");
+    cmd.add(leaderArg);
+
+    TCLAP::ValueArg<std::string> seedArg("s", "seed", "File of key=value lines to load instead of the regression test keys", false, "", "path");
+    cmd.add(seedArg);
+
+    TCLAP::ValueArg<std::size_t> largeKeysArg("n", "large-keys", "Number of keys to add under large/", false, 0, "count");
+    cmd.add(largeKeysArg);
+
+    TCLAP::ValueArg<std::size_t> largeSizeArg("z", "large-value-size", "Size in bytes of the values of the large/ keys", false, 1024, "bytes");
+    cmd.add(largeSizeArg);
+
+    TCLAP::ValueArg<int> latencyArg("l", "latency", "Delay (ms) added to every response", false, 0, "ms");
+    cmd.add(latencyArg);
+
+    TCLAP::ValueArg<int> jitterArg("j", "jitter", "Random extra delay (ms), up to this much", false, 0, "ms");
+    cmd.add(jitterArg);
+
+    TCLAP::ValueArg<double> errorRateArg("e", "error-rate", "Fraction of requests answered with --error-status", false, 0.0, "0.0-1.0");
+    cmd.add(errorRateArg);
+
+    TCLAP::ValueArg<int> errorStatusArg("E", "error-status", "HTTP status of injected errors", false, opts.errorStatus, "status");
+    cmd.add(errorStatusArg);
+
+    TCLAP::ValueArg<std::string> faultPrefixArg("f", "fault-prefix", "Only inject latency and errors into requests for paths with this prefix", false, opts.faultPrefix, "path");
+    cmd.add(faultPrefixArg);
+
+    TCLAP::ValueArg<IndexT> lastContactArg("C", "last-contact", "X-Consul-LastContact (ms) reported for reads", false, 0, "ms");
+    cmd.add(lastContactArg);
+
+    cmd.parse(argc, argv);
+
+    opts.debug = debugArg.getValue();
+    opts.datacenter = dcArg.getValue();
+    opts.leader = leaderArg.getValue();
+    opts.latencyMs = latencyArg.getValue();
+    opts.jitterMs = jitterArg.getValue();
+    opts.errorRate = errorRateArg.getValue();
+    opts.errorStatus = errorStatusArg.getValue();
+    opts.faultPrefix = faultPrefixArg.getValue();
+    opts.lastContactMs = lastContactArg.getValue();
+    bindAddr = bindArg.getValue();
+    port = portArg.getValue();
+
+    IndexT index = 1;
+    if (seedArg.isSet()) {
+      if (!seedFromFile(store, seedArg.getValue(), index)) {
+        LOG(ERROR) << "Unable to read seed file " << seedArg.getValue();
+        return EX_NOINPUT;
+      }
+    } else {
+      seedDefaults(store, index);
+    }
+
+    const std::string value(largeSizeArg.getValue(), 'x');
+    for (std::size_t i = 0; i < largeKeysArg.getValue(); ++i) {
+      char key[32];
+      std::snprintf(key, sizeof(key), "large/%08zu", i);
+      store.seed(key, value, index++);
+    }
+  } catch (TCLAP::ArgException &e)  {
+    LOG(FATAL) << e.error() << " for arg " << e.argId();
+    return EX_USAGE;
+  }
+
+  const int lfd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (lfd < 0) {
+    LOG(ERROR) << "socket(2) failed: " << std::strerror(errno);
+    return EX_OSERR;
+  }
+  const int one = 1;
+  ::setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<std::uint16_t>(port));
+  if (::inet_pton(AF_INET, bindAddr.c_str(), &addr.sin_addr) != 1) {
+    LOG(ERROR) << "Invalid bind address " << bindAddr;
+    return EX_USAGE;
+  }
+  if (::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(lfd, 128) != 0) {
+    LOG(ERROR) << "Unable to listen on " << bindAddr << ":" << port << ": " << std::strerror(errno);
+    return EX_UNAVAILABLE;
+  }
+  LOG(INFO) << "consul-mock listening on " << bindAddr << ":" << port;
+
+  Server server{opts, store};
+  for (;;) {
+    const int fd = ::accept(lfd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      LOG(ERROR) << "accept(2) failed: " << std::strerror(errno);
+      return EX_OSERR;
+    }
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // One thread per connection, so blocking queries don't hold up others
+    std::thread{serveConnection, fd, std::ref(server), opts.debug}.detach();
+  }
+}
@@ -29,6 +29,8 @@ extern "C" {
 #include "tclap/CmdLine.h"
 
 #include "consul/agent.hpp"
+#include "consul/agent_pool.hpp"
+#include "consul/json_document.hpp"
 #include "consul/peers.hpp"
 
 INITIALIZE_EASYLOGGINGPP
@@ -50,9 +52,9 @@ constexpr int
   ALL = std::numeric_limits<int>::max();
 } // namespace statusFlags
 
-static int statusLeader(::consul::Agent& agent);
-static int statusPeers(::consul::Agent& agent);
-static int statusSelf(::consul::Agent& agent);
+static int statusLeader(::consul::AgentPool& pool);
+static int statusPeers(::consul::AgentPool& pool);
+static int statusSelf(::consul::AgentPool& pool);
 
 using ConsulPrefixSegmentT = std::string;
 using ConsulPrefixT = std::vector<ConsulPrefixSegmentT>;
@@ -233,6 +235,7 @@ main(int argc, char* argv[]) {
     el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
 
   ::consul::Agent agent;
+  ::consul::AgentPool pool;
   auto statusFlags = StatusFlags::NONE;
 
   try {
@@ -242,6 +245,9 @@ main(int argc, char* argv[]) {
     TCLAP::SwitchArg debugArg("d", "debug", "Print additional information with debugging", false);
     cmd.add(debugArg);
 
+    TCLAP::ValueArg<std::string> agentsArg("A", "agents", "Comma separated list of consul agents (host[:port]) to fail over between", false, "", "host[:port],...");
+    cmd.add(agentsArg);
+
     TCLAP::ValueArg<consul::Agent::PortT> portArg("p", "port", "Port number of consul agent", false, agent.port(), "port");
     cmd.add(portArg);
 
@@ -267,6 +273,16 @@ main(int argc, char* argv[]) {
       agent.setPort(portArg.getValue());
     }
 
+    if (agentsArg.isSet()) {
+      std::string err;
+      if (!::consul::AgentPool::InitFromList(pool, agentsArg.getValue(), agent.port(), err)) {
+        LOG(ERROR) << "Invalid agent list: " << err;
+        return EX_USAGE;
+      }
+    } else {
+      pool = ::consul::AgentPool{agent};
+    }
+
     if (statusTypeArg.isSet()) {
       const auto& v = statusTypeArg.getValue();
       if (v == "all") {
@@ -293,19 +309,19 @@ main(int argc, char* argv[]) {
   }
 
   if (statusFlags & StatusFlags::LEADER) {
-    auto ret = statusLeader(agent);
+    auto ret = statusLeader(pool);
     if (ret != EX_OK)
       return ret;
   }
 
   if (statusFlags & StatusFlags::PEERS) {
-    auto ret = statusPeers(agent);
+    auto ret = statusPeers(pool);
     if (ret != EX_OK)
       return ret;
   }
 
   if (statusFlags & StatusFlags::SELF) {
-    auto ret = statusSelf(agent);
+    auto ret = statusSelf(pool);
     if (ret != EX_OK)
       return ret;
   }
@@ -316,11 +332,13 @@ main(int argc, char* argv[]) {
 
 
 static int
-statusLeader(::consul::Agent& agent) {
+statusLeader(::consul::AgentPool& pool) {
   try {
-    auto r = cpr::Get(cpr::Url{agent.statusLeaderUrl()},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{agent.timeoutMs()});
+    auto r = pool.request([](::consul::Agent& agent) {
+        return cpr::Get(cpr::Url{agent.statusLeaderUrl()},
+                        cpr::Header{{"Connection", "close"}},
+                        cpr::Timeout{agent.timeoutMs()});
+      });
     if (r.status_code != 200) {
       LOG(ERROR) << "consul returned error " << r.status_code;
       return EX_TEMPFAIL;
@@ -352,11 +370,13 @@ statusLeader(::consul::Agent& agent) {
 
 
 static int
-statusPeers(::consul::Agent& agent) {
+statusPeers(::consul::AgentPool& pool) {
   try {
-    auto r = cpr::Get(cpr::Url{agent.statusPeersUrl()},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{agent.timeoutMs()});
+    auto r = pool.request([](::consul::Agent& agent) {
+        return cpr::Get(cpr::Url{agent.statusPeersUrl()},
+                        cpr::Header{{"Connection", "close"}},
+                        cpr::Timeout{agent.timeoutMs()});
+      });
     if (r.status_code != 200) {
       LOG(ERROR) << "consul returned error " << r.status_code;
       return EX_TEMPFAIL;
@@ -372,7 +392,7 @@ statusPeers(::consul::Agent& agent) {
     }
 
     for (auto& peer : peers.peers) {
-      std::cout << "JSON Peer: " << json11::Json(peer).dump() << std::endl;
+      std::cout << "JSON Peer: " << peer.json() << std::endl;
     }
 
     return EX_OK;
@@ -384,7 +404,7 @@ statusPeers(::consul::Agent& agent) {
 
 
 static void
-statusSelfConfigAdvertiseAddrs(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfigAdvertiseAddrs(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "advertise_addrs");
   for (const auto& kv : configConsulConfigAdvertiseAddrsToOidMap) {
     std::cout << formatConsulOidFullValue(prefix, kv.second.oidName, cfg[kv.first].dump()) << std::endl;
@@ -393,7 +413,7 @@ statusSelfConfigAdvertiseAddrs(const json11::Json& cfg, const ConsulPrefixT& bas
 
 
 static void
-statusSelfConfigDns(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfigDns(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "dns_config");
   for (const auto& kv : configConsulConfigDnsToOidMap) {
     std::cout << formatConsulOidFullValue(prefix, kv.second.oidName, cfg[kv.first].dump()) << std::endl;
@@ -402,7 +422,7 @@ statusSelfConfigDns(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
 
 
 static void
-statusSelfConfigPorts(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfigPorts(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "ports");
   for (const auto& kv : configConsulConfigPortsToOidMap) {
     std::cout << formatConsulOidFullValue(prefix, kv.second.oidName, cfg[kv.first].dump()) << std::endl;
@@ -411,7 +431,7 @@ statusSelfConfigPorts(const json11::Json& cfg, const ConsulPrefixT& basePrefix)
 
 
 static void
-statusSelfConfigAddresses(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfigAddresses(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "addresses");
   for (const auto& kv : configConsulConfigAddressesToOidMap) {
     std::cout << formatConsulOidFullValue(prefix, kv.second.oidName, cfg[kv.first].dump()) << std::endl;
@@ -419,7 +439,7 @@ statusSelfConfigAddresses(const json11::Json& cfg, const ConsulPrefixT& basePref
 }
 
 static void
-statusSelfConfigUnixSockets(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfigUnixSockets(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "unix_sockets");
   for (const auto& kv : configConsulConfigUnixSocketsToOidMap) {
     std::cout << formatConsulOidFullValue(prefix, kv.second.oidName, cfg[kv.first].dump()) << std::endl;
@@ -428,7 +448,7 @@ statusSelfConfigUnixSockets(const json11::Json& cfg, const ConsulPrefixT& basePr
 
 
 static void
-statusSelfConfig(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfConfig(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "config");
 
   // FIXME(seanc@): Sort everything by the oidName, not its Consul Name
@@ -449,7 +469,7 @@ statusSelfConfig(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
 
 
 static void
-statusSelfCoord(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfCoord(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "coord");
 
   for (const auto& kv : configConsulCoordToOidMap) {
@@ -460,7 +480,7 @@ statusSelfCoord(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
 
 
 static void
-statusSelfMemberTags(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfMemberTags(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "tags");
 
   for (const auto& kv : configConsulMemberTagsToOidMap) {
@@ -470,7 +490,7 @@ statusSelfMemberTags(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
 
 
 static void
-statusSelfMember(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
+statusSelfMember(const ::consul::JsonValue& cfg, const ConsulPrefixT& basePrefix) {
   auto prefix = appendPrefix(basePrefix, "member");
 
   for (const auto& kv : configConsulMemberToOidMap) {
@@ -482,11 +502,13 @@ statusSelfMember(const json11::Json& cfg, const ConsulPrefixT& basePrefix) {
 
 
 static int
-statusSelf(::consul::Agent& agent) {
+statusSelf(::consul::AgentPool& pool) {
   try {
-    auto r = cpr::Get(cpr::Url{agent.selfUrl()},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{agent.timeoutMs()});
+    auto r = pool.request([](::consul::Agent& agent) {
+        return cpr::Get(cpr::Url{agent.selfUrl()},
+                        cpr::Header{{"Connection", "close"}},
+                        cpr::Timeout{agent.timeoutMs()});
+      });
     if (r.status_code != 200) {
       LOG(ERROR) << "consul returned error " << r.status_code;
       return EX_TEMPFAIL;
@@ -494,13 +516,14 @@ statusSelf(::consul::Agent& agent) {
 
     // Parse response as json
     std::string err;
-    auto jsr = json11::Json::parse(r.text, err);
-    if (!err.empty()) {
+    ::consul::JsonDocument doc;
+    if (!::consul::JsonDocument::Parse(doc, std::move(r.text), err)) {
       LOG(ERROR) << "Unable to parse json: " << err;
       return EX_PROTOCOL;
     }
 
     const ConsulPrefixT prefix = {"consul", "agent", "status"};
+    const auto& jsr = doc.root();
     statusSelfConfig(jsr["Config"], prefix);
     statusSelfCoord(jsr["Coord"], prefix);
     statusSelfMember(jsr["Member"], prefix);
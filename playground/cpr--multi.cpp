@@ -0,0 +1 @@
+../src/cpr--multi.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../src/cpr--share.cpp
\ No newline at end of file
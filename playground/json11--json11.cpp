@@ -1 +0,0 @@
-../src/json11--json11.cpp
\ No newline at end of file
@@ -1,4 +1,4 @@
-/* pg_consul/pg_consul--0.1.0.sql */
+/* pg_consul/pg_consul--0.2.0.sql */
 
 -- complain if script is sourced in psql, rather than via CREATE EXTENSION
 \echo Use "CREATE EXTENSION pg_consul" to load this file. \quit
@@ -32,6 +32,14 @@ LANGUAGE C
 LEAKPROOF
 ROWS 5;
 
+-- Planner support for consul_kv_get(): calls that only need some of the
+-- output columns are rewritten to the overload below.
+CREATE FUNCTION consul_kv_get_support(INTERNAL)
+RETURNS INTERNAL
+AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get_support'
+LANGUAGE C
+STRICT;
+
 CREATE FUNCTION consul_kv_get(
        IN "key" TEXT,
        IN recurse BOOL DEFAULT FALSE,
@@ -46,5 +54,158 @@ CREATE FUNCTION consul_kv_get(
 RETURNS RECORD
 AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get'
 LANGUAGE C
+LEAKPROOF
+SUPPORT consul_kv_get_support;
+
+-- columns is a bitmask of the output columns to return, bit 0 being "key".
+-- Columns not in the mask are returned as NULL.
+CREATE FUNCTION consul_kv_get(
+       IN "key" TEXT,
+       IN recurse BOOL,
+       IN cluster TEXT,
+       IN columns INT4,
+       OUT "key" TEXT,
+       OUT "value" TEXT,
+       OUT flags INT8,
+       OUT create_index INT8,
+       OUT modify_index INT8,
+       OUT lock_index INT8,
+       OUT "session" TEXT)
+RETURNS RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get'
+LANGUAGE C
+LEAKPROOF;
+
+CREATE FUNCTION consul_kv_get_bool(
+       IN "key" TEXT,
+       IN recurse BOOL DEFAULT FALSE,
+       IN cluster TEXT DEFAULT NULL,
+       OUT "key" TEXT,
+       OUT "value" BOOL,
+       OUT "error" TEXT)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get_bool'
+LANGUAGE C
 LEAKPROOF;
 
+CREATE FUNCTION consul_kv_get_int8(
+       IN "key" TEXT,
+       IN recurse BOOL DEFAULT FALSE,
+       IN cluster TEXT DEFAULT NULL,
+       OUT "key" TEXT,
+       OUT "value" INT8,
+       OUT "error" TEXT)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get_int8'
+LANGUAGE C
+LEAKPROOF;
+
+CREATE FUNCTION consul_kv_get_jsonb(
+       IN "key" TEXT,
+       IN recurse BOOL DEFAULT FALSE,
+       IN cluster TEXT DEFAULT NULL,
+       OUT "key" TEXT,
+       OUT "value" JSONB,
+       OUT "error" TEXT)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_kv_get_jsonb'
+LANGUAGE C
+LEAKPROOF;
+
+
+CREATE FUNCTION consul_circuit_breakers(
+       OUT host TEXT,
+       OUT port INT4,
+       OUT state TEXT,
+       OUT consecutive_failures INT8,
+       OUT successes INT8,
+       OUT failures INT8,
+       OUT rejections INT8,
+       OUT trips INT8,
+       OUT opened_at TIMESTAMPTZ,
+       OUT retry_at TIMESTAMPTZ)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_circuit_breakers'
+LANGUAGE C;
+
+CREATE VIEW consul_circuit_breakers AS
+  SELECT * FROM consul_circuit_breakers();
+
+CREATE FUNCTION consul_agent_timeouts(
+       OUT host TEXT,
+       OUT port INT4,
+       OUT endpoint TEXT,
+       OUT samples INT8,
+       OUT p50_ms FLOAT8,
+       OUT p99_ms FLOAT8,
+       OUT timeout_ms INT4)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_agent_timeouts'
+LANGUAGE C;
+
+CREATE VIEW consul_agent_timeouts AS
+  SELECT * FROM consul_agent_timeouts();
+
+CREATE FUNCTION pg_stat_consul(
+       OUT endpoint TEXT,
+       OUT requests INT8,
+       OUT failures INT8,
+       OUT bytes_received INT8,
+       OUT bytes_decoded INT8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_stat'
+LANGUAGE C;
+
+CREATE VIEW pg_stat_consul AS
+  SELECT * FROM pg_stat_consul();
+
+-- Consul requests made by each statement, keyed like pg_stat_statements
+-- (which it can be joined with on userid, dbid and queryid).  Needs
+-- compute_query_id.
+CREATE FUNCTION pg_stat_consul_statements(
+       OUT userid OID,
+       OUT dbid OID,
+       OUT queryid INT8,
+       OUT calls INT8,
+       OUT requests INT8,
+       OUT failures INT8,
+       OUT total_time FLOAT8,
+       OUT bytes_received INT8,
+       OUT bytes_decoded INT8,
+       OUT conn_reused INT8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_stat_statements'
+LANGUAGE C;
+
+CREATE VIEW pg_stat_consul_statements AS
+  SELECT * FROM pg_stat_consul_statements();
+
+-- The last 1024 requests made to consul agents by any backend.  Keys can be
+-- sensitive, so only roles that can read all statistics may see them.
+CREATE FUNCTION pg_consul_recent_requests(
+       OUT started_at TIMESTAMPTZ,
+       OUT pid INT4,
+       OUT endpoint TEXT,
+       OUT key TEXT,
+       OUT dc TEXT,
+       OUT host TEXT,
+       OUT port INT4,
+       OUT status INT4,
+       OUT bytes_received INT8,
+       OUT bytes_decoded INT8,
+       OUT dns_ms FLOAT8,
+       OUT connect_ms FLOAT8,
+       OUT tls_ms FLOAT8,
+       OUT first_byte_ms FLOAT8,
+       OUT total_ms FLOAT8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_consul_v1_recent_requests'
+LANGUAGE C;
+
+CREATE VIEW pg_consul_recent_requests AS
+  SELECT * FROM pg_consul_recent_requests();
+
+REVOKE ALL ON FUNCTION pg_consul_recent_requests() FROM PUBLIC;
+REVOKE ALL ON pg_consul_recent_requests FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_consul_recent_requests() TO pg_read_all_stats;
+GRANT SELECT ON pg_consul_recent_requests TO pg_read_all_stats;
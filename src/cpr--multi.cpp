@@ -0,0 +1,114 @@
+#include "cpr/multi.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "cpr/curlholder.h"
+
+namespace cpr {
+
+class Multi::Impl {
+  public:
+    Impl();
+    ~Impl();
+
+    void Add(Session& session);
+    void Remove(Session& session);
+    int Perform();
+    void Poll(const long& timeout_ms);
+    Session* NextDone();
+
+  private:
+    CURLM* multi_;
+    std::vector<std::pair<CURL*, Session*>> sessions_;
+};
+
+Multi::Impl::Impl() : multi_{curl_multi_init()} {
+#ifdef CURLPIPE_MULTIPLEX
+    // Send concurrent HTTP/2 requests to the same host over one connection
+    if (multi_) {
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+#endif
+}
+
+Multi::Impl::~Impl() {
+    for (auto& item : sessions_) {
+        curl_multi_remove_handle(multi_, item.first);
+    }
+    curl_multi_cleanup(multi_);
+}
+
+void Multi::Impl::Add(Session& session) {
+    auto curl = session.GetCurlHolder()->handle;
+    if (multi_ && curl) {
+        curl_multi_add_handle(multi_, curl);
+        sessions_.emplace_back(curl, &session);
+    }
+}
+
+void Multi::Impl::Remove(Session& session) {
+    auto curl = session.GetCurlHolder()->handle;
+    auto item = std::find_if(sessions_.begin(), sessions_.end(),
+                             [curl](const std::pair<CURL*, Session*>& i) { return i.first == curl; });
+    if (item != sessions_.end()) {
+        curl_multi_remove_handle(multi_, curl);
+        sessions_.erase(item);
+    }
+}
+
+int Multi::Impl::Perform() {
+    int running = 0;
+    if (multi_) {
+        curl_multi_perform(multi_, &running);
+    }
+    return running;
+}
+
+void Multi::Impl::Poll(const long& timeout_ms) {
+    if (multi_) {
+        int numfds = 0;
+        curl_multi_wait(multi_, NULL, 0, static_cast<int>(timeout_ms), &numfds);
+    }
+}
+
+Session* Multi::Impl::NextDone() {
+    if (!multi_) {
+        return nullptr;
+    }
+
+    int queued = 0;
+    while (auto msg = curl_multi_info_read(multi_, &queued)) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        auto curl = msg->easy_handle;
+        auto item = std::find_if(sessions_.begin(), sessions_.end(),
+                                 [curl](const std::pair<CURL*, Session*>& i) { return i.first == curl; });
+        if (item == sessions_.end()) {
+            continue;
+        }
+
+        auto session = item->second;
+        curl_multi_remove_handle(multi_, curl);
+        sessions_.erase(item);
+        return session;
+    }
+    return nullptr;
+}
+
+// clang-format off
+Multi::Multi() : pimpl_{ new Impl{} } {}
+Multi::~Multi() {}
+void Multi::Add(Session& session) { pimpl_->Add(session); }
+void Multi::Remove(Session& session) { pimpl_->Remove(session); }
+int Multi::Perform() { return pimpl_->Perform(); }
+void Multi::Poll(const long& timeout_ms) { pimpl_->Poll(timeout_ms); }
+Session* Multi::NextDone() { return pimpl_->NextDone(); }
+// clang-format on
+
+} // namespace cpr
@@ -20,6 +20,11 @@ class Session::Impl {
     void SetParameters(Parameters&& parameters);
     void SetHeader(const Header& header);
     void SetTimeout(const Timeout& timeout);
+    void SetConnectTimeout(const ConnectTimeout& timeout);
+    void SetShare(const Share& share);
+    void SetSslOptions(const SslOptions& options);
+    void SetHttpVersion(const HttpVersion& version);
+    void SetAcceptEncoding(const AcceptEncoding& encoding);
     void SetAuth(const Authentication& auth);
     void SetDigest(const Digest& auth);
     void SetPayload(Payload&& payload);
@@ -42,13 +47,22 @@ class Session::Impl {
     Response Post();
     Response Put();
 
+    void PrepareGet();
+    void PreparePut();
+    Response Complete();
+    CurlHolder* GetCurlHolder();
+
   private:
     std::unique_ptr<CurlHolder, std::function<void(CurlHolder*)>> curl_;
     Url url_;
     Parameters parameters_;
     Proxies proxies_;
+    std::string response_string_;
+    std::string header_string_;
 
     Response makeRequest(CURL* curl);
+    void prepareRequest(CURL* curl);
+    Response completeRequest(CURL* curl);
     static void freeHolder(CurlHolder* holder);
     static CurlHolder* newHolder();
 };
@@ -130,6 +144,64 @@ void Session::Impl::SetTimeout(const Timeout& timeout) {
     }
 }
 
+void Session::Impl::SetConnectTimeout(const ConnectTimeout& timeout) {
+    auto curl = curl_->handle;
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, timeout.ms);
+    }
+}
+
+void Session::Impl::SetShare(const Share& share) {
+    auto curl = curl_->handle;
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share.GetShareHolder()->handle);
+    }
+}
+
+void Session::Impl::SetSslOptions(const SslOptions& options) {
+    auto curl = curl_->handle;
+    if (curl) {
+        if (!options.ca_file.empty()) {
+            curl_easy_setopt(curl, CURLOPT_CAINFO, options.ca_file.data());
+        }
+        if (!options.cert_file.empty()) {
+            curl_easy_setopt(curl, CURLOPT_SSLCERT, options.cert_file.data());
+        }
+        if (!options.key_file.empty()) {
+            curl_easy_setopt(curl, CURLOPT_SSLKEY, options.key_file.data());
+        }
+    }
+}
+
+void Session::Impl::SetHttpVersion(const HttpVersion& version) {
+    auto curl = curl_->handle;
+    if (curl) {
+        switch (version) {
+        case HttpVersion::DEFAULT:
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_NONE);
+            break;
+        case HttpVersion::HTTP_1_1:
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+            break;
+        case HttpVersion::HTTP_2_TLS:
+#if LIBCURL_VERSION_NUM >= 0x072f00
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            // Wait for an existing connection to the host to be usable for
+            // multiplexing rather than opening another one.
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+            break;
+        }
+    }
+}
+
+void Session::Impl::SetAcceptEncoding(const AcceptEncoding& encoding) {
+    auto curl = curl_->handle;
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, encoding.encodings.data());
+    }
+}
+
 void Session::Impl::SetAuth(const Authentication& auth) {
     auto curl = curl_->handle;
     if (curl) {
@@ -279,6 +351,36 @@ Response Session::Impl::Get() {
     return makeRequest(curl);
 }
 
+void Session::Impl::PrepareGet() {
+    auto curl = curl_->handle;
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_POST, 0L);
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, nullptr);
+    }
+
+    prepareRequest(curl);
+}
+
+void Session::Impl::PreparePut() {
+    auto curl = curl_->handle;
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+    }
+
+    prepareRequest(curl);
+}
+
+Response Session::Impl::Complete() {
+    return completeRequest(curl_->handle);
+}
+
+CurlHolder* Session::Impl::GetCurlHolder() {
+    return curl_.get();
+}
+
 Response Session::Impl::Head() {
     auto curl = curl_->handle;
     if (curl) {
@@ -327,6 +429,12 @@ Response Session::Impl::Put() {
 }
 
 Response Session::Impl::makeRequest(CURL* curl) {
+    prepareRequest(curl);
+    curl_easy_perform(curl);
+    return completeRequest(curl);
+}
+
+void Session::Impl::prepareRequest(CURL* curl) {
     if (!parameters_.content.empty()) {
         Url new_url{url_ + "?" + parameters_.content};
         curl_easy_setopt(curl, CURLOPT_URL, new_url.data());
@@ -341,14 +449,14 @@ Response Session::Impl::makeRequest(CURL* curl) {
         curl_easy_setopt(curl, CURLOPT_PROXY, "");
     }
 
-    std::string response_string;
-    std::string header_string;
+    response_string_.clear();
+    header_string_.clear();
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cpr::util::writeFunction);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header_string);
-
-    curl_easy_perform(curl);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string_);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header_string_);
+}
 
+Response Session::Impl::completeRequest(CURL* curl) {
     char* raw_url;
     long response_code;
     double elapsed;
@@ -367,9 +475,22 @@ Response Session::Impl::makeRequest(CURL* curl) {
     }
     curl_slist_free_all(raw_cookies);
 
-    auto header = cpr::util::parseHeader(header_string);
-    response_string = cpr::util::parseResponse(response_string);
-    return Response{response_code, response_string, header, raw_url, elapsed, cookies};
+    auto header = cpr::util::parseHeader(header_string_);
+    auto response_string = cpr::util::parseResponse(response_string_);
+    Response response{response_code, response_string, header, raw_url, elapsed, cookies};
+
+    long header_bytes;
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t downloaded_bytes;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded_bytes);
+#else
+    double downloaded_bytes;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &downloaded_bytes);
+#endif
+    curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &header_bytes);
+    response.downloaded_bytes = static_cast<long long>(downloaded_bytes);
+    response.header_bytes = header_bytes;
+    return response;
 }
 
 // clang-format off
@@ -380,6 +501,11 @@ void Session::SetParameters(const Parameters& parameters) { pimpl_->SetParameter
 void Session::SetParameters(Parameters&& parameters) { pimpl_->SetParameters(std::move(parameters)); }
 void Session::SetHeader(const Header& header) { pimpl_->SetHeader(header); }
 void Session::SetTimeout(const Timeout& timeout) { pimpl_->SetTimeout(timeout); }
+void Session::SetConnectTimeout(const ConnectTimeout& timeout) { pimpl_->SetConnectTimeout(timeout); }
+void Session::SetShare(const Share& share) { pimpl_->SetShare(share); }
+void Session::SetSslOptions(const SslOptions& options) { pimpl_->SetSslOptions(options); }
+void Session::SetHttpVersion(const HttpVersion& version) { pimpl_->SetHttpVersion(version); }
+void Session::SetAcceptEncoding(const AcceptEncoding& encoding) { pimpl_->SetAcceptEncoding(encoding); }
 void Session::SetAuth(const Authentication& auth) { pimpl_->SetAuth(auth); }
 void Session::SetDigest(const Digest& auth) { pimpl_->SetDigest(auth); }
 void Session::SetPayload(const Payload& payload) { pimpl_->SetPayload(payload); }
@@ -398,6 +524,11 @@ void Session::SetOption(const Parameters& parameters) { pimpl_->SetParameters(pa
 void Session::SetOption(Parameters&& parameters) { pimpl_->SetParameters(std::move(parameters)); }
 void Session::SetOption(const Header& header) { pimpl_->SetHeader(header); }
 void Session::SetOption(const Timeout& timeout) { pimpl_->SetTimeout(timeout); }
+void Session::SetOption(const ConnectTimeout& timeout) { pimpl_->SetConnectTimeout(timeout); }
+void Session::SetOption(const Share& share) { pimpl_->SetShare(share); }
+void Session::SetOption(const SslOptions& options) { pimpl_->SetSslOptions(options); }
+void Session::SetOption(const HttpVersion& version) { pimpl_->SetHttpVersion(version); }
+void Session::SetOption(const AcceptEncoding& encoding) { pimpl_->SetAcceptEncoding(encoding); }
 void Session::SetOption(const Authentication& auth) { pimpl_->SetAuth(auth); }
 void Session::SetOption(const Digest& auth) { pimpl_->SetDigest(auth); }
 void Session::SetOption(const Payload& payload) { pimpl_->SetPayload(payload); }
@@ -418,6 +549,10 @@ Response Session::Options() { return pimpl_->Options(); }
 Response Session::Patch() { return pimpl_->Patch(); }
 Response Session::Post() { return pimpl_->Post(); }
 Response Session::Put() { return pimpl_->Put(); }
+void Session::PrepareGet() { pimpl_->PrepareGet(); }
+void Session::PreparePut() { pimpl_->PreparePut(); }
+Response Session::Complete() { return pimpl_->Complete(); }
+CurlHolder* Session::GetCurlHolder() { return pimpl_->GetCurlHolder(); }
 // clang-format on
 
 } // namespace cpr
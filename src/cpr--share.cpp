@@ -0,0 +1,45 @@
+#include "cpr/share.h"
+
+#include <curl/curl.h>
+
+#include "cpr/curlholder.h"
+
+namespace cpr {
+
+class Share::Impl {
+  public:
+    Impl();
+    ~Impl();
+
+    ShareHolder* GetShareHolder();
+
+  private:
+    ShareHolder holder_;
+};
+
+Share::Impl::Impl() {
+    holder_.handle = curl_share_init();
+    auto share = holder_.handle;
+    if (share) {
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+}
+
+Share::Impl::~Impl() {
+    curl_share_cleanup(holder_.handle);
+}
+
+ShareHolder* Share::Impl::GetShareHolder() {
+    return &holder_;
+}
+
+Share::Share() : pimpl_{ new Impl{} } {}
+Share::~Share() {}
+
+ShareHolder* Share::GetShareHolder() const { return pimpl_->GetShareHolder(); }
+
+} // namespace cpr
@@ -16,32 +16,78 @@ extern "C" {
 #include <unistd.h>
 
 #include "access/hash.h"
+#include "catalog/pg_authid.h"
+#include "catalog/pg_type.h"
+#if PG_VERSION_NUM >= 180000
+#include "commands/explain.h"
+#include "commands/explain_format.h"
+#include "commands/explain_state.h"
+#include "executor/executor.h"
+#endif
 #include "executor/instrument.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#if PG_VERSION_NUM >= 160000
+#include "nodes/miscnodes.h"
+#endif
+#include "nodes/nodeFuncs.h"
+#include "nodes/pathnodes.h"
+#include "nodes/supportnodes.h"
 #include "parser/analyze.h"
+#include "parser/parse_func.h"
 #include "parser/parsetree.h"
 #include "parser/scanner.h"
 #include "pgstat.h"
+#include "port/atomics.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "storage/spin.h"
 #include "tcop/utility.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/timeout.h"
+#include "utils/timestamp.h"
 } // extern "C"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <regex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "cpr/cpr.h"
-#include "json11.hpp"
+#include "cpr/curlholder.h"
 #include "boost/algorithm/string.hpp"
 #include "consul.hpp"
 
+// Static tracepoints for perf, bpftrace and SystemTap, built with
+// `make USDT=1`.  They compile to a nop unless a tracer is attached; see
+// doc/probes.md for the list of probes and their arguments.
+#ifdef PG_CONSUL_USDT
+#include <sys/sdt.h>
+#define PG_CONSUL_PROBE(name, ...) STAP_PROBEV(pg_consul, name, __VA_ARGS__)
+#else
+// The arguments are still type checked, and count as used, but never
+// evaluated.
+template <typename... Args> static inline void pg_consul_probe_args(const Args&...) {}
+#define PG_CONSUL_PROBE(name, ...) do { if (false) { pg_consul_probe_args(__VA_ARGS__); } } while (0)
+#endif
+
 extern "C" {
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
@@ -51,39 +97,494 @@ PG_MODULE_MAGIC;
 void _PG_init(void);
 void _PG_fini(void);
 PG_FUNCTION_INFO_V1(pg_consul_v1_agent_ping0);
+PG_FUNCTION_INFO_V1(pg_consul_v1_circuit_breakers);
 PG_FUNCTION_INFO_V1(pg_consul_v1_agent_ping2);
+PG_FUNCTION_INFO_V1(pg_consul_v1_agent_timeouts);
 PG_FUNCTION_INFO_V1(pg_consul_v1_kv_get);
+PG_FUNCTION_INFO_V1(pg_consul_v1_kv_get_bool);
+PG_FUNCTION_INFO_V1(pg_consul_v1_kv_get_int8);
+PG_FUNCTION_INFO_V1(pg_consul_v1_kv_get_jsonb);
+PG_FUNCTION_INFO_V1(pg_consul_v1_kv_get_support);
+PG_FUNCTION_INFO_V1(pg_consul_v1_recent_requests);
 PG_FUNCTION_INFO_V1(pg_consul_v1_status_leader);
+PG_FUNCTION_INFO_V1(pg_consul_v1_stat);
+PG_FUNCTION_INFO_V1(pg_consul_v1_stat_statements);
 PG_FUNCTION_INFO_V1(pg_consul_v1_status_peers);
 } // extern "C"
 
+// expression_tree_walker() and query_tree_walker() take an untyped callback
+// before PostgreSQL 16, where they became macros that cast it themselves.
+#if PG_VERSION_NUM >= 160000
+#define PG_CONSUL_TREE_WALKER(w) (w)
+#else
+#define PG_CONSUL_TREE_WALKER(w) reinterpret_cast<bool (*)()>(w)
+#endif
+
 namespace {
+// ---- Memory management
+
+// STL allocator backed by the MemoryContext that was current when it was
+// constructed.  Failures throw std::bad_alloc instead of raising an ERROR,
+// which would longjmp past the destructors of the C++ objects in flight.
+template <typename T>
+struct PgConsulAllocator {
+  using value_type = T;
+
+  PgConsulAllocator() noexcept : context{CurrentMemoryContext} {}
+  explicit PgConsulAllocator(MemoryContext context_) noexcept : context{context_} {}
+  template <typename U>
+  PgConsulAllocator(const PgConsulAllocator<U>& other) noexcept : context{other.context} {}
+
+  T* allocate(const std::size_t n) {
+    if (n > MaxAllocHugeSize / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    void* p = MemoryContextAllocExtended(context, n * sizeof(T), MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, std::size_t) noexcept {
+    pfree(p);
+  }
+
+  MemoryContext context;
+};
+
+template <typename T, typename U>
+bool operator==(const PgConsulAllocator<T>& a, const PgConsulAllocator<U>& b) noexcept {
+  return a.context == b.context;
+}
+
+template <typename T, typename U>
+bool operator!=(const PgConsulAllocator<T>& a, const PgConsulAllocator<U>& b) noexcept {
+  return a.context != b.context;
+}
+
+template <typename T>
+using PgConsulVector = std::vector<T, PgConsulAllocator<T>>;
+
+// A set-returning function's context and the callback that destroys it
+template <typename T>
+struct PgConsulFctx {
+  MemoryContextCallback callback;
+  T fctx;
+};
+
+template <typename T>
+void
+pg_consul_fctx_destroy(void* arg) {
+  static_cast<T*>(arg)->~T();
+}
+
+// Construct a T in funcctx's multi_call_memory_ctx, which must be current so
+// that the T's PgConsulAllocators use it too, and make it funcctx's
+// user_fctx.  The T is destroyed when the context is reset or deleted: after
+// the last row, when the scan is stopped early (e.g. by a LIMIT), or on error
+// or cancellation.
+template <typename T>
+T*
+pg_consul_fctx_new(FuncCallContext* funcctx) {
+  void* p = MemoryContextAlloc(funcctx->multi_call_memory_ctx, sizeof(PgConsulFctx<T>));
+  auto holder = new (p) PgConsulFctx<T>();
+  holder->callback.func = pg_consul_fctx_destroy<T>;
+  holder->callback.arg = &holder->fctx;
+  MemoryContextRegisterResetCallback(funcctx->multi_call_memory_ctx, &holder->callback);
+  funcctx->user_fctx = &holder->fctx;
+  return &holder->fctx;
+}
+
 // ---- pg_consul-specific structs
 
+// The KV pairs of a response, stored in the function's memory context
+using PgConsulKVPairsView = ::consul::BasicKVPairsView<PgConsulAllocator<::consul::KVPairView>>;
+
+struct ConsulInstrumentation;
+
 // consul_kv_get() function context
 struct ConsulGetFctx {
-  ::consul::KVPairs kvps;
-  ::consul::KVPairs::KVPairsT::size_type iter = 0;
+  PgConsulKVPairsView kvps;
+  PgConsulKVPairsView::KVPairsT::size_type iter = 0;
+  uint32 columns = 0; // Bitmask of the output columns the query references
+  ConsulInstrumentation* instr = nullptr;
+};
+
+// State for pg_consul_kv_get_columns_walker()
+struct ConsulKVColumnsCtx {
+  Query* query;       // Query being planned
+  Bitmapset* rtis;    // Range table indexes of its consul_kv_get() scans
+  Oid funcid;
+  int sublevelsUp;
+  uint32 columns;
+};
+
+// Endpoints of the consul HTTP API used by the extension
+enum class Endpoint : char { AGENT_SELF, KV, STATUS_LEADER, STATUS_PEERS };
+static const constexpr std::size_t PG_CONSUL_NUM_ENDPOINTS = 4;
+
+// One of the GETs in flight for a pg_consul_get() call
+struct ConsulAttempt {
+  ::consul::AgentPool::SizeT agent;
+  ::consul::AgentPool::ClockT::time_point start;
+  long timeoutMs;
+  bool done = false;
+  cpr::Session session;
 };
 
+// Thrown out of pg_consul_get() when servicing an interrupt raised an error,
+// e.g. because the query was cancelled.  It isn't a std::exception so it
+// passes through the handlers that turn those into SQL errors, and is raised
+// again with ReThrowError() once the request's C++ objects are destroyed.
+struct PgConsulInterrupt {
+  ErrorData* edata;
+};
+
+// An ERROR found while C++ objects are in scope.  ereport() would longjmp
+// past their destructors, so it is thrown instead, caught where the scope
+// ends and raised with pg_consul_raise().  message is palloc'd.
+struct PgConsulError {
+  int sqlerrcode;
+  char* message;
+  bool getErrdetail; // add pg_consul_get_errdetail()
+};
+
+// What a backend is waiting on while it waits for consul, reported as a wait
+// event in pg_stat_activity.  CONNECT covers name resolution and the TCP and
+// TLS handshakes, RESPONSE the time from sending the request to the first
+// byte of the response, and RECEIVE the rest of the response.  PROBE is a
+// synchronous health check of an agent.
+enum class ConsulWait : char { CONNECT, RESPONSE, RECEIVE, PROBE };
+static const constexpr std::size_t PG_CONSUL_NUM_WAITS = 4;
+
+// Reports a consul wait event for as long as it is in scope
+class PgConsulWaitEvent final {
+public:
+  explicit PgConsulWaitEvent(ConsulWait wait);
+  ~PgConsulWaitEvent() { pgstat_report_wait_end(); }
+  PgConsulWaitEvent(const PgConsulWaitEvent&) = delete;
+  PgConsulWaitEvent& operator=(const PgConsulWaitEvent&) = delete;
+};
+
+// Target type of the value column for the typed consul_kv_get_*() functions
+enum class KVValueType : char { BOOL, INT8, JSONB };
+
 // consul_status_peers() function context
 struct ConsulPeersFctx {
   ::consul::Peers peers;
   ::consul::Peers::PeersT::size_type iter = 0;
 };
 
+// RFC 1123 says names must be shorter than 255.
+static const constexpr auto RFC1123_NAME_LIMIT = 255;
+
+enum class BreakerState : char { CLOSED, OPEN, HALF_OPEN };
+
+// Circuit breaker for one agent.  A breaker opens after
+// consul.breaker_threshold consecutive transport failures, and requests to
+// the agent then fail immediately.  After consul.breaker_reset_timeout the
+// next request is let through as a probe (half-open): success closes the
+// breaker, failure opens it again.
+struct ConsulBreaker {
+  char host[RFC1123_NAME_LIMIT + 1];
+  consul::Agent::PortT port;
+  BreakerState state;
+  uint32 consecutiveFailures;
+  int probePid;
+  TimestampTz probeStartedAt;
+  TimestampTz openedAt;
+  TimestampTz retryAt;
+  TimestampTz lastUsedAt;
+  uint64 successes;
+  uint64 failures;
+  uint64 rejections;
+  uint64 trips;
+};
+
+// Recent latency of each endpoint of one agent, and the timeout last chosen
+// for it by consul.adaptive_timeout (0 if none yet).
+struct ConsulAgentLatency {
+  ::consul::LatencyHistogram endpoints[PG_CONSUL_NUM_ENDPOINTS];
+  uint32 timeoutMs[PG_CONSUL_NUM_ENDPOINTS];
+};
+
+// Counters of the requests made to an endpoint
+struct ConsulEndpointStats {
+  uint64 requests;
+  uint64 failures;
+  uint64 bytesReceived; // headers and body as sent, i.e. compressed
+  uint64 bytesDecoded;  // headers and decoded body
+};
+
+// ConsulEndpointStats as kept in PgConsulSharedState, updated without a lock
+struct ConsulEndpointCounters {
+  pg_atomic_uint64 requests;
+  pg_atomic_uint64 failures;
+  pg_atomic_uint64 bytesReceived;
+  pg_atomic_uint64 bytesDecoded;
+};
+
+// Consul work done by a backend, statement or plan node
+struct ConsulQueryCounters {
+  uint64 calls;         // consul requests, i.e. pg_consul_get()s
+  uint64 requests;      // HTTP requests, including hedges and failovers
+  uint64 failures;
+  uint64 bytesReceived;
+  uint64 bytesDecoded;
+  uint64 connReused;    // HTTP requests sent over a cached connection
+  uint64 timeUs;        // time spent waiting for consul
+
+  void add(const ConsulQueryCounters& c) noexcept {
+    calls += c.calls;
+    requests += c.requests;
+    failures += c.failures;
+    bytesReceived += c.bytesReceived;
+    bytesDecoded += c.bytesDecoded;
+    connReused += c.connReused;
+    timeUs += c.timeUs;
+  }
+
+  // The work done since these counters were before
+  ConsulQueryCounters since(const ConsulQueryCounters& before) const noexcept {
+    return ConsulQueryCounters{calls - before.calls, requests - before.requests, failures - before.failures,
+                               bytesReceived - before.bytesReceived, bytesDecoded - before.bytesDecoded,
+                               connReused - before.connReused, timeUs - before.timeUs};
+  }
+};
+
+// Consul work of the statements with a query id, keyed like
+// pg_stat_statements
+struct ConsulQueryStats {
+  Oid userid;
+  Oid dbid;
+  uint64 queryId;       // 0 if the slot is free
+  TimestampTz lastUsedAt;
+  ConsulQueryCounters counters;
+};
+
+// Consul work of the calls made by one consul_kv_get() expression of a plan,
+// shown by EXPLAIN ANALYZE
+struct ConsulInstrumentation {
+  const Node* expr;
+  bool timing;          // parse and decode times are measured
+  ConsulQueryCounters counters;
+  uint64 parseNs;
+  uint64 decodeNs;
+};
+
+// The consul_kv_get() expressions of an instrumented executor, allocated in
+// its per-query memory context and unlinked from pgConsulExplainStates when
+// that is deleted.
+struct ConsulExplainState {
+  MemoryContext queryContext;
+  bool timing;
+  List* instrumentation; // of ConsulInstrumentation
+  MemoryContextCallback callback;
+  ConsulExplainState* next;
+};
+
+// State for pg_consul_explain_walker(): the work of a plan node's
+// consul_kv_get() expressions
+struct ConsulExplainCtx {
+  const ConsulExplainState* state;
+  ConsulInstrumentation total;
+  bool found;
+};
+
+// Maximum number of agents tracked in PgConsulSharedState.  An agent is
+// looked for in the PG_CONSUL_AGENT_PROBES slots following its hash, and
+// takes over the least recently used healthy one of them if it isn't there.
+static const constexpr int PG_CONSUL_MAX_AGENTS = 64;
+static const constexpr int PG_CONSUL_AGENT_PROBES = 8;
+
+// Maximum number of statements tracked in PgConsulSharedState.  A statement
+// is looked for in the PG_CONSUL_QUERY_PROBES slots following its hash, and
+// evicts the least recently used of them if it isn't there.
+static const constexpr int PG_CONSUL_MAX_QUERIES = 1024;
+static const constexpr int PG_CONSUL_QUERY_PROBES = 8;
+
+// Number of requests kept by pg_consul_recent_requests(), and the longest key
+// and datacenter recorded for them
+static const constexpr int PG_CONSUL_RECENT_REQUESTS = 1024;
+static const constexpr int PG_CONSUL_RECENT_KEY_LEN = 128;
+static const constexpr int PG_CONSUL_RECENT_DC_LEN = 64;
+static const constexpr int PG_CONSUL_RECENT_IP_LEN = 46; // INET6_ADDRSTRLEN
+
+// One HTTP request made to an agent.  Phase times are curl's, in
+// microseconds since the request started, or -1 if unknown.
+struct ConsulRecentRequest {
+  TimestampTz startedAt;
+  int pid;
+  Endpoint endpoint;
+  long status;          // 0 if the agent didn't answer
+  uint64 bytesReceived;
+  uint64 bytesDecoded;
+  int32 dnsUs;
+  int32 connectUs;
+  int32 tlsUs;
+  int32 firstByteUs;
+  int32 totalUs;
+  int port;
+  char ip[PG_CONSUL_RECENT_IP_LEN];
+  char key[PG_CONSUL_RECENT_KEY_LEN];   // truncated, NUL terminated
+  char dc[PG_CONSUL_RECENT_DC_LEN];     // URL encoded, "" for the default
+};
+
+// A slot of the recent requests ring.  seq is 2 * position + 1 while the
+// request at that position is being written, and 2 * position + 2 once it
+// has been, so readers can tell a complete request from a torn one without
+// taking a lock.  Writers claim a slot by moving seq from even to odd, so
+// two writers PG_CONSUL_RECENT_REQUESTS positions apart never write the same
+// slot at once.
+struct ConsulRecentSlot {
+  pg_atomic_uint64 seq;
+  ConsulRecentRequest request;
+};
+
+// An agent's breaker and latencies in PgConsulSharedState.  mutex protects
+// both.  The agent a slot belongs to only changes with the lock held
+// exclusively as well, so it can be read under either.
+struct ConsulAgentSlot {
+  slock_t mutex;
+  ConsulBreaker breaker;
+  ConsulAgentLatency latency;
+};
+
+// A statement in PgConsulSharedState, protected like ConsulAgentSlot
+struct ConsulQuerySlot {
+  slock_t mutex;
+  ConsulQueryStats stats;
+};
+
+// State shared by all backends when pg_consul is in
+// shared_preload_libraries, otherwise private to each backend.  Requests only
+// take the mutex of the slots they update; the lock is taken exclusively to
+// give a slot to another agent or statement, and shared to read every slot.
+struct PgConsulSharedState {
+  LWLock* lock; // nullptr if backend-local
+  ConsulAgentSlot agents[PG_CONSUL_MAX_AGENTS];
+  ConsulEndpointCounters stats[PG_CONSUL_NUM_ENDPOINTS];
+  ConsulQuerySlot queries[PG_CONSUL_MAX_QUERIES];
+  // The last PG_CONSUL_RECENT_REQUESTS requests, written without the lock
+  pg_atomic_uint64 recentNext; // position of the next request
+  ConsulRecentSlot recent[PG_CONSUL_RECENT_REQUESTS];
+};
+
+// consul_circuit_breakers() function context
+struct ConsulBreakersFctx {
+  PgConsulVector<ConsulBreaker> breakers;
+  PgConsulVector<ConsulBreaker>::size_type iter = 0;
+};
+
+// pg_stat_consul() function context
+struct ConsulStatFctx {
+  ConsulEndpointStats stats[PG_CONSUL_NUM_ENDPOINTS];
+  std::size_t iter = 0;
+};
+
+// pg_stat_consul_statements() function context
+struct ConsulStatementsFctx {
+  PgConsulVector<ConsulQueryStats> queries;
+  PgConsulVector<ConsulQueryStats>::size_type iter = 0;
+};
+
+// pg_consul_recent_requests() function context
+struct ConsulRecentRequestsFctx {
+  PgConsulVector<ConsulRecentRequest> requests;
+  PgConsulVector<ConsulRecentRequest>::size_type iter = 0;
+};
+
+// One row of consul_agent_timeouts()
+struct ConsulAgentTimeout {
+  ConsulBreaker agent;
+  Endpoint endpoint;
+  ::consul::LatencyHistogram::CountT samples;
+  ::consul::LatencyHistogram::LatencyT p50Us;
+  ::consul::LatencyHistogram::LatencyT p99Us;
+  uint32 timeoutMs;
+};
+
+// consul_agent_timeouts() function context
+struct ConsulAgentTimeoutsFctx {
+  PgConsulVector<ConsulAgentTimeout> timeouts;
+  PgConsulVector<ConsulAgentTimeout>::size_type iter = 0;
+};
+
 // ---- Constants
 static const constexpr char PG_CONSUL_AGENT_HOST_DEFAULT[] = "127.0.0.1";
 static const constexpr char PG_CONSUL_AGENT_HOST_LONG_DESCR[] = "Host of the consul agent this API client should use to talk with";
 static const constexpr char PG_CONSUL_AGENT_HOST_SHORT_DESCR[] = "Sets host of the consul agent to talk to.";
+static const constexpr char PG_CONSUL_AGENT_HOSTS_LONG_DESCR[] = "Comma separated list of consul agents (host[:port]) this API client should use.  Requests go to the agent with the best recent latency and error rate and fail over to the others.  Overrides consul.agent_host when set.";
+static const constexpr char PG_CONSUL_AGENT_HOSTS_SHORT_DESCR[] = "Sets the list of consul agents to talk to.";
+static const char PG_CONSUL_AGENT_TLS_LONG_DESCR[] = "Talk to the consul agents over HTTPS.";
+static const char PG_CONSUL_AGENT_TLS_SHORT_DESCR[] = "Use HTTPS to talk to consul agents";
+static const char PG_CONSUL_AGENT_HTTP2_LONG_DESCR[] = "Negotiate HTTP/2 with agents reached over HTTPS, so concurrent requests (e.g. hedged reads) share one connection.";
+static const char PG_CONSUL_AGENT_HTTP2_SHORT_DESCR[] = "Use HTTP/2 with HTTPS consul agents";
+static const char PG_CONSUL_AGENT_COMPRESSION_LONG_DESCR[] = "Ask consul agents to compress responses (Accept-Encoding), which are decoded as they are received.";
+static const char PG_CONSUL_AGENT_COMPRESSION_SHORT_DESCR[] = "Request compressed responses from consul agents";
+static const char PG_CONSUL_JSON_INDEX_LONG_DESCR[] = "Index the strings of KV responses of 64kB or more with SIMD before parsing them.  Only faster for responses with large values.";
+static const char PG_CONSUL_JSON_INDEX_SHORT_DESCR[] = "Index large KV responses before parsing them";
+static const char PG_CONSUL_AGENT_CA_FILE_LONG_DESCR[] = "File of CA certificates used to verify consul agents reached over HTTPS.  Empty uses the system's CA certificates.";
+static const char PG_CONSUL_AGENT_CA_FILE_SHORT_DESCR[] = "Sets the CA certificates that verify consul agents";
+static const char PG_CONSUL_AGENT_CERT_FILE_LONG_DESCR[] = "Client certificate presented to consul agents reached over HTTPS.  Empty presents no certificate.";
+static const char PG_CONSUL_AGENT_CERT_FILE_SHORT_DESCR[] = "Sets the client certificate presented to consul agents";
+static const char PG_CONSUL_AGENT_KEY_FILE_LONG_DESCR[] = "Private key of consul.agent_cert_file.";
+static const char PG_CONSUL_AGENT_KEY_FILE_SHORT_DESCR[] = "Sets the private key of the client certificate";
+static const char PG_CONSUL_AGENT_CONNECT_TIMEOUT_LONG_DESCR[] = "Timeout (ms) for establishing a connection to a consul agent.  0 uses consul.agent_timeout.";
+static const char PG_CONSUL_AGENT_CONNECT_TIMEOUT_SHORT_DESCR[] = "Timeout (ms) for connecting to a consul agent";
+// Timeout (ms) used when probing an ejected agent before it is used again
+static const constexpr long PG_CONSUL_AGENT_PROBE_TIMEOUT_MS = 100;
+static const char PG_CONSUL_HEDGE_PERCENTILE_LONG_DESCR[] = "Percentile of recent request latency after which a read is duplicated to a second agent, and whichever answers first is used.  0 disables hedged requests.";
+static const char PG_CONSUL_HEDGE_PERCENTILE_SHORT_DESCR[] = "Latency percentile after which reads are hedged";
+static const constexpr double PG_CONSUL_HEDGE_PERCENTILE_MAX = 99.9;
+// Requests to an endpoint that must be timed before its latency is used to
+// hedge reads or adapt timeouts
+static const constexpr ::consul::LatencyHistogram::CountT PG_CONSUL_LATENCY_MIN_SAMPLES = 20;
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_LONG_DESCR[] = "Derive the timeout of each request from the recent latency of the agent and endpoint: the consul.adaptive_timeout_percentile latency times consul.adaptive_timeout_factor, no shorter than consul.adaptive_timeout_min and no longer than consul.agent_timeout.";
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_SHORT_DESCR[] = "Adapt request timeouts to observed latency";
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_LONG_DESCR[] = "Percentile of recent request latency that adaptive timeouts are derived from.";
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_SHORT_DESCR[] = "Latency percentile adaptive timeouts are derived from";
+static const constexpr double PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_DEFAULT = 99.0;
+static const constexpr double PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_MIN = 50.0;
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_LONG_DESCR[] = "Multiple of the consul.adaptive_timeout_percentile latency a request may take before it times out.";
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_SHORT_DESCR[] = "Multiple of observed latency used as the adaptive timeout";
+static const constexpr double PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_DEFAULT = 3.0;
+static const constexpr double PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_MIN = 1.0;
+static const constexpr double PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_MAX = 100.0;
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_LONG_DESCR[] = "Shortest timeout (ms) consul.adaptive_timeout may choose.";
+static const char PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_SHORT_DESCR[] = "Lower bound (ms) of adaptive timeouts";
+static const constexpr int PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_DEFAULT = 50;
+static const char PG_CONSUL_BREAKER_THRESHOLD_LONG_DESCR[] = "Number of consecutive failed requests to an agent after which its circuit breaker opens and requests to it fail immediately.  0 disables circuit breakers.";
+static const char PG_CONSUL_BREAKER_THRESHOLD_SHORT_DESCR[] = "Consecutive failures that open an agent's circuit breaker";
+static const constexpr int PG_CONSUL_BREAKER_THRESHOLD_DEFAULT = 5;
+static const constexpr int PG_CONSUL_BREAKER_THRESHOLD_MAX = 1000;
+static const char PG_CONSUL_BREAKER_RESET_TIMEOUT_LONG_DESCR[] = "Time (ms) an open circuit breaker waits before letting a single probe request through to the agent.";
+static const char PG_CONSUL_BREAKER_RESET_TIMEOUT_SHORT_DESCR[] = "Time (ms) before an open circuit breaker is probed";
+static const constexpr int PG_CONSUL_BREAKER_RESET_TIMEOUT_DEFAULT = 10 * 1000;
+static const constexpr int PG_CONSUL_BREAKER_RESET_TIMEOUT_MAX = 60 * 60 * 1000;
+static const constexpr char PG_CONSUL_SHMEM_NAME[] = "pg_consul";
+
+// Upper bound (ms) on each wait for network activity, which bounds how long
+// an interrupt (e.g. statement cancellation) goes unnoticed.
+static const constexpr long PG_CONSUL_POLL_INTERVAL_MS = 10;
 static const constexpr consul::Agent::PortT PG_CONSUL_AGENT_PORT_DEFAULT = consul::Agent::DEFAULT_PORT;
 static const constexpr char PG_CONSUL_AGENT_PORT_LONG_DESCR[] = "Port number of the consul agent this API client should use to talk with";
 static const constexpr char PG_CONSUL_AGENT_PORT_SHORT_DESCR[] = "Port number used by the agent for consul RPC requests.";
 static const char PG_CONSUL_AGENT_TIMEOUT_LONG_DESCR[] = "Timeout (ms) used when communicating with consul agent.";
 static const char PG_CONSUL_AGENT_TIMEOUT_SHORT_DESCR[] = "Timeout (ms) for communicating with consul agent";
-
-// RFC 1123 says names must be shorter than 255.
-static const constexpr auto RFC1123_NAME_LIMIT = 255;
+static const char PG_CONSUL_MAX_STALE_LONG_DESCR[] = "Maximum time (ms) since the answering server last heard from the leader for a stale read to be accepted.  Staler responses are retried against the leader.  0 accepts any stale response.";
+static const char PG_CONSUL_MAX_STALE_SHORT_DESCR[] = "Maximum staleness (ms) of a stale read";
+static const constexpr int PG_CONSUL_MAX_STALE_MS_MAX = 24 * 60 * 60 * 1000;
+static const char PG_CONSUL_READ_CONSISTENCY_LONG_DESCR[] = "Consistency mode used for reads: default forwards reads to the leader, stale allows any consul server to answer and consistent makes the leader verify its leadership first.";
+static const char PG_CONSUL_READ_CONSISTENCY_SHORT_DESCR[] = "Sets the consistency mode of consul reads.";
+
+static const struct config_enum_entry PG_CONSUL_READ_CONSISTENCY_OPTIONS[] = {
+  { "default",    static_cast<int>(consul::Agent::ConsistencyT::DEFAULT),    false },
+  { "stale",      static_cast<int>(consul::Agent::ConsistencyT::STALE),      false },
+  { "consistent", static_cast<int>(consul::Agent::ConsistencyT::CONSISTENT), false },
+  { nullptr, 0, false }
+};
 
 // -- consul_peers() SETOF column constants
 static const constexpr int PG_CONSUL_PEERS1_COLUMN_HOST   = 0;
@@ -96,6 +597,7 @@ static const constexpr int PG_CONSUL_PEERS1_NUM_COLUMNS   = 3;
 static const constexpr int PG_CONSUL_KV1_GET_IN_KEY_POS       = 0;
 static const constexpr int PG_CONSUL_KV1_GET_IN_RECURSE_POS   = 1;
 static const constexpr int PG_CONSUL_KV1_GET_IN_CLUSTER_POS   = 2;
+static const constexpr int PG_CONSUL_KV1_GET_IN_COLUMNS_POS   = 3;
 static const constexpr int PG_CONSUL_KV1_GET_COUMN_KEY        = 0;
 static const constexpr int PG_CONSUL_KV1_GET_COUMN_VALUE      = 1;
 static const constexpr int PG_CONSUL_KV1_GET_COUMN_FLAGS      = 2;
@@ -104,16 +606,134 @@ static const constexpr int PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX = 4;
 static const constexpr int PG_CONSUL_KV1_GET_COUMN_LOCK_IDX   = 5;
 static const constexpr int PG_CONSUL_KV1_GET_COUMN_SESSION    = 6;
 static const constexpr int PG_CONSUL_KV1_GET_NUM_COLUMNS      = 7;
+static const constexpr uint32 PG_CONSUL_KV1_GET_ALL_COLUMNS   = (1u << PG_CONSUL_KV1_GET_NUM_COLUMNS) - 1;
+
+// -- consul_circuit_breakers() SETOF column constants
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_HOST         = 0;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_PORT         = 1;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_STATE        = 2;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_CONSEC_FAILS = 3;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_SUCCESSES    = 4;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_FAILURES     = 5;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_REJECTIONS   = 6;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_TRIPS        = 7;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_OPENED_AT    = 8;
+static const constexpr int PG_CONSUL_BREAKERS1_COLUMN_RETRY_AT     = 9;
+static const constexpr int PG_CONSUL_BREAKERS1_NUM_COLUMNS         = 10;
+
+// -- consul_agent_timeouts() SETOF column constants
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_HOST       = 0;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_PORT       = 1;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_ENDPOINT   = 2;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_SAMPLES    = 3;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_P50_MS     = 4;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_P99_MS     = 5;
+static const constexpr int PG_CONSUL_TIMEOUTS1_COLUMN_TIMEOUT_MS = 6;
+static const constexpr int PG_CONSUL_TIMEOUTS1_NUM_COLUMNS       = 7;
+
+// -- pg_stat_consul() SETOF column constants
+static const constexpr int PG_CONSUL_STAT1_COLUMN_ENDPOINT       = 0;
+static const constexpr int PG_CONSUL_STAT1_COLUMN_REQUESTS       = 1;
+static const constexpr int PG_CONSUL_STAT1_COLUMN_FAILURES       = 2;
+static const constexpr int PG_CONSUL_STAT1_COLUMN_BYTES_RECEIVED = 3;
+static const constexpr int PG_CONSUL_STAT1_COLUMN_BYTES_DECODED  = 4;
+static const constexpr int PG_CONSUL_STAT1_NUM_COLUMNS           = 5;
+
+// -- pg_stat_consul_statements() SETOF column constants
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_USERID         = 0;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_DBID           = 1;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_QUERYID        = 2;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_CALLS          = 3;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_REQUESTS       = 4;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_FAILURES       = 5;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_TOTAL_TIME     = 6;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_BYTES_RECEIVED = 7;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_BYTES_DECODED  = 8;
+static const constexpr int PG_CONSUL_STATEMENTS1_COLUMN_CONN_REUSED    = 9;
+static const constexpr int PG_CONSUL_STATEMENTS1_NUM_COLUMNS           = 10;
+
+// -- pg_consul_recent_requests() SETOF column constants
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_STARTED_AT     = 0;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_PID            = 1;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_ENDPOINT       = 2;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_KEY            = 3;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_DC             = 4;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_HOST           = 5;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_PORT           = 6;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_STATUS         = 7;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_BYTES_RECEIVED = 8;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_BYTES_DECODED  = 9;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_DNS_MS         = 10;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_CONNECT_MS     = 11;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_TLS_MS         = 12;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_FIRST_BYTE_MS  = 13;
+static const constexpr int PG_CONSUL_RECENT1_COLUMN_TOTAL_MS       = 14;
+static const constexpr int PG_CONSUL_RECENT1_NUM_COLUMNS           = 15;
+
+// -- consul_kv_get_{bool,int8,jsonb}() SETOF column constants
+static const constexpr int PG_CONSUL_KV1_GET_TYPED_COLUMN_KEY   = 0;
+static const constexpr int PG_CONSUL_KV1_GET_TYPED_COLUMN_VALUE = 1;
+static const constexpr int PG_CONSUL_KV1_GET_TYPED_COLUMN_ERROR = 2;
+static const constexpr int PG_CONSUL_KV1_GET_TYPED_NUM_COLUMNS  = 3;
 
 // ---- GUC variables
 
 // NOTE: this variable still needs to be defined even though the
 // authoritative value is contained within pgConsulAgent.
 static char* pg_consul_agent_host_string = nullptr;
+static char* pg_consul_agent_hosts_string = nullptr;
 static int pg_consul_agent_port = consul::Agent::DEFAULT_PORT;
 static int pg_consul_agent_timeout_ms = 0;
+static int pg_consul_agent_connect_timeout_ms = 0;
+static bool pg_consul_agent_tls = false;
+static bool pg_consul_agent_http2 = true;
+static bool pg_consul_agent_compression = true;
+static bool pg_consul_json_index = false;
+static char* pg_consul_agent_ca_file = nullptr;
+static char* pg_consul_agent_cert_file = nullptr;
+static char* pg_consul_agent_key_file = nullptr;
+static int pg_consul_max_stale_ms = 0;
+static int pg_consul_read_consistency = static_cast<int>(consul::Agent::ConsistencyT::DEFAULT);
+static double pg_consul_hedge_percentile = 0.0;
+static int pg_consul_breaker_threshold = PG_CONSUL_BREAKER_THRESHOLD_DEFAULT;
+static int pg_consul_breaker_reset_timeout_ms = PG_CONSUL_BREAKER_RESET_TIMEOUT_DEFAULT;
+static bool pg_consul_adaptive_timeout = false;
+static double pg_consul_adaptive_timeout_percentile = PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_DEFAULT;
+static double pg_consul_adaptive_timeout_factor = PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_DEFAULT;
+static int pg_consul_adaptive_timeout_min_ms = PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_DEFAULT;
 static ::consul::Agent pgConsulAgent;
 
+// Agents requests are sent to.  Rebuilt from consul.agent_hosts, or
+// pgConsulAgent if consul.agent_hosts is empty, whenever an agent GUC
+// changes.
+static ::consul::AgentPool pgConsulAgentPool;
+static bool pgConsulAgentPoolValid = false;
+
+// Recent latency of each endpoint, used to decide when to hedge a request.
+static ::consul::LatencyHistogram pgConsulLatency[PG_CONSUL_NUM_ENDPOINTS];
+
+// Executors being instrumented, e.g. by EXPLAIN ANALYZE
+static ConsulExplainState* pgConsulExplainStates = nullptr;
+
+// ---- Shared state
+static PgConsulSharedState* pgConsulShared = nullptr;
+static PgConsulSharedState pgConsulLocalState;
+
+// Consul work done by this backend.  The work of a statement or plan node is
+// the difference across its calls.
+static ConsulQueryCounters pgConsulBackendCounters;
+// Why the last pg_consul_get() failed without an answer from an agent
+enum class GetFailure : char { NONE, BREAKER_OPEN, DEADLINE };
+static GetFailure pgConsulGetFailure = GetFailure::NONE;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = nullptr;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = nullptr;
+#if PG_VERSION_NUM >= 180000
+static ExecutorStart_hook_type prev_ExecutorStart_hook = nullptr;
+static explain_per_node_hook_type prev_explain_per_node_hook = nullptr;
+#endif
+
 // ---- Function declarations
 static       void  pg_consul_agent_host_assign_hook(const char *newvalue, void *extra);
 static       bool  pg_consul_agent_host_check_hook(const char *newval);
@@ -124,6 +744,60 @@ static const char* pg_consul_agent_port_show_hook(void);
 static const char* pg_consul_agent_timeout_show_hook(void);
 static       void  pg_consul_agent_timeout_assign_hook(int newvalue, void *extra);
 static const char* pg_consul_agent_timeout_show_hook(void);
+static       void  pg_consul_agent_hosts_assign_hook(const char *newvalue, void *extra);
+static       void  pg_consul_agent_tls_assign_hook(bool newvalue, void *extra);
+static       bool  pg_consul_agent_hosts_check_hook(char **newval, void **extra, GucSource source);
+static       void  pg_consul_shmem_request(void);
+static       void  pg_consul_shmem_startup(void);
+static PgConsulSharedState* pg_consul_state(void);
+static       void  pg_consul_state_init(PgConsulSharedState* state);
+static       void  pg_consul_recent_record(Endpoint endpoint, const consul::KVPair::KeyT& key, const cpr::Parameters& params, const cpr::Response& r, CURL* curl, long elapsedUs);
+static ConsulAgentSlot* pg_consul_agent_slot(PgConsulSharedState* state, const consul::Agent& agent, TimestampTz now);
+#if PG_VERSION_NUM >= 140000
+static ConsulQuerySlot* pg_consul_query_slot(PgConsulSharedState* state, Oid userid, Oid dbid, uint64 queryId);
+#endif
+static       bool  pg_consul_breaker_allow(const consul::Agent& agent);
+static       void  pg_consul_breaker_release(const consul::Agent& agent);
+static       void  pg_consul_agent_record(const consul::Agent& agent, Endpoint endpoint, bool success, long latencyUs);
+static       long  pg_consul_agent_timeout(const consul::Agent& agent, Endpoint endpoint);
+static       void  pg_consul_stats_record(Endpoint endpoint, const cpr::Response& r, bool connReused);
+static       void  pg_consul_query_stats_record(const ConsulQueryCounters& counters);
+static       int   pg_consul_get_errdetail(void);
+[[noreturn]] static void pg_consul_raise(const PgConsulError& error);
+static consul::AgentPool::ClockT::time_point pg_consul_deadline(void);
+static       long  pg_consul_timeout_ms(consul::AgentPool::ClockT::time_point deadline, long timeoutMs);
+static       long  pg_consul_connect_timeout_ms(long timeoutMs);
+static const char* pg_consul_breaker_state_str(BreakerState state);
+static const char* pg_consul_endpoint_str(Endpoint endpoint);
+static const char* pg_consul_wait_str(ConsulWait wait);
+static uint32 pg_consul_wait_event_info(ConsulWait wait);
+static ConsulWait pg_consul_attempts_wait(const std::vector<std::unique_ptr<ConsulAttempt>>& attempts);
+static consul::AgentPool& pg_consul_agent_pool(void);
+static cpr::Share& pg_consul_share(void);
+static consul::JsonAllocator pg_consul_json_allocator(void);
+static cpr::SslOptions pg_consul_ssl_options(void);
+static cpr::HttpVersion pg_consul_http_version(void);
+static consul::Agent::UrlT pg_consul_endpoint_url(consul::Agent& agent, Endpoint endpoint, const consul::KVPair::KeyT& key);
+static std::chrono::microseconds pg_consul_hedge_delay(Endpoint endpoint);
+static ErrorData* pg_consul_process_interrupts(void);
+static cpr::Response pg_consul_get_multi(Endpoint endpoint, const consul::KVPair::KeyT& key, const cpr::Parameters& params, consul::AgentPool::ClockT::time_point deadline);
+static cpr::Response pg_consul_get(Endpoint endpoint, const consul::KVPair::KeyT& key = consul::KVPair::KeyT(), const cpr::Parameters& params = cpr::Parameters());
+static cpr::Response pg_consul_read(const consul::KVPair::KeyT& key, const cpr::Parameters& params, const char* fname);
+static       bool  pg_consul_kv_get_fetch(FunctionCallInfo fcinfo, const char* fname, PgConsulKVPairsView& kvps, ConsulInstrumentation* instr);
+static ::consul::KVPairView::ViewT pg_consul_kv_value(const ::consul::KVPairView& kvp, ConsulInstrumentation* instr);
+static ConsulInstrumentation* pg_consul_instrumentation(FunctionCallInfo fcinfo);
+#if PG_VERSION_NUM >= 180000
+static       void  pg_consul_explain_state_destroy(void* arg);
+static const ConsulExplainState* pg_consul_explain_state(MemoryContext queryContext);
+static       bool  pg_consul_explain_walker(Node* node, ConsulExplainCtx* ctx);
+static       void  pg_consul_executor_start(QueryDesc* queryDesc, int eflags);
+static       void  pg_consul_explain_per_node(PlanState* planstate, List* ancestors, const char* relationship, const char* plan_name, ExplainState* es);
+#endif
+static       Datum pg_consul_text_datum(const ::consul::KVPairView::ViewT& str);
+static       bool  pg_consul_kv_get_columns(Query* query, Oid funcid, uint32& columns);
+static       bool  pg_consul_kv_get_columns_walker(Node* node, ConsulKVColumnsCtx* ctx);
+static       Datum pg_consul_kv_get_typed(FunctionCallInfo fcinfo, const char* fname, KVValueType valueType);
+static       bool  pg_consul_kv_value_to_datum(const ::consul::KVPairView::ViewT& value, KVValueType valueType, Datum& datum, std::string& err);
 } // anon-namespace
 
 extern "C" {
@@ -149,6 +823,17 @@ _PG_init(void)
                              pg_consul_agent_host_assign_hook,
                              pg_consul_agent_host_show_hook);
 
+  DefineCustomStringVariable("consul.agent_hosts",
+                             PG_CONSUL_AGENT_HOSTS_SHORT_DESCR,
+                             PG_CONSUL_AGENT_HOSTS_LONG_DESCR,
+                             &pg_consul_agent_hosts_string,
+                             "",
+                             PGC_USERSET,
+                             GUC_LIST_INPUT | GUC_NOT_WHILE_SEC_REST,
+                             pg_consul_agent_hosts_check_hook,
+                             pg_consul_agent_hosts_assign_hook,
+                             nullptr);
+
   DefineCustomIntVariable("consul.agent_port",
                           PG_CONSUL_AGENT_PORT_SHORT_DESCR,
                           PG_CONSUL_AGENT_PORT_LONG_DESCR,
@@ -175,7 +860,237 @@ _PG_init(void)
                           pg_consul_agent_timeout_assign_hook,
                           pg_consul_agent_timeout_show_hook);
 
+  DefineCustomIntVariable("consul.agent_connect_timeout",
+                          PG_CONSUL_AGENT_CONNECT_TIMEOUT_SHORT_DESCR,
+                          PG_CONSUL_AGENT_CONNECT_TIMEOUT_LONG_DESCR,
+                          &pg_consul_agent_connect_timeout_ms,
+                          0,
+                          0,
+                          consul::Agent::DEFAULT_TIMEOUT_MS_MAX,
+                          PGC_USERSET,
+                          GUC_UNIT_MS | GUC_NOT_WHILE_SEC_REST,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
+  DefineCustomBoolVariable("consul.agent_tls",
+                           PG_CONSUL_AGENT_TLS_SHORT_DESCR,
+                           PG_CONSUL_AGENT_TLS_LONG_DESCR,
+                           &pg_consul_agent_tls,
+                           false,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           pg_consul_agent_tls_assign_hook,
+                           nullptr);
+
+  DefineCustomBoolVariable("consul.agent_http2",
+                           PG_CONSUL_AGENT_HTTP2_SHORT_DESCR,
+                           PG_CONSUL_AGENT_HTTP2_LONG_DESCR,
+                           &pg_consul_agent_http2,
+                           true,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomBoolVariable("consul.agent_compression",
+                           PG_CONSUL_AGENT_COMPRESSION_SHORT_DESCR,
+                           PG_CONSUL_AGENT_COMPRESSION_LONG_DESCR,
+                           &pg_consul_agent_compression,
+                           true,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomBoolVariable("consul.json_index",
+                           PG_CONSUL_JSON_INDEX_SHORT_DESCR,
+                           PG_CONSUL_JSON_INDEX_LONG_DESCR,
+                           &pg_consul_json_index,
+                           false,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  // Paths to files on the server, so only superusers may change them.
+  DefineCustomStringVariable("consul.agent_ca_file",
+                             PG_CONSUL_AGENT_CA_FILE_SHORT_DESCR,
+                             PG_CONSUL_AGENT_CA_FILE_LONG_DESCR,
+                             &pg_consul_agent_ca_file,
+                             "",
+                             PGC_SUSET,
+                             GUC_NOT_WHILE_SEC_REST,
+                             nullptr,
+                             nullptr,
+                             nullptr);
+
+  DefineCustomStringVariable("consul.agent_cert_file",
+                             PG_CONSUL_AGENT_CERT_FILE_SHORT_DESCR,
+                             PG_CONSUL_AGENT_CERT_FILE_LONG_DESCR,
+                             &pg_consul_agent_cert_file,
+                             "",
+                             PGC_SUSET,
+                             GUC_NOT_WHILE_SEC_REST,
+                             nullptr,
+                             nullptr,
+                             nullptr);
+
+  DefineCustomStringVariable("consul.agent_key_file",
+                             PG_CONSUL_AGENT_KEY_FILE_SHORT_DESCR,
+                             PG_CONSUL_AGENT_KEY_FILE_LONG_DESCR,
+                             &pg_consul_agent_key_file,
+                             "",
+                             PGC_SUSET,
+                             GUC_NOT_WHILE_SEC_REST,
+                             nullptr,
+                             nullptr,
+                             nullptr);
+
+  DefineCustomEnumVariable("consul.read_consistency",
+                           PG_CONSUL_READ_CONSISTENCY_SHORT_DESCR,
+                           PG_CONSUL_READ_CONSISTENCY_LONG_DESCR,
+                           &pg_consul_read_consistency,
+                           static_cast<int>(consul::Agent::ConsistencyT::DEFAULT),
+                           PG_CONSUL_READ_CONSISTENCY_OPTIONS,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomIntVariable("consul.max_stale",
+                          PG_CONSUL_MAX_STALE_SHORT_DESCR,
+                          PG_CONSUL_MAX_STALE_LONG_DESCR,
+                          &pg_consul_max_stale_ms,
+                          0,
+                          0,
+                          PG_CONSUL_MAX_STALE_MS_MAX,
+                          PGC_USERSET,
+                          GUC_UNIT_MS | GUC_NOT_WHILE_SEC_REST,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
+  DefineCustomRealVariable("consul.hedge_percentile",
+                           PG_CONSUL_HEDGE_PERCENTILE_SHORT_DESCR,
+                           PG_CONSUL_HEDGE_PERCENTILE_LONG_DESCR,
+                           &pg_consul_hedge_percentile,
+                           0.0,
+                           0.0,
+                           PG_CONSUL_HEDGE_PERCENTILE_MAX,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomIntVariable("consul.breaker_threshold",
+                          PG_CONSUL_BREAKER_THRESHOLD_SHORT_DESCR,
+                          PG_CONSUL_BREAKER_THRESHOLD_LONG_DESCR,
+                          &pg_consul_breaker_threshold,
+                          PG_CONSUL_BREAKER_THRESHOLD_DEFAULT,
+                          0,
+                          PG_CONSUL_BREAKER_THRESHOLD_MAX,
+                          PGC_USERSET,
+                          GUC_NOT_WHILE_SEC_REST,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
+  DefineCustomIntVariable("consul.breaker_reset_timeout",
+                          PG_CONSUL_BREAKER_RESET_TIMEOUT_SHORT_DESCR,
+                          PG_CONSUL_BREAKER_RESET_TIMEOUT_LONG_DESCR,
+                          &pg_consul_breaker_reset_timeout_ms,
+                          PG_CONSUL_BREAKER_RESET_TIMEOUT_DEFAULT,
+                          1,
+                          PG_CONSUL_BREAKER_RESET_TIMEOUT_MAX,
+                          PGC_USERSET,
+                          GUC_UNIT_MS | GUC_NOT_WHILE_SEC_REST,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
+  DefineCustomBoolVariable("consul.adaptive_timeout",
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_SHORT_DESCR,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_LONG_DESCR,
+                           &pg_consul_adaptive_timeout,
+                           false,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomRealVariable("consul.adaptive_timeout_percentile",
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_SHORT_DESCR,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_LONG_DESCR,
+                           &pg_consul_adaptive_timeout_percentile,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_DEFAULT,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_PERCENTILE_MIN,
+                           PG_CONSUL_HEDGE_PERCENTILE_MAX,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomRealVariable("consul.adaptive_timeout_factor",
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_SHORT_DESCR,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_LONG_DESCR,
+                           &pg_consul_adaptive_timeout_factor,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_DEFAULT,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_MIN,
+                           PG_CONSUL_ADAPTIVE_TIMEOUT_FACTOR_MAX,
+                           PGC_USERSET,
+                           GUC_NOT_WHILE_SEC_REST,
+                           nullptr,
+                           nullptr,
+                           nullptr);
+
+  DefineCustomIntVariable("consul.adaptive_timeout_min",
+                          PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_SHORT_DESCR,
+                          PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_LONG_DESCR,
+                          &pg_consul_adaptive_timeout_min_ms,
+                          PG_CONSUL_ADAPTIVE_TIMEOUT_MIN_DEFAULT,
+                          consul::Agent::DEFAULT_TIMEOUT_MS_MIN,
+                          consul::Agent::DEFAULT_TIMEOUT_MS_MAX,
+                          PGC_USERSET,
+                          GUC_UNIT_MS | GUC_NOT_WHILE_SEC_REST,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
   EmitWarningsOnPlaceholders("consul");
+
+  pg_consul_state_init(&pgConsulLocalState);
+
+  // Circuit breakers and latencies are shared between backends only if the
+  // library is preloaded, otherwise each backend keeps its own (see
+  // pg_consul_state()).
+  if (process_shared_preload_libraries_in_progress) {
+#if PG_VERSION_NUM >= 150000
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = pg_consul_shmem_request;
+#else
+    pg_consul_shmem_request();
+#endif
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = pg_consul_shmem_startup;
+  }
+
+  // EXPLAIN ANALYZE shows the consul work of each plan node.  Executors that
+  // started before the library was loaded aren't instrumented.
+#if PG_VERSION_NUM >= 180000
+  prev_ExecutorStart_hook = ExecutorStart_hook;
+  ExecutorStart_hook = pg_consul_executor_start;
+  prev_explain_per_node_hook = explain_per_node_hook;
+  explain_per_node_hook = pg_consul_explain_per_node;
+#endif
 }
 
 
@@ -186,24 +1101,34 @@ void
 _PG_fini(void)
 {
   // Uninstall hooks.
+#if PG_VERSION_NUM >= 150000
+  shmem_request_hook = prev_shmem_request_hook;
+#endif
+  shmem_startup_hook = prev_shmem_startup_hook;
+#if PG_VERSION_NUM >= 180000
+  ExecutorStart_hook = prev_ExecutorStart_hook;
+  explain_per_node_hook = prev_explain_per_node_hook;
+#endif
 }
 
 
 Datum
 pg_consul_v1_agent_ping0(PG_FUNCTION_ARGS) {
+  ErrorData* interrupt = nullptr;
   try {
-    auto selfUrl = pgConsulAgent.selfUrl();
-    auto r = cpr::Get(cpr::Url{selfUrl},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{pgConsulAgent.timeoutMs()});
+    auto r = pg_consul_get(Endpoint::AGENT_SELF);
     if (r.status_code == 200) {
       return true;
     } else {
       return false;
     }
+  } catch (const PgConsulInterrupt& e) {
+    interrupt = e.edata;
   } catch (std::exception & e) {
     return false;
   }
+
+  ReThrowError(interrupt);
 }
 
 
@@ -213,12 +1138,26 @@ pg_consul_v1_agent_ping2(PG_FUNCTION_ARGS) {
     consul::Agent::HostT host{VARDATA(PG_GETARG_TEXT_P(0))};
     consul::Agent::PortT port = PG_GETARG_INT32(1); // FIXME(seanc@): int32_t -> uint16_t narrowing
     consul::Agent localAgent{host, port};
+    localAgent.setTls(pg_consul_agent_tls);
 
     const auto selfUrl = localAgent.selfUrl();
-    const auto timeout = localAgent.timeoutMs();
+    const auto timeout = pg_consul_timeout_ms(pg_consul_deadline(), localAgent.timeoutMs());
+    if (timeout == 0) {
+      return false;
+    }
+
+    const auto before = pgConsulBackendCounters;
+    PgConsulWaitEvent wait{ConsulWait::PROBE};
     auto r = cpr::Get(cpr::Url{selfUrl},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{timeout});
+                      pg_consul_share(),
+                      pg_consul_ssl_options(),
+                      pg_consul_http_version(),
+                      cpr::Timeout{timeout},
+                      cpr::ConnectTimeout{pg_consul_connect_timeout_ms(timeout)});
+    pg_consul_stats_record(Endpoint::AGENT_SELF, r, false);
+    pgConsulBackendCounters.calls++;
+    pgConsulBackendCounters.timeUs += static_cast<uint64>(r.elapsed * 1000000.0);
+    pg_consul_query_stats_record(pgConsulBackendCounters.since(before));
     if (r.status_code == 200) {
       return true;
     } else {
@@ -235,9 +1174,7 @@ pg_consul_v1_agent_ping2(PG_FUNCTION_ARGS) {
 Datum
 pg_consul_v1_kv_get(PG_FUNCTION_ARGS) {
   MemoryContext oldcontext;
-  void* fctx_p;
   TupleDesc tupdesc;
-  AttInMetadata *attinmeta;
   ConsulGetFctx *fctx;
   FuncCallContext *funcctx;
   uint32 call_cntr;
@@ -257,106 +1194,34 @@ pg_consul_v1_kv_get(PG_FUNCTION_ARGS) {
                errmsg("function returning record called in context "
                       "that cannot accept type record")));
 
-    // generate attribute metadata needed later to produce tuples from raw C
-    // strings
-    attinmeta = TupleDescGetAttInMetadata(tupdesc);
-    funcctx->attinmeta = attinmeta;
-
-    // allocate memory for user context.  Use emlacement new operator.
-    fctx_p = static_cast<ConsulGetFctx *>(palloc(sizeof(ConsulGetFctx)));
+    // Rows are formed directly from the response buffer as Datums, so bless
+    // the descriptor instead of generating AttInMetadata.
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
     /*
      * Use fctx to keep track of KVPair entries from call to call.  The first
      * call returns the entire list, then every subsequent call iterates
-     * through the list.
+     * through the list.  It is destroyed along with multi_call_memory_ctx,
+     * however the scan ends.
      */
-    ConsulGetFctx* fctx = new(fctx_p) ConsulGetFctx();
-
-    // WARNING(seanc@): it is exceedingly important to destruct the object
-    // explicitly: fctx->~ConsulGetFctx(); Pulling this off requires a bit
-    // of manual accountancy.  If the query is cancelled while returning
-    // rows, this will leak because the destructor is *ONLY* called when
-    // call_cntr == max_calls.
-    funcctx->user_fctx = fctx;
+    fctx = pg_consul_fctx_new<ConsulGetFctx>(funcctx);
+    fctx->instr = pg_consul_instrumentation(fcinfo);
 
     // Populate KVPairs via cpr
-    try {
-      consul::KVPair::KeyT key;
-      if (PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_KEY_POS)) {
-        PG_RETURN_NULL();
-      } else {
-        text *keyp = PG_GETARG_TEXT_P(PG_CONSUL_KV1_GET_IN_KEY_POS);
-        key.assign(VARDATA(keyp), VARSIZE(keyp) - VARHDRSZ);
-      }
-
-      bool recurseParam = false;
-      if (!PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_RECURSE_POS))
-        recurseParam = PG_GETARG_BOOL(PG_CONSUL_KV1_GET_IN_RECURSE_POS);
-
-      consul::Agent::ClusterT dcParam;
-      if (!PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_CLUSTER_POS)) {
-        text *clusterp = PG_GETARG_TEXT_P(PG_CONSUL_KV1_GET_IN_CLUSTER_POS);
-        dcParam.assign(VARDATA(clusterp), VARSIZE(clusterp) - VARHDRSZ);
-      }
-
-      const consul::KVPair::IndexT casParam = 0;
-      const consul::KVPair::SessionT acquireParam;
-      const consul::KVPair::FlagsT flagsParam = 0;
-
-      auto params = cpr::Parameters();
-      if (!dcParam.empty()) {
-        params.AddParameter({"dc", dcParam});
-      }
-
-      if (recurseParam) {
-        params.AddParameter({"recurse", ""});
-      }
-
-      if (casParam) {
-        params.AddParameter({"cas", consul::KVPair::IndexStr(casParam)});
-      }
-
-      if (flagsParam) {
-        params.AddParameter({"flags", consul::KVPair::FlagsStr(flagsParam)});
-      }
-
-      if (!acquireParam.empty()) {
-        params.AddParameter({"acquire", acquireParam});
-      }
-
-      // Make a call to get the current leader
-      auto kvUrl = pgConsulAgent.kvUrl(key);
-      auto r = cpr::Get(cpr::Url{kvUrl},
-                        cpr::Header{{"Connection", "close"}},
-                        cpr::Timeout{pgConsulAgent.timeoutMs()},
-                        params);
-      if (r.status_code != 200) {
-        ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
-                 errmsg("consul_kv_get() returned error %ld", r.status_code)));
-      }
-
-      consul::KVPairs kvps;
-      std::string err;
-      if (!::consul::KVPairs::InitFromJson(fctx->kvps, r.text, err)) {
-        ereport(ERROR, (errcode(ERRCODE_FDW_REPLY_HANDLE),
-                        errmsg("Failed to load KV pairs from JSON: %s: %s", err.c_str(), r.text.c_str())));
-      }
-
-      if (!recurseParam && fctx->kvps.size() > 1) {
-        ereport(ERROR,
-                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-                 errmsg("consul_kv_get() performed a non-recursive GET but received %lu responses", fctx->kvps.size())));
-      }
+    if (!pg_consul_kv_get_fetch(fcinfo, "consul_kv_get", fctx->kvps, fctx->instr)) {
+      PG_RETURN_NULL();
+    }
 
-      // Set the max calls
-      funcctx->max_calls = fctx->kvps.objs().size();
-    } catch (std::exception & e) {
-      ereport(ERROR,
-              (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-               errmsg("consul_kv_get() failed: %s", std::string(e.what()).c_str())));
+    // The columns argument is only passed to the overload that
+    // pg_consul_v1_kv_get_support() substitutes for the original call.
+    fctx->columns = PG_CONSUL_KV1_GET_ALL_COLUMNS;
+    if (PG_NARGS() > PG_CONSUL_KV1_GET_IN_COLUMNS_POS && !PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_COLUMNS_POS)) {
+      fctx->columns = static_cast<uint32>(PG_GETARG_INT32(PG_CONSUL_KV1_GET_IN_COLUMNS_POS));
     }
 
+    // Set the max calls
+    funcctx->max_calls = fctx->kvps.objs().size();
+
     MemoryContextSwitchTo(oldcontext);
   }
 
@@ -365,76 +1230,122 @@ pg_consul_v1_kv_get(PG_FUNCTION_ARGS) {
 
   call_cntr = funcctx->call_cntr;
   max_calls = funcctx->max_calls;
-  attinmeta = funcctx->attinmeta;
   fctx = static_cast<ConsulGetFctx*>(funcctx->user_fctx);
 
   if (call_cntr < max_calls) { // do when there is more left to send
-    char       **values;
-    HeapTuple    tuple;
-    Datum        result;
+    Datum values[PG_CONSUL_KV1_GET_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_KV1_GET_NUM_COLUMNS];
+    memset(values, 0, sizeof(values));
+
+    // Columns the query never reads are returned as NULL so that, in
+    // particular, values are never base64 decoded or copied.
+    for (int i = 0; i < PG_CONSUL_KV1_GET_NUM_COLUMNS; i++) {
+      nulls[i] = ((fctx->columns & (1u << i)) == 0);
+    }
 
-    // Snag a reference to the KVPair we're going to send back
+    // Snag a reference to the KVPair we're going to send back.  Its fields
+    // point into the response buffer and are copied once, into the tuple.
     const auto& objs = fctx->kvps.objs();
     const auto& kvp = objs[fctx->iter];
     fctx->iter++;
 
-    // Prepare a values array for building the returned tuple.  This should
-    // be an array of C strings which will be processed later by the type
-    // input functions.
-    values = static_cast<char **>(palloc(PG_CONSUL_KV1_GET_NUM_COLUMNS * sizeof(char *)));
-    // PG_CONSUL_KV1_GET_COUMN_KEY == key (TEXT)
-    values[PG_CONSUL_KV1_GET_COUMN_KEY] = static_cast<char *>(palloc(kvp.key().size() + 1));
-    kvp.key().copy(values[PG_CONSUL_KV1_GET_COUMN_KEY], kvp.key().size());
-    values[PG_CONSUL_KV1_GET_COUMN_KEY][kvp.key().size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_VALUE == value (BYTEA)
-    values[PG_CONSUL_KV1_GET_COUMN_VALUE] = static_cast<char *>(palloc(kvp.value().size() + 1));
-    kvp.value().copy(values[PG_CONSUL_KV1_GET_COUMN_VALUE], kvp.value().size());
-    values[PG_CONSUL_KV1_GET_COUMN_VALUE][kvp.value().size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_FLAGS == flags (INT)
-    const auto flagsStr = kvp.flagsStr();
-    values[PG_CONSUL_KV1_GET_COUMN_FLAGS] = static_cast<char *>(palloc(flagsStr.size() + 1));
-    flagsStr.copy(values[PG_CONSUL_KV1_GET_COUMN_FLAGS], flagsStr.size());
-    values[PG_CONSUL_KV1_GET_COUMN_FLAGS][flagsStr.size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_CREATE_IDX == create_index (INT8)
-    const auto createIndexStr = kvp.createIndexStr();
-    values[PG_CONSUL_KV1_GET_COUMN_CREATE_IDX] = static_cast<char *>(palloc(createIndexStr.size() + 1));
-    createIndexStr.copy(values[PG_CONSUL_KV1_GET_COUMN_CREATE_IDX], createIndexStr.size());
-    values[PG_CONSUL_KV1_GET_COUMN_CREATE_IDX][createIndexStr.size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_LOCK_IDX == lock_index (INT8)
-    const auto lockIndexStr = kvp.lockIndexStr();
-    values[PG_CONSUL_KV1_GET_COUMN_LOCK_IDX] = static_cast<char *>(palloc(lockIndexStr.size() + 1));
-    lockIndexStr.copy(values[PG_CONSUL_KV1_GET_COUMN_LOCK_IDX], lockIndexStr.size());
-    values[PG_CONSUL_KV1_GET_COUMN_LOCK_IDX][lockIndexStr.size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX == modify_index (INT8)
-    const auto modifyIndexStr = kvp.modifyIndexStr();
-    values[PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX] = static_cast<char *>(palloc(modifyIndexStr.size() + 1));
-    modifyIndexStr.copy(values[PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX], modifyIndexStr.size());
-    values[PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX][modifyIndexStr.size()] = '\0';
-    // PG_CONSUL_KV1_GET_COUMN_SESSION == session (TEXT)
-    values[PG_CONSUL_KV1_GET_COUMN_SESSION] = static_cast<char *>(palloc(kvp.session().size() + 1));
-    kvp.session().copy(values[PG_CONSUL_KV1_GET_COUMN_SESSION], kvp.session().size());
-    values[PG_CONSUL_KV1_GET_COUMN_SESSION][kvp.session().size()] = '\0';
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_KEY])
+      values[PG_CONSUL_KV1_GET_COUMN_KEY] = pg_consul_text_datum(kvp.key());
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_VALUE])
+      values[PG_CONSUL_KV1_GET_COUMN_VALUE] = pg_consul_text_datum(pg_consul_kv_value(kvp, fctx->instr));
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_FLAGS])
+      values[PG_CONSUL_KV1_GET_COUMN_FLAGS] = Int64GetDatum(static_cast<int64>(kvp.flags()));
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_CREATE_IDX])
+      values[PG_CONSUL_KV1_GET_COUMN_CREATE_IDX] = Int64GetDatum(static_cast<int64>(kvp.createIndex()));
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX])
+      values[PG_CONSUL_KV1_GET_COUMN_MODIFY_IDX] = Int64GetDatum(static_cast<int64>(kvp.modifyIndex()));
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_LOCK_IDX])
+      values[PG_CONSUL_KV1_GET_COUMN_LOCK_IDX] = Int64GetDatum(static_cast<int64>(kvp.lockIndex()));
+    if (!nulls[PG_CONSUL_KV1_GET_COUMN_SESSION])
+      values[PG_CONSUL_KV1_GET_COUMN_SESSION] = pg_consul_text_datum(kvp.session());
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    PG_CONSUL_PROBE(row_emit, call_cntr, kvp.key().size(), tuple->t_len);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    // Do when there is no more left; fctx is destroyed with
+    // multi_call_memory_ctx
+    SRF_RETURN_DONE(funcctx);
+  }
+}
 
-    /* build a tuple */
-    tuple = BuildTupleFromCStrings(attinmeta, values);
 
-    /* make the tuple into a datum */
-    result = HeapTupleGetDatum(tuple);
 
-    /* clean up (this is not really necessary) */
-    for (auto i = 0; i < PG_CONSUL_KV1_GET_NUM_COLUMNS; ++i) {
-      pfree(values[i]);
-    }
+/*
+ * Planner support function for consul_kv_get().  When the query only
+ * references some of the output columns, the call is replaced with the
+ * consul_kv_get(key, recurse, cluster, columns) overload so the remaining
+ * columns, most importantly the base64 encoded value, are never decoded or
+ * copied.  The overload has no support function, so it isn't rewritten
+ * again.
+ */
+Datum
+pg_consul_v1_kv_get_support(PG_FUNCTION_ARGS) {
+  Node* rawreq = reinterpret_cast<Node*>(PG_GETARG_POINTER(0));
+  if (!IsA(rawreq, SupportRequestSimplify)) {
+    PG_RETURN_POINTER(nullptr);
+  }
 
-    SRF_RETURN_NEXT(funcctx, result);
-  } else {
-    // Do when there is no more left
-    fctx->~ConsulGetFctx();
-    SRF_RETURN_DONE(funcctx);
+  auto req = reinterpret_cast<SupportRequestSimplify*>(rawreq);
+  if (req->root == nullptr || req->root->parse == nullptr) {
+    PG_RETURN_POINTER(nullptr);
   }
+
+  FuncExpr* fcall = req->fcall;
+  uint32 columns;
+  if (!pg_consul_kv_get_columns(req->root->parse, fcall->funcid, columns) ||
+      columns == PG_CONSUL_KV1_GET_ALL_COLUMNS) {
+    PG_RETURN_POINTER(nullptr);
+  }
+
+  // Look up the overload next to the original function
+  const Oid argtypes[] = { TEXTOID, BOOLOID, TEXTOID, INT4OID };
+  List* name = list_make2(makeString(get_namespace_name(get_func_namespace(fcall->funcid))),
+                          makeString(get_func_name(fcall->funcid)));
+  const Oid projected = LookupFuncName(name, lengthof(argtypes), argtypes, true);
+  if (!OidIsValid(projected)) {
+    PG_RETURN_POINTER(nullptr);
+  }
+
+  Const* mask = makeConst(INT4OID, -1, InvalidOid, sizeof(int32),
+                          Int32GetDatum(static_cast<int32>(columns)), false, true);
+  FuncExpr* newcall = makeFuncExpr(projected, fcall->funcresulttype,
+                                   lappend(list_copy(fcall->args), mask),
+                                   fcall->funccollid, fcall->inputcollid,
+                                   COERCE_EXPLICIT_CALL);
+  newcall->funcretset = fcall->funcretset;
+  newcall->location = fcall->location;
+  PG_RETURN_POINTER(newcall);
+}
+
+
+/*
+ * Typed variants of consul_kv_get().  The decoded value is converted
+ * directly into a Datum of the target type.  Values that fail conversion are
+ * returned as NULL with the reason in the error column.
+ */
+Datum
+pg_consul_v1_kv_get_bool(PG_FUNCTION_ARGS) {
+  return pg_consul_kv_get_typed(fcinfo, "consul_kv_get_bool", KVValueType::BOOL);
+}
+
+
+Datum
+pg_consul_v1_kv_get_int8(PG_FUNCTION_ARGS) {
+  return pg_consul_kv_get_typed(fcinfo, "consul_kv_get_int8", KVValueType::INT8);
 }
 
 
+Datum
+pg_consul_v1_kv_get_jsonb(PG_FUNCTION_ARGS) {
+  return pg_consul_kv_get_typed(fcinfo, "consul_kv_get_jsonb", KVValueType::JSONB);
+}
+
 
 /*
  * Obtain the current leader of the Raft quorum
@@ -442,16 +1353,13 @@ pg_consul_v1_kv_get(PG_FUNCTION_ARGS) {
 Datum
 pg_consul_v1_status_leader(PG_FUNCTION_ARGS)
 {
-  using json11::Json;
-
+  ErrorData* interrupt = nullptr;
+  PgConsulError error{};
   try {
-    auto r = cpr::Get(cpr::Url{pgConsulAgent.statusLeaderUrl()},
-                      cpr::Header{{"Connection", "close"}},
-                      cpr::Timeout{pgConsulAgent.timeoutMs()});
+    auto r = pg_consul_get(Endpoint::STATUS_LEADER);
     if (r.status_code != 200) {
-      ereport(ERROR,
-              (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
-               errmsg("consul_status_leader() returned error %ld", r.status_code)));
+      throw PgConsulError{ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION,
+                          psprintf("consul_status_leader() returned error %ld", r.status_code), true};
     }
 
     if (r.text.size() == 0) {
@@ -460,24 +1368,31 @@ pg_consul_v1_status_leader(PG_FUNCTION_ARGS)
 
     consul::Peer leader;
     std::string err;
-    if (!::consul::Peer::InitFromJson(leader, r.text, err)) {
-      ereport(ERROR, (errcode(ERRCODE_FDW_REPLY_HANDLE),
-                      errmsg("Failed to load leader from JSON: %s", err.c_str())));
+    if (!::consul::Peer::InitFromJson(leader, r.text, err, pg_consul_json_allocator())) {
+      throw PgConsulError{ERRCODE_FDW_REPLY_HANDLE,
+                          psprintf("Failed to load leader from JSON: %s", err.c_str()), false};
     }
 
     PG_RETURN_TEXT_P(cstring_to_text(leader.str().c_str()));
+  } catch (const PgConsulInterrupt& e) {
+    interrupt = e.edata;
+  } catch (const PgConsulError& e) {
+    error = e;
   } catch (std::exception & e) {
-    ereport(ERROR,
-            (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-             errmsg("consul_status_leader() failed: %s", std::string(e.what()).c_str())));
+    error = PgConsulError{ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE,
+                          psprintf("consul_status_leader() failed: %s", e.what()), false};
   }
+
+  if (interrupt != nullptr) {
+    ReThrowError(interrupt);
+  }
+  pg_consul_raise(error);
 }
 
 
 Datum
 pg_consul_v1_status_peers(PG_FUNCTION_ARGS) {
   MemoryContext oldcontext;
-  void* fctx_p;
   TupleDesc tupdesc;
   AttInMetadata *attinmeta;
   ConsulPeersFctx *fctx;
@@ -504,55 +1419,41 @@ pg_consul_v1_status_peers(PG_FUNCTION_ARGS) {
     attinmeta = TupleDescGetAttInMetadata(tupdesc);
     funcctx->attinmeta = attinmeta;
 
-    // allocate memory for user context.  Use emlacement new operator.
-    fctx_p = static_cast<ConsulPeersFctx *>(palloc(sizeof(ConsulPeersFctx)));
-
     /*
      * Use fctx to keep track of peers list from call to call.  The first
      * call returns the entire list, then every subsequent call iterates
-     * through the list.
+     * through the list.  It is destroyed along with multi_call_memory_ctx.
      */
-    ConsulPeersFctx* fctx = new(fctx_p) ConsulPeersFctx();
-
-    // WARNING(seanc@): it is exceedingly important to destruct the object
-    // explicitly: fctx->~ConsulPeersFctx(); Pulling this off requires a bit
-    // of manual accountancy.  If the query is cancelled while returning
-    // rows, this will leak because the destructor is *ONLY* called when
-    // call_cntr == max_calls.
-    funcctx->user_fctx = fctx;
+    fctx = pg_consul_fctx_new<ConsulPeersFctx>(funcctx);
 
     // Populate our peers list via cpr call
+    ErrorData* interrupt = nullptr;
+    PgConsulError error{};
     try {
       // Make a call to get the current leader
-      auto r = cpr::Get(cpr::Url{pgConsulAgent.statusLeaderUrl()},
-                        cpr::Header{{"Connection", "close"}},
-                        cpr::Timeout{pgConsulAgent.timeoutMs()});
+      auto r = pg_consul_get(Endpoint::STATUS_LEADER);
       if (r.status_code != 200) {
-        ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
-                 errmsg("consul_status_leader() returned error %ld", r.status_code)));
+        throw PgConsulError{ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION,
+                            psprintf("consul_status_leader() returned error %ld", r.status_code), true};
       }
 
       consul::Peer leader;
       std::string err;
-      if (!::consul::Peer::InitFromJson(leader, r.text, err)) {
-        ereport(ERROR, (errcode(ERRCODE_FDW_REPLY_HANDLE),
-                        errmsg("Failed to load leader from JSON: %s", err.c_str())));
+      if (!::consul::Peer::InitFromJson(leader, r.text, err, pg_consul_json_allocator())) {
+        throw PgConsulError{ERRCODE_FDW_REPLY_HANDLE,
+                            psprintf("Failed to load leader from JSON: %s", err.c_str()), false};
       }
 
       // Then query the current list of peers
-      r = cpr::Get(cpr::Url{pgConsulAgent.statusPeersUrl()},
-                        cpr::Header{{"Connection", "close"}},
-                   cpr::Timeout{pgConsulAgent.timeoutMs()});
+      r = pg_consul_get(Endpoint::STATUS_PEERS);
       if (r.status_code != 200) {
-        ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
-                 errmsg("consul_status_peers() returned error %ld", r.status_code)));
+        throw PgConsulError{ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION,
+                            psprintf("consul_status_peers() returned error %ld", r.status_code), true};
       }
 
-      if (!::consul::Peers::InitFromJson(fctx->peers, r.text, err)) {
-        ereport(ERROR, (errcode(ERRCODE_FDW_REPLY_HANDLE),
-                        errmsg("Failed to load peers from JSON: %s: %s", err.c_str(), r.text.c_str())));
+      if (!::consul::Peers::InitFromJson(fctx->peers, r.text, err, pg_consul_json_allocator())) {
+        throw PgConsulError{ERRCODE_FDW_REPLY_HANDLE,
+                            psprintf("Failed to load peers from JSON: %s: %s", err.c_str(), r.text.c_str()), false};
       }
 
       // Set the peer who is the leader with the leader bit
@@ -565,10 +1466,20 @@ pg_consul_v1_status_peers(PG_FUNCTION_ARGS) {
 
       // Set the max calls
       funcctx->max_calls = fctx->peers.peers.size();
+    } catch (const PgConsulInterrupt& e) {
+      interrupt = e.edata;
+    } catch (const PgConsulError& e) {
+      error = e;
     } catch (std::exception & e) {
-      ereport(ERROR,
-              (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-               errmsg("consul_status_peers() failed: %s", std::string(e.what()).c_str())));
+      error = PgConsulError{ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE,
+                            psprintf("consul_status_peers() failed: %s", e.what()), false};
+    }
+
+    if (interrupt != nullptr) {
+      ReThrowError(interrupt);
+    }
+    if (error.message != nullptr) {
+      pg_consul_raise(error);
     }
 
     MemoryContextSwitchTo(oldcontext);
@@ -623,29 +1534,2092 @@ pg_consul_v1_status_peers(PG_FUNCTION_ARGS) {
 
     SRF_RETURN_NEXT(funcctx, result);
   } else {
-    // Do when there is no more left
-    fctx->~ConsulPeersFctx();
+    // Do when there is no more left; fctx is destroyed with
+    // multi_call_memory_ctx
     SRF_RETURN_DONE(funcctx);
   }
 }
 
 
-} // extern "C"
-
-namespace {
+/*
+ * Report the state of the circuit breaker of every agent that has been used
+ */
+Datum
+pg_consul_v1_circuit_breakers(PG_FUNCTION_ARGS) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulBreakersFctx *fctx;
+  FuncCallContext *funcctx;
 
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-static void
-pg_consul_agent_host_assign_hook(const char *newHost, void *extra) {
-  // FIXME(seanc@): This is pretty dumb.  By API design we're compelled to
-  // const_cast<> from const char*, but in DefineCustomStringVariable() we
-  // can't pass nullptr for either the assignment when the function pointer
-  // is not null.  If you pass a *_assign_hook() function pointer to
-  // DefineCustom*Variable(), you can only pass a char* as an argument.  It
-  // feels like I'm missing something obvious.
-  pg_consul_agent_host_string = const_cast<char*>(newHost);
-  pgConsulAgent.setHost(newHost);
-}
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulBreakersFctx>(funcctx);
+
+    // Copy the breakers out so the lock isn't held while returning rows
+    auto state = pg_consul_state();
+    if (state->lock != nullptr) {
+      LWLockAcquire(state->lock, LW_SHARED);
+    }
+    for (auto& slot : state->agents) {
+      if (slot.breaker.host[0] == '\0') {
+        continue;
+      }
+
+      SpinLockAcquire(&slot.mutex);
+      const ConsulBreaker breaker = slot.breaker;
+      SpinLockRelease(&slot.mutex);
+      fctx->breakers.push_back(breaker);
+    }
+    if (state->lock != nullptr) {
+      LWLockRelease(state->lock);
+    }
+
+    funcctx->max_calls = fctx->breakers.size();
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulBreakersFctx*>(funcctx->user_fctx);
+
+  if (fctx->iter < fctx->breakers.size()) {
+    const auto& breaker = fctx->breakers[fctx->iter++];
+    Datum values[PG_CONSUL_BREAKERS1_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_BREAKERS1_NUM_COLUMNS];
+    memset(nulls, 0, sizeof(nulls));
+
+    values[PG_CONSUL_BREAKERS1_COLUMN_HOST] = CStringGetTextDatum(breaker.host);
+    values[PG_CONSUL_BREAKERS1_COLUMN_PORT] = Int32GetDatum(breaker.port);
+    values[PG_CONSUL_BREAKERS1_COLUMN_STATE] = CStringGetTextDatum(pg_consul_breaker_state_str(breaker.state));
+    values[PG_CONSUL_BREAKERS1_COLUMN_CONSEC_FAILS] = Int64GetDatum(breaker.consecutiveFailures);
+    values[PG_CONSUL_BREAKERS1_COLUMN_SUCCESSES] = Int64GetDatum(breaker.successes);
+    values[PG_CONSUL_BREAKERS1_COLUMN_FAILURES] = Int64GetDatum(breaker.failures);
+    values[PG_CONSUL_BREAKERS1_COLUMN_REJECTIONS] = Int64GetDatum(breaker.rejections);
+    values[PG_CONSUL_BREAKERS1_COLUMN_TRIPS] = Int64GetDatum(breaker.trips);
+    values[PG_CONSUL_BREAKERS1_COLUMN_OPENED_AT] = TimestampTzGetDatum(breaker.openedAt);
+    nulls[PG_CONSUL_BREAKERS1_COLUMN_OPENED_AT] = (breaker.trips == 0);
+    values[PG_CONSUL_BREAKERS1_COLUMN_RETRY_AT] = TimestampTzGetDatum(breaker.retryAt);
+    nulls[PG_CONSUL_BREAKERS1_COLUMN_RETRY_AT] = (breaker.state != BreakerState::OPEN);
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+/*
+ * Report the number of requests made to each consul endpoint and the bytes
+ * received for them, before and after decompression
+ */
+Datum
+pg_consul_v1_stat(PG_FUNCTION_ARGS) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulStatFctx *fctx;
+  FuncCallContext *funcctx;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulStatFctx>(funcctx);
+
+    auto state = pg_consul_state();
+    for (std::size_t e = 0; e < PG_CONSUL_NUM_ENDPOINTS; ++e) {
+      auto& counters = state->stats[e];
+      fctx->stats[e].requests = pg_atomic_read_u64(&counters.requests);
+      fctx->stats[e].failures = pg_atomic_read_u64(&counters.failures);
+      fctx->stats[e].bytesReceived = pg_atomic_read_u64(&counters.bytesReceived);
+      fctx->stats[e].bytesDecoded = pg_atomic_read_u64(&counters.bytesDecoded);
+    }
+
+    funcctx->max_calls = PG_CONSUL_NUM_ENDPOINTS;
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulStatFctx*>(funcctx->user_fctx);
+
+  if (fctx->iter < PG_CONSUL_NUM_ENDPOINTS) {
+    const auto endpoint = static_cast<Endpoint>(fctx->iter);
+    const auto& stats = fctx->stats[fctx->iter++];
+    Datum values[PG_CONSUL_STAT1_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_STAT1_NUM_COLUMNS];
+    memset(nulls, 0, sizeof(nulls));
+
+    values[PG_CONSUL_STAT1_COLUMN_ENDPOINT] = CStringGetTextDatum(pg_consul_endpoint_str(endpoint));
+    values[PG_CONSUL_STAT1_COLUMN_REQUESTS] = Int64GetDatum(stats.requests);
+    values[PG_CONSUL_STAT1_COLUMN_FAILURES] = Int64GetDatum(stats.failures);
+    values[PG_CONSUL_STAT1_COLUMN_BYTES_RECEIVED] = Int64GetDatum(stats.bytesReceived);
+    values[PG_CONSUL_STAT1_COLUMN_BYTES_DECODED] = Int64GetDatum(stats.bytesDecoded);
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+/*
+ * Report the consul requests made by each statement, by the query id of the
+ * top-level statement as in pg_stat_statements.  Only members of
+ * pg_read_all_stats see other users' statements.
+ */
+Datum
+pg_consul_v1_stat_statements(PG_FUNCTION_ARGS) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulStatementsFctx *fctx;
+  FuncCallContext *funcctx;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulStatementsFctx>(funcctx);
+
+    const Oid userid = GetUserId();
+    const bool readAllStats = has_privs_of_role(userid, ROLE_PG_READ_ALL_STATS);
+    auto state = pg_consul_state();
+    if (state->lock != nullptr) {
+      LWLockAcquire(state->lock, LW_SHARED);
+    }
+    for (auto& slot : state->queries) {
+      if (slot.stats.queryId == 0) {
+        continue;
+      }
+
+      SpinLockAcquire(&slot.mutex);
+      const ConsulQueryStats query = slot.stats;
+      SpinLockRelease(&slot.mutex);
+      if (query.userid != userid && !readAllStats) {
+        continue;
+      }
+      fctx->queries.push_back(query);
+    }
+    if (state->lock != nullptr) {
+      LWLockRelease(state->lock);
+    }
+
+    funcctx->max_calls = fctx->queries.size();
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulStatementsFctx*>(funcctx->user_fctx);
+
+  if (fctx->iter < fctx->queries.size()) {
+    const auto& query = fctx->queries[fctx->iter++];
+    const auto& counters = query.counters;
+    Datum values[PG_CONSUL_STATEMENTS1_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_STATEMENTS1_NUM_COLUMNS];
+    memset(nulls, 0, sizeof(nulls));
+
+    values[PG_CONSUL_STATEMENTS1_COLUMN_USERID] = ObjectIdGetDatum(query.userid);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_DBID] = ObjectIdGetDatum(query.dbid);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_QUERYID] = Int64GetDatum(static_cast<int64>(query.queryId));
+    values[PG_CONSUL_STATEMENTS1_COLUMN_CALLS] = Int64GetDatum(counters.calls);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_REQUESTS] = Int64GetDatum(counters.requests);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_FAILURES] = Int64GetDatum(counters.failures);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_TOTAL_TIME] = Float8GetDatum(counters.timeUs / 1000.0);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_BYTES_RECEIVED] = Int64GetDatum(counters.bytesReceived);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_BYTES_DECODED] = Int64GetDatum(counters.bytesDecoded);
+    values[PG_CONSUL_STATEMENTS1_COLUMN_CONN_REUSED] = Int64GetDatum(counters.connReused);
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+/*
+ * Report the last requests made to consul agents by any backend, oldest
+ * first.  Requests still being recorded, or overwritten while being read,
+ * are skipped.
+ */
+Datum
+pg_consul_v1_recent_requests(PG_FUNCTION_ARGS) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulRecentRequestsFctx *fctx;
+  FuncCallContext *funcctx;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulRecentRequestsFctx>(funcctx);
+    fctx->requests.reserve(PG_CONSUL_RECENT_REQUESTS);
+
+    auto state = pg_consul_state();
+    const uint64 next = pg_atomic_read_u64(&state->recentNext);
+    const uint64 first = (next > PG_CONSUL_RECENT_REQUESTS ? next - PG_CONSUL_RECENT_REQUESTS : 0);
+    for (uint64 pos = first; pos < next; ++pos) {
+      // The slot must hold the complete request at pos both before and after
+      // it is copied
+      auto& slot = state->recent[pos % PG_CONSUL_RECENT_REQUESTS];
+      const uint64 complete = 2 * pos + 2;
+      if (pg_atomic_read_u64(&slot.seq) != complete) {
+        continue;
+      }
+      pg_read_barrier();
+      ConsulRecentRequest req;
+      memcpy(&req, &slot.request, sizeof(req));
+      pg_read_barrier();
+      if (pg_atomic_read_u64(&slot.seq) == complete) {
+        fctx->requests.push_back(req);
+      }
+    }
+
+    funcctx->max_calls = fctx->requests.size();
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulRecentRequestsFctx*>(funcctx->user_fctx);
+
+  if (fctx->iter < fctx->requests.size()) {
+    const auto& req = fctx->requests[fctx->iter++];
+    Datum values[PG_CONSUL_RECENT1_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_RECENT1_NUM_COLUMNS];
+    memset(nulls, 0, sizeof(nulls));
+
+    values[PG_CONSUL_RECENT1_COLUMN_STARTED_AT] = TimestampTzGetDatum(req.startedAt);
+    values[PG_CONSUL_RECENT1_COLUMN_PID] = Int32GetDatum(req.pid);
+    values[PG_CONSUL_RECENT1_COLUMN_ENDPOINT] = CStringGetTextDatum(pg_consul_endpoint_str(req.endpoint));
+    values[PG_CONSUL_RECENT1_COLUMN_KEY] = CStringGetTextDatum(req.key);
+    values[PG_CONSUL_RECENT1_COLUMN_DC] = CStringGetTextDatum(req.dc);
+    nulls[PG_CONSUL_RECENT1_COLUMN_DC] = (req.dc[0] == '\0');
+    values[PG_CONSUL_RECENT1_COLUMN_HOST] = CStringGetTextDatum(req.ip);
+    nulls[PG_CONSUL_RECENT1_COLUMN_HOST] = (req.ip[0] == '\0');
+    values[PG_CONSUL_RECENT1_COLUMN_PORT] = Int32GetDatum(req.port);
+    nulls[PG_CONSUL_RECENT1_COLUMN_PORT] = (req.port == 0);
+    values[PG_CONSUL_RECENT1_COLUMN_STATUS] = Int32GetDatum(static_cast<int32>(req.status));
+    nulls[PG_CONSUL_RECENT1_COLUMN_STATUS] = (req.status == 0);
+    values[PG_CONSUL_RECENT1_COLUMN_BYTES_RECEIVED] = Int64GetDatum(req.bytesReceived);
+    values[PG_CONSUL_RECENT1_COLUMN_BYTES_DECODED] = Int64GetDatum(req.bytesDecoded);
+
+    const std::pair<int, int32> phases[] = {
+      { PG_CONSUL_RECENT1_COLUMN_DNS_MS,        req.dnsUs },
+      { PG_CONSUL_RECENT1_COLUMN_CONNECT_MS,    req.connectUs },
+      { PG_CONSUL_RECENT1_COLUMN_TLS_MS,        req.tlsUs },
+      { PG_CONSUL_RECENT1_COLUMN_FIRST_BYTE_MS, req.firstByteUs },
+      { PG_CONSUL_RECENT1_COLUMN_TOTAL_MS,      req.totalUs },
+    };
+    for (const auto& phase : phases) {
+      values[phase.first] = Float8GetDatum(phase.second / 1000.0);
+      nulls[phase.first] = (phase.second < 0);
+    }
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+/*
+ * Report the recent latency of every agent and endpoint that has been used,
+ * and the timeout last chosen for it by consul.adaptive_timeout
+ */
+Datum
+pg_consul_v1_agent_timeouts(PG_FUNCTION_ARGS) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulAgentTimeoutsFctx *fctx;
+  FuncCallContext *funcctx;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulAgentTimeoutsFctx>(funcctx);
+
+    // Summarize the histograms so the lock isn't held while returning rows
+    auto state = pg_consul_state();
+    if (state->lock != nullptr) {
+      LWLockAcquire(state->lock, LW_SHARED);
+    }
+    for (auto& slot : state->agents) {
+      if (slot.breaker.host[0] == '\0') {
+        continue;
+      }
+
+      SpinLockAcquire(&slot.mutex);
+      const ConsulBreaker agent = slot.breaker;
+      const ConsulAgentLatency latency = slot.latency;
+      SpinLockRelease(&slot.mutex);
+      for (std::size_t e = 0; e < PG_CONSUL_NUM_ENDPOINTS; ++e) {
+        if (latency.endpoints[e].total == 0 && latency.timeoutMs[e] == 0) {
+          continue;
+        }
+
+        ConsulAgentTimeout row;
+        row.agent = agent;
+        row.endpoint = static_cast<Endpoint>(e);
+        row.samples = latency.endpoints[e].total;
+        row.p50Us = latency.endpoints[e].percentile(50.0);
+        row.p99Us = latency.endpoints[e].percentile(99.0);
+        row.timeoutMs = latency.timeoutMs[e];
+        fctx->timeouts.push_back(row);
+      }
+    }
+    if (state->lock != nullptr) {
+      LWLockRelease(state->lock);
+    }
+
+    funcctx->max_calls = fctx->timeouts.size();
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulAgentTimeoutsFctx*>(funcctx->user_fctx);
+
+  if (fctx->iter < fctx->timeouts.size()) {
+    const auto& row = fctx->timeouts[fctx->iter++];
+    Datum values[PG_CONSUL_TIMEOUTS1_NUM_COLUMNS];
+    bool nulls[PG_CONSUL_TIMEOUTS1_NUM_COLUMNS];
+    memset(nulls, 0, sizeof(nulls));
+
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_HOST] = CStringGetTextDatum(row.agent.host);
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_PORT] = Int32GetDatum(row.agent.port);
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_ENDPOINT] = CStringGetTextDatum(pg_consul_endpoint_str(row.endpoint));
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_SAMPLES] = Int64GetDatum(row.samples);
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_P50_MS] = Float8GetDatum(row.p50Us / 1000.0);
+    nulls[PG_CONSUL_TIMEOUTS1_COLUMN_P50_MS] = (row.samples == 0);
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_P99_MS] = Float8GetDatum(row.p99Us / 1000.0);
+    nulls[PG_CONSUL_TIMEOUTS1_COLUMN_P99_MS] = (row.samples == 0);
+    values[PG_CONSUL_TIMEOUTS1_COLUMN_TIMEOUT_MS] = Int32GetDatum(row.timeoutMs);
+    nulls[PG_CONSUL_TIMEOUTS1_COLUMN_TIMEOUT_MS] = (row.timeoutMs == 0);
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+} // extern "C"
+
+namespace {
+
+
+// Reserve shared memory and a lock for the circuit breakers, latencies and
+// statistics
+static void
+pg_consul_shmem_request(void) {
+#if PG_VERSION_NUM >= 150000
+  if (prev_shmem_request_hook) {
+    prev_shmem_request_hook();
+  }
+#endif
+
+  RequestAddinShmemSpace(sizeof(PgConsulSharedState));
+  RequestNamedLWLockTranche(PG_CONSUL_SHMEM_NAME, 1);
+}
+
+
+static void
+pg_consul_shmem_startup(void) {
+  if (prev_shmem_startup_hook) {
+    prev_shmem_startup_hook();
+  }
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  bool found = false;
+  pgConsulShared = static_cast<PgConsulSharedState*>(ShmemInitStruct(PG_CONSUL_SHMEM_NAME, sizeof(PgConsulSharedState), &found));
+  if (!found) {
+    memset(pgConsulShared, 0, sizeof(PgConsulSharedState));
+    pg_consul_state_init(pgConsulShared);
+    pgConsulShared->lock = &(GetNamedLWLockTranche(PG_CONSUL_SHMEM_NAME))->lock;
+  }
+  LWLockRelease(AddinShmemInitLock);
+}
+
+
+// Shared state if pg_consul was preloaded, otherwise this backend's copy
+static PgConsulSharedState*
+pg_consul_state(void) {
+  return (pgConsulShared != nullptr ? pgConsulShared : &pgConsulLocalState);
+}
+
+
+// Initialize the atomics and spinlocks of zeroed state
+static void
+pg_consul_state_init(PgConsulSharedState* state) {
+  for (auto& slot : state->agents) {
+    SpinLockInit(&slot.mutex);
+  }
+  for (auto& counters : state->stats) {
+    pg_atomic_init_u64(&counters.requests, 0);
+    pg_atomic_init_u64(&counters.failures, 0);
+    pg_atomic_init_u64(&counters.bytesReceived, 0);
+    pg_atomic_init_u64(&counters.bytesDecoded, 0);
+  }
+  for (auto& slot : state->queries) {
+    SpinLockInit(&slot.mutex);
+  }
+  pg_atomic_init_u64(&state->recentNext, 0);
+  for (auto& slot : state->recent) {
+    pg_atomic_init_u64(&slot.seq, 0);
+  }
+}
+
+
+// Record a request to an agent in the recent requests ring.  This is on the
+// request path, so it neither allocates nor takes the lock: the position is
+// taken with an atomic increment, and its slot claimed by a compare and
+// exchange of its seq.  The request is dropped if the slot is still being
+// written for an older position, or already taken for a newer one.  curl is
+// the request's handle, for the remote address and phase times.
+static void
+pg_consul_recent_record(Endpoint endpoint, const consul::KVPair::KeyT& key, const cpr::Parameters& params,
+                        const cpr::Response& r, CURL* curl, const long elapsedUs) {
+  auto state = pg_consul_state();
+  const uint64 pos = pg_atomic_fetch_add_u64(&state->recentNext, 1);
+  auto& slot = state->recent[pos % PG_CONSUL_RECENT_REQUESTS];
+  uint64 seq = pg_atomic_read_u64(&slot.seq);
+  if ((seq & 1) != 0 || seq > 2 * pos ||
+      !pg_atomic_compare_exchange_u64(&slot.seq, &seq, 2 * pos + 1)) {
+    return;
+  }
+  // The compare and exchange is a full barrier, so readers see the slot
+  // claimed before any of it changes
+  auto& req = slot.request;
+  req.startedAt = GetCurrentTimestamp() - elapsedUs;
+  req.pid = MyProcPid;
+  req.endpoint = endpoint;
+  req.status = r.status_code;
+  req.bytesReceived = r.header_bytes + r.downloaded_bytes;
+  req.bytesDecoded = r.header_bytes + r.text.size();
+
+  const auto keyLen = std::min(key.size(), static_cast<std::size_t>(PG_CONSUL_RECENT_KEY_LEN - 1));
+  memcpy(req.key, key.data(), keyLen);
+  req.key[keyLen] = '\0';
+
+  // The dc parameter, if any, of "dc=...&recurse=&..."
+  std::size_t dcLen = 0;
+  const auto& content = params.content;
+  for (std::size_t i = 0; i < content.size();) {
+    const auto end = std::min(content.find('&', i), content.size());
+    if (content.compare(i, 3, "dc=") == 0) {
+      dcLen = std::min(end - i - 3, static_cast<std::size_t>(PG_CONSUL_RECENT_DC_LEN - 1));
+      memcpy(req.dc, content.data() + i + 3, dcLen);
+      break;
+    }
+    i = end + 1;
+  }
+  req.dc[dcLen] = '\0';
+
+  // Seconds since the start of the request to the end of each phase
+  auto phaseUs = [curl](const CURLINFO info) {
+    double seconds = 0.0;
+    if (curl_easy_getinfo(curl, info, &seconds) != CURLE_OK) {
+      return static_cast<int32>(-1);
+    }
+    return static_cast<int32>(seconds * 1000000.0);
+  };
+  req.dnsUs = phaseUs(CURLINFO_NAMELOOKUP_TIME);
+  req.connectUs = phaseUs(CURLINFO_CONNECT_TIME);
+  req.tlsUs = phaseUs(CURLINFO_APPCONNECT_TIME);
+  req.firstByteUs = phaseUs(CURLINFO_STARTTRANSFER_TIME);
+  req.totalUs = phaseUs(CURLINFO_TOTAL_TIME);
+
+  char* ip = nullptr;
+  long port = 0;
+  req.ip[0] = '\0';
+  if (curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) == CURLE_OK && ip != nullptr) {
+    strlcpy(req.ip, ip, sizeof(req.ip));
+  }
+  req.port = (curl_easy_getinfo(curl, CURLINFO_PRIMARY_PORT, &port) == CURLE_OK ? static_cast<int>(port) : 0);
+
+  pg_write_barrier();
+  pg_atomic_write_u64(&slot.seq, 2 * pos + 2);
+}
+
+
+// The slot of agent, with its mutex held, claiming one (a free slot or the
+// least recently used healthy one) if it doesn't have one yet.  Returns
+// nullptr if every slot agent may use belongs to an unhealthy agent.  Only
+// claiming a slot takes the lock.
+static ConsulAgentSlot*
+pg_consul_agent_slot(PgConsulSharedState* state, const consul::Agent& agent, TimestampTz now) {
+  if (agent.host().size() > RFC1123_NAME_LIMIT) {
+    return nullptr;
+  }
+
+  const auto hash = std::hash<std::string>{}(agent.host()) ^ agent.port();
+  auto isAgent = [&agent](const ConsulAgentSlot& slot) {
+    return slot.breaker.port == agent.port() && agent.host() == slot.breaker.host;
+  };
+
+  for (int i = 0; i < PG_CONSUL_AGENT_PROBES; ++i) {
+    auto& slot = state->agents[(hash + i) % PG_CONSUL_MAX_AGENTS];
+    SpinLockAcquire(&slot.mutex);
+    if (isAgent(slot)) {
+      return &slot;
+    }
+    SpinLockRelease(&slot.mutex);
+  }
+
+  if (state->lock != nullptr) {
+    LWLockAcquire(state->lock, LW_EXCLUSIVE);
+  }
+
+  // Another backend may have claimed a slot for agent since
+  ConsulAgentSlot* victim = nullptr;
+  TimestampTz victimUsedAt = 0;
+  for (int i = 0; i < PG_CONSUL_AGENT_PROBES; ++i) {
+    auto& slot = state->agents[(hash + i) % PG_CONSUL_MAX_AGENTS];
+    if (isAgent(slot)) {
+      victim = &slot;
+      break;
+    }
+
+    if (slot.breaker.host[0] == '\0') {
+      if (victim == nullptr || victimUsedAt != 0) {
+        victim = &slot;
+        victimUsedAt = 0;
+      }
+      continue;
+    }
+
+    SpinLockAcquire(&slot.mutex);
+    const bool healthy = (slot.breaker.state == BreakerState::CLOSED && slot.breaker.consecutiveFailures == 0);
+    const auto usedAt = slot.breaker.lastUsedAt;
+    SpinLockRelease(&slot.mutex);
+    if (healthy && (victim == nullptr || (victimUsedAt != 0 && usedAt < victimUsedAt))) {
+      victim = &slot;
+      victimUsedAt = usedAt;
+    }
+  }
+
+  if (victim != nullptr) {
+    SpinLockAcquire(&victim->mutex);
+    if (!isAgent(*victim)) {
+      memset(&victim->breaker, 0, sizeof(ConsulBreaker));
+      memset(&victim->latency, 0, sizeof(ConsulAgentLatency));
+      memcpy(victim->breaker.host, agent.host().c_str(), agent.host().size() + 1);
+      victim->breaker.port = agent.port();
+      victim->breaker.state = BreakerState::CLOSED;
+      victim->breaker.lastUsedAt = now;
+    }
+  }
+
+  if (state->lock != nullptr) {
+    LWLockRelease(state->lock);
+  }
+  return victim;
+}
+
+
+// True if a request may be sent to agent.  Requests are rejected while the
+// agent's breaker is open, and while half-open except for the one probe.  A
+// probe that has run for twice consul.agent_timeout is presumed lost and
+// another backend may take over.
+static bool
+pg_consul_breaker_allow(const consul::Agent& agent) {
+  if (pg_consul_breaker_threshold <= 0) {
+    return true;
+  }
+
+  const auto now = GetCurrentTimestamp();
+  const int probeTimeoutMs = 2 * pgConsulAgent.timeoutMs();
+  auto slot = pg_consul_agent_slot(pg_consul_state(), agent, now);
+  if (slot == nullptr) {
+    return true;
+  }
+
+  bool allowed = true;
+  auto breaker = &slot->breaker;
+  breaker->lastUsedAt = now;
+  switch (breaker->state) {
+  case BreakerState::CLOSED:
+    break;
+  case BreakerState::OPEN:
+    if (now >= breaker->retryAt) {
+      breaker->state = BreakerState::HALF_OPEN;
+      breaker->probePid = MyProcPid;
+      breaker->probeStartedAt = now;
+    } else {
+      allowed = false;
+    }
+    break;
+  case BreakerState::HALF_OPEN:
+    if (TimestampDifferenceExceeds(breaker->probeStartedAt, now, probeTimeoutMs)) {
+      breaker->probePid = MyProcPid;
+      breaker->probeStartedAt = now;
+    } else {
+      allowed = false;
+    }
+    break;
+  }
+
+  if (!allowed) {
+    breaker->rejections++;
+  }
+
+  SpinLockRelease(&slot->mutex);
+  return allowed;
+}
+
+
+// Give up the probe of agent's half-open breaker, if this backend holds it,
+// for a request that was allowed but ended without an outcome (it lost a
+// hedge, was interrupted, or was never started).  The breaker reopens ready
+// for the next request to probe, rather than rejecting every request until
+// the probe is presumed lost.
+static void
+pg_consul_breaker_release(const consul::Agent& agent) {
+  if (pg_consul_breaker_threshold <= 0) {
+    return;
+  }
+
+  const auto now = GetCurrentTimestamp();
+  auto slot = pg_consul_agent_slot(pg_consul_state(), agent, now);
+  if (slot == nullptr) {
+    return;
+  }
+
+  auto breaker = &slot->breaker;
+  if (breaker->state == BreakerState::HALF_OPEN && breaker->probePid == MyProcPid) {
+    breaker->state = BreakerState::OPEN;
+    breaker->retryAt = now;
+    breaker->probePid = 0;
+  }
+
+  SpinLockRelease(&slot->mutex);
+}
+
+
+// Record the outcome of a request to endpoint of agent.  Only transport
+// failures count against an agent's breaker; any HTTP response shows it is
+// reachable.  latencyUs, if not negative, is added to the agent's latency
+// for endpoint.
+static void
+pg_consul_agent_record(const consul::Agent& agent, Endpoint endpoint, bool success, long latencyUs) {
+  if (pg_consul_breaker_threshold <= 0 && latencyUs < 0) {
+    return;
+  }
+
+  const auto now = GetCurrentTimestamp();
+  const auto retryAt = TimestampTzPlusMilliseconds(now, pg_consul_breaker_reset_timeout_ms);
+  auto slot = pg_consul_agent_slot(pg_consul_state(), agent, now);
+  if (slot == nullptr) {
+    return;
+  }
+
+  auto breaker = &slot->breaker;
+  if (latencyUs >= 0) {
+    slot->latency.endpoints[static_cast<std::size_t>(endpoint)].record(latencyUs);
+  }
+  if (pg_consul_breaker_threshold > 0) {
+    if (success) {
+      breaker->successes++;
+      breaker->consecutiveFailures = 0;
+      breaker->state = BreakerState::CLOSED;
+      breaker->probePid = 0;
+    } else {
+      breaker->failures++;
+      breaker->consecutiveFailures++;
+      if (breaker->state == BreakerState::HALF_OPEN ||
+          (breaker->state == BreakerState::CLOSED &&
+           breaker->consecutiveFailures >= static_cast<uint32>(pg_consul_breaker_threshold))) {
+        breaker->state = BreakerState::OPEN;
+        breaker->trips++;
+        breaker->openedAt = now;
+        breaker->retryAt = retryAt;
+        breaker->probePid = 0;
+      }
+    }
+  }
+
+  SpinLockRelease(&slot->mutex);
+}
+
+
+// Timeout (ms) for a request to endpoint of agent.  consul.agent_timeout,
+// unless consul.adaptive_timeout is on and the agent has answered enough
+// requests to the endpoint, in which case it is the
+// consul.adaptive_timeout_percentile latency times
+// consul.adaptive_timeout_factor, clamped to [consul.adaptive_timeout_min,
+// consul.agent_timeout].
+static long
+pg_consul_agent_timeout(const consul::Agent& agent, Endpoint endpoint) {
+  const long maxMs = pgConsulAgent.timeoutMs();
+  if (!pg_consul_adaptive_timeout) {
+    return maxMs;
+  }
+
+  auto slot = pg_consul_agent_slot(pg_consul_state(), agent, GetCurrentTimestamp());
+  if (slot == nullptr) {
+    return maxMs;
+  }
+
+  long timeoutMs = maxMs;
+  auto& latency = slot->latency;
+  const auto e = static_cast<std::size_t>(endpoint);
+  if (latency.endpoints[e].total >= PG_CONSUL_LATENCY_MIN_SAMPLES) {
+    const auto us = latency.endpoints[e].percentile(pg_consul_adaptive_timeout_percentile);
+    const auto ms = static_cast<long>(std::ceil(us * pg_consul_adaptive_timeout_factor / 1000.0));
+    timeoutMs = std::min(maxMs, std::max(ms, static_cast<long>(pg_consul_adaptive_timeout_min_ms)));
+  }
+  latency.timeoutMs[e] = static_cast<uint32>(timeoutMs);
+
+  SpinLockRelease(&slot->mutex);
+  return timeoutMs;
+}
+
+
+// Count a request to endpoint in pg_stat_consul and pgConsulBackendCounters
+static void
+pg_consul_stats_record(Endpoint endpoint, const cpr::Response& r, const bool connReused) {
+  auto& counters = pgConsulBackendCounters;
+  counters.requests++;
+  if (r.status_code == 0) {
+    counters.failures++;
+  }
+  counters.bytesReceived += r.header_bytes + r.downloaded_bytes;
+  counters.bytesDecoded += r.header_bytes + r.text.size();
+  if (connReused) {
+    counters.connReused++;
+  }
+
+  auto& stats = pg_consul_state()->stats[static_cast<std::size_t>(endpoint)];
+  pg_atomic_fetch_add_u64(&stats.requests, 1);
+  if (r.status_code == 0) {
+    pg_atomic_fetch_add_u64(&stats.failures, 1);
+  }
+  pg_atomic_fetch_add_u64(&stats.bytesReceived, r.header_bytes + r.downloaded_bytes);
+  pg_atomic_fetch_add_u64(&stats.bytesDecoded, r.header_bytes + r.text.size());
+}
+
+
+#if PG_VERSION_NUM >= 140000
+// The slot of a statement, with its mutex held, taking over the least
+// recently used of the PG_CONSUL_QUERY_PROBES slots following its hash if it
+// doesn't have one yet.  Only that takes the lock.
+static ConsulQuerySlot*
+pg_consul_query_slot(PgConsulSharedState* state, const Oid userid, const Oid dbid, const uint64 queryId) {
+  const auto hash = queryId ^ (static_cast<uint64>(dbid) << 32) ^ userid;
+  auto isQuery = [=](const ConsulQuerySlot& slot) {
+    return slot.stats.queryId == queryId && slot.stats.userid == userid && slot.stats.dbid == dbid;
+  };
+
+  for (int i = 0; i < PG_CONSUL_QUERY_PROBES; ++i) {
+    auto& slot = state->queries[(hash + i) % PG_CONSUL_MAX_QUERIES];
+    SpinLockAcquire(&slot.mutex);
+    if (isQuery(slot)) {
+      return &slot;
+    }
+    SpinLockRelease(&slot.mutex);
+  }
+
+  if (state->lock != nullptr) {
+    LWLockAcquire(state->lock, LW_EXCLUSIVE);
+  }
+
+  // Another backend may have claimed a slot for the statement since
+  ConsulQuerySlot* victim = nullptr;
+  TimestampTz victimUsedAt = 0;
+  for (int i = 0; i < PG_CONSUL_QUERY_PROBES; ++i) {
+    auto& slot = state->queries[(hash + i) % PG_CONSUL_MAX_QUERIES];
+    if (isQuery(slot)) {
+      victim = &slot;
+      break;
+    }
+
+    if (slot.stats.queryId == 0) {
+      if (victim == nullptr || victimUsedAt != 0) {
+        victim = &slot;
+        victimUsedAt = 0;
+      }
+      continue;
+    }
+
+    SpinLockAcquire(&slot.mutex);
+    const auto usedAt = slot.stats.lastUsedAt;
+    SpinLockRelease(&slot.mutex);
+    if (victim == nullptr || (victimUsedAt != 0 && usedAt < victimUsedAt)) {
+      victim = &slot;
+      victimUsedAt = usedAt;
+    }
+  }
+
+  SpinLockAcquire(&victim->mutex);
+  if (!isQuery(*victim)) {
+    victim->stats = ConsulQueryStats{};
+    victim->stats.userid = userid;
+    victim->stats.dbid = dbid;
+    victim->stats.queryId = queryId;
+  }
+
+  if (state->lock != nullptr) {
+    LWLockRelease(state->lock);
+  }
+  return victim;
+}
+#endif
+
+
+// Add the work of a consul call to the current statement in
+// pg_stat_consul_statements.  Statements are identified by the query id of
+// the top-level statement, as in pg_stat_statements, and aren't tracked
+// without one (i.e. with compute_query_id off).
+static void
+pg_consul_query_stats_record(const ConsulQueryCounters& counters) {
+#if PG_VERSION_NUM >= 140000
+  const uint64 queryId = pgstat_get_my_query_id();
+  if (queryId == 0) {
+    return;
+  }
+
+  const auto now = GetCurrentTimestamp();
+  auto slot = pg_consul_query_slot(pg_consul_state(), GetUserId(), MyDatabaseId, queryId);
+  slot->stats.lastUsedAt = now;
+  slot->stats.counters.add(counters);
+  SpinLockRelease(&slot->mutex);
+#else
+  (void)counters;
+#endif
+}
+
+
+// errdetail() for a failed pg_consul_get() that never got an answer because
+// every agent's circuit breaker was open or the statement ran out of time.
+static int
+pg_consul_get_errdetail(void) {
+  switch (pgConsulGetFailure) {
+  case GetFailure::NONE:
+    break;
+  case GetFailure::BREAKER_OPEN:
+    return errdetail("The circuit breaker of every consul agent is open.");
+  case GetFailure::DEADLINE:
+    return errdetail("The statement's remaining time ran out before a consul agent answered.");
+  }
+  return 0;
+}
+
+
+// Raise an ERROR recorded as a PgConsulError
+static void
+pg_consul_raise(const PgConsulError& error) {
+  ereport(ERROR,
+          (errcode(error.sqlerrcode),
+           errmsg("%s", error.message),
+           error.getErrdetail ? pg_consul_get_errdetail() : 0));
+  pg_unreachable();
+}
+
+
+static const char*
+pg_consul_breaker_state_str(BreakerState state) {
+  switch (state) {
+  case BreakerState::CLOSED:    return "closed";
+  case BreakerState::OPEN:      return "open";
+  case BreakerState::HALF_OPEN: return "half_open";
+  }
+  return "unknown";
+}
+
+
+static const char*
+pg_consul_endpoint_str(Endpoint endpoint) {
+  switch (endpoint) {
+  case Endpoint::AGENT_SELF:    return "agent_self";
+  case Endpoint::KV:            return "kv";
+  case Endpoint::STATUS_LEADER: return "status_leader";
+  case Endpoint::STATUS_PEERS:  return "status_peers";
+  }
+  return "unknown";
+}
+
+
+static const char*
+pg_consul_wait_str(ConsulWait wait) {
+  switch (wait) {
+  case ConsulWait::CONNECT:  return "ConsulConnect";
+  case ConsulWait::RESPONSE: return "ConsulResponse";
+  case ConsulWait::RECEIVE:  return "ConsulReceive";
+  case ConsulWait::PROBE:    return "ConsulProbe";
+  }
+  return "ConsulUnknown";
+}
+
+
+// wait_event_info of wait.  PostgreSQL 17 lets extensions name their wait
+// events, which are all registered the first time this backend waits on
+// consul, so that pg_wait_events lists them; older releases report them all
+// as the generic "Extension" event.
+static uint32
+pg_consul_wait_event_info(ConsulWait wait) {
+#if PG_VERSION_NUM >= 170000
+  static uint32 events[PG_CONSUL_NUM_WAITS] = {};
+  if (events[0] == 0) {
+    for (std::size_t i = PG_CONSUL_NUM_WAITS; i-- > 0;) {
+      events[i] = WaitEventExtensionNew(pg_consul_wait_str(static_cast<ConsulWait>(i)));
+    }
+  }
+  return events[static_cast<std::size_t>(wait)];
+#else
+  (void)wait;
+  return PG_WAIT_EXTENSION;
+#endif
+}
+
+
+PgConsulWaitEvent::PgConsulWaitEvent(ConsulWait wait) {
+  pgstat_report_wait_start(pg_consul_wait_event_info(wait));
+}
+
+
+// The phase of the furthest along of the transfers still running, going by
+// the times curl records as each transfer passes its milestones.
+static ConsulWait
+pg_consul_attempts_wait(const std::vector<std::unique_ptr<ConsulAttempt>>& attempts) {
+  auto wait = ConsulWait::CONNECT;
+  for (const auto& attempt : attempts) {
+    if (attempt->done) {
+      continue;
+    }
+
+    double pretransfer = 0.0;
+    double starttransfer = 0.0;
+    auto curl = attempt->session.GetCurlHolder()->handle;
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    if (starttransfer > 0.0) {
+      return ConsulWait::RECEIVE;
+    }
+    if (pretransfer > 0.0) {
+      wait = ConsulWait::RESPONSE;
+    }
+  }
+  return wait;
+}
+
+
+// The agents requests may be sent to, rebuilt if an agent GUC has changed.
+static consul::AgentPool&
+pg_consul_agent_pool(void) {
+  if (!pgConsulAgentPoolValid) {
+    consul::AgentPool pool{pgConsulAgent};
+    if (pg_consul_agent_hosts_string != nullptr && pg_consul_agent_hosts_string[0] != '\0') {
+      std::string err;
+      if (!consul::AgentPool::InitFromList(pool, pg_consul_agent_hosts_string, pgConsulAgent.port(), err)) {
+        // Already validated by pg_consul_agent_hosts_check_hook().  Thrown
+        // rather than raised, as the caller's C++ objects are in scope.
+        throw std::invalid_argument("invalid consul.agent_hosts: " + err);
+      }
+    }
+    for (consul::AgentPool::SizeT i = 0; i < pool.size(); ++i) {
+      pool.agent(i).setTls(pgConsulAgent.tls());
+    }
+    pgConsulAgentPool = std::move(pool);
+    pgConsulAgentPoolValid = true;
+  }
+  return pgConsulAgentPool;
+}
+
+
+// DNS, TLS session and connection cache shared by every request this backend
+// makes, so repeated requests reuse a warm connection to the agent.
+static cpr::Share&
+pg_consul_share(void) {
+  static cpr::Share share;
+  return share;
+}
+
+
+// TLS settings for agents reached over HTTPS
+static cpr::SslOptions
+pg_consul_ssl_options(void) {
+  return cpr::SslOptions{pg_consul_agent_ca_file != nullptr ? pg_consul_agent_ca_file : "",
+                         pg_consul_agent_cert_file != nullptr ? pg_consul_agent_cert_file : "",
+                         pg_consul_agent_key_file != nullptr ? pg_consul_agent_key_file : ""};
+}
+
+
+// JSON documents are allocated from CurrentMemoryContext, so nothing leaks if
+// the query errors out while they're alive.  Allocation failures are reported
+// by the parser rather than via ereport(ERROR).
+static void*
+pg_consul_json_alloc(void* ctx, const std::size_t size) {
+  return MemoryContextAllocExtended(static_cast<MemoryContext>(ctx), size, MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+}
+
+
+static void
+pg_consul_json_free(void* ctx, void* ptr) {
+  pfree(ptr);
+}
+
+
+static consul::JsonAllocator
+pg_consul_json_allocator(void) {
+  consul::JsonAllocator alloc;
+  alloc.allocFn = pg_consul_json_alloc;
+  alloc.freeFn = pg_consul_json_free;
+  alloc.ctx = CurrentMemoryContext;
+  return alloc;
+}
+
+
+static cpr::HttpVersion
+pg_consul_http_version(void) {
+  return (pg_consul_agent_http2 ? cpr::HttpVersion::HTTP_2_TLS : cpr::HttpVersion::HTTP_1_1);
+}
+
+
+static consul::Agent::UrlT
+pg_consul_endpoint_url(consul::Agent& agent, Endpoint endpoint, const consul::KVPair::KeyT& key) {
+  switch (endpoint) {
+  case Endpoint::AGENT_SELF:    return agent.selfUrl();
+  case Endpoint::KV:            return agent.kvUrl(key);
+  case Endpoint::STATUS_LEADER: return agent.statusLeaderUrl();
+  case Endpoint::STATUS_PEERS:  return agent.statusPeersUrl();
+  }
+  return consul::Agent::UrlT();
+}
+
+
+// How long a request to endpoint may run before it is hedged: the
+// consul.hedge_percentile latency of recent requests, or zero if hedging is
+// disabled or there isn't enough latency data yet.
+static std::chrono::microseconds
+pg_consul_hedge_delay(Endpoint endpoint) {
+  const auto& latency = pgConsulLatency[static_cast<std::size_t>(endpoint)];
+  if (pg_consul_hedge_percentile <= 0.0 || latency.total < PG_CONSUL_LATENCY_MIN_SAMPLES) {
+    return std::chrono::microseconds::zero();
+  }
+
+  return std::chrono::microseconds(latency.percentile(pg_consul_hedge_percentile));
+}
+
+
+// Service pending interrupts.  An error raised by one, e.g. when the query has
+// been cancelled, is returned instead of being thrown, or nullptr if there was
+// none.  This keeps the longjmp within this frame, which has no C++ objects.
+static ErrorData*
+pg_consul_process_interrupts(void) {
+  const MemoryContext oldcontext = CurrentMemoryContext;
+  ErrorData* volatile edata = nullptr;
+
+  PG_TRY();
+  {
+    CHECK_FOR_INTERRUPTS();
+  }
+  PG_CATCH();
+  {
+    MemoryContextSwitchTo(oldcontext);
+    edata = CopyErrorData();
+    FlushErrorState();
+  }
+  PG_END_TRY();
+
+  return edata;
+}
+
+
+// Drive the GET(s) for pg_consul_get() with curl_multi.  The request goes to
+// the best available agent and fails over to the next best agent on transport
+// errors.  If hedging is enabled and the request is still outstanding after
+// the hedge delay, a duplicate is sent to a second agent (or to the same agent
+// if there is only one, which may still reach a different server) and the
+// first response wins.  No attempt runs past deadline.  Interrupts are
+// serviced while waiting: if one raises an error the transfers in flight are
+// cancelled and PgConsulInterrupt is thrown, otherwise the request carries on.
+static cpr::Response
+pg_consul_get_multi(Endpoint endpoint, const consul::KVPair::KeyT& key, const cpr::Parameters& params, consul::AgentPool::ClockT::time_point deadline) {
+  using ClockT = consul::AgentPool::ClockT;
+
+  auto& pool = pg_consul_agent_pool();
+  auto& latency = pgConsulLatency[static_cast<std::size_t>(endpoint)];
+  const auto hedgeDelay = pg_consul_hedge_delay(endpoint);
+  const auto sslOptions = pg_consul_ssl_options();
+  const auto httpVersion = pg_consul_http_version();
+
+  cpr::Response r{};
+  std::vector<std::unique_ptr<ConsulAttempt>> attempts;
+  std::vector<bool> tried(pool.size(), false);
+  // Declared after attempts so unfinished transfers are removed from the
+  // multi handle before their sessions are destroyed.
+  cpr::Multi multi;
+
+  // Start a GET to agent i, which its breaker has allowed, unless the
+  // deadline has passed
+  auto startAttempt = [&](const consul::AgentPool::SizeT i) {
+    const long attemptTimeoutMs = pg_consul_timeout_ms(deadline, pg_consul_agent_timeout(pool.agent(i), endpoint));
+    if (attemptTimeoutMs == 0) {
+      pgConsulGetFailure = GetFailure::DEADLINE;
+      pg_consul_breaker_release(pool.agent(i));
+      return false;
+    }
+
+    std::unique_ptr<ConsulAttempt> attempt{new ConsulAttempt};
+    attempt->agent = i;
+    attempt->timeoutMs = attemptTimeoutMs;
+    attempt->session.SetUrl(cpr::Url{pg_consul_endpoint_url(pool.agent(i), endpoint, key)});
+    attempt->session.SetShare(pg_consul_share());
+    attempt->session.SetSslOptions(sslOptions);
+    attempt->session.SetHttpVersion(httpVersion);
+    if (pg_consul_agent_compression) {
+      attempt->session.SetAcceptEncoding(cpr::AcceptEncoding{});
+    }
+    attempt->session.SetTimeout(cpr::Timeout{attemptTimeoutMs});
+    attempt->session.SetConnectTimeout(cpr::ConnectTimeout{pg_consul_connect_timeout_ms(attemptTimeoutMs)});
+    attempt->session.SetParameters(params);
+    attempt->session.PrepareGet();
+    attempt->start = ClockT::now();
+    multi.Add(attempt->session);
+    attempts.push_back(std::move(attempt));
+    tried[i] = true;
+    return true;
+  };
+
+  // Release the breakers of the attempts still running, which end without
+  // an outcome
+  auto abandonAttempts = [&]() {
+    for (auto& attempt : attempts) {
+      if (!attempt->done) {
+        pg_consul_breaker_release(pool.agent(attempt->agent));
+      }
+    }
+  };
+
+  // Next agent whose circuit breaker allows a request, or pool.size()
+  auto pickAgent = [&]() {
+    for (;;) {
+      const auto i = pool.pick(tried);
+      if (i == pool.size() || pg_consul_breaker_allow(pool.agent(i))) {
+        return i;
+      }
+      tried[i] = true;
+    }
+  };
+
+  const auto first = pickAgent();
+  if (first == pool.size()) {
+    pgConsulGetFailure = GetFailure::BREAKER_OPEN;
+    return r;
+  }
+  if (!startAttempt(first)) {
+    return r;
+  }
+  // The attempt a hedge would duplicate, and when it started.  A failover
+  // attempt takes over both, so it gets the full hedge delay as well.
+  auto hedgeFrom = first;
+  auto hedgeStart = attempts.front()->start;
+  bool hedged = (hedgeDelay == std::chrono::microseconds::zero());
+  std::size_t running = 1;
+
+  while (running > 0) {
+    if (INTERRUPTS_PENDING_CONDITION()) {
+      ErrorData* edata = pg_consul_process_interrupts();
+      if (edata != nullptr) {
+        abandonAttempts();
+        for (auto& attempt : attempts) {
+          if (!attempt->done) {
+            multi.Remove(attempt->session);
+            attempt->done = true;
+          }
+        }
+        throw PgConsulInterrupt{edata};
+      }
+    }
+
+    multi.Perform();
+    while (auto done = multi.NextDone()) {
+      running--;
+      auto it = std::find_if(attempts.begin(), attempts.end(),
+                             [done](const std::unique_ptr<ConsulAttempt>& a) { return &a->session == done; });
+      auto& attempt = **it;
+      attempt.done = true;
+
+      // curl opens no connection for a request it sends over one from its
+      // connection cache
+      long connects = 0;
+      curl_easy_getinfo(done->GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &connects);
+      if (connects == 0) {
+        PG_CONSUL_PROBE(conn_cache_hit, pg_consul_endpoint_str(endpoint), attempt.agent);
+      } else {
+        PG_CONSUL_PROBE(conn_cache_miss, pg_consul_endpoint_str(endpoint), attempt.agent);
+      }
+
+      auto resp = done->Complete();
+      const auto now = ClockT::now();
+      pg_consul_stats_record(endpoint, resp, connects == 0);
+      const auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(now - attempt.start).count();
+      PG_CONSUL_PROBE(response_received, pg_consul_endpoint_str(endpoint), attempt.agent, resp.status_code,
+                      resp.header_bytes + resp.downloaded_bytes, resp.text.size(), elapsedUs);
+      pg_consul_recent_record(endpoint, key, params, resp, done->GetCurlHolder()->handle, elapsedUs);
+      if (resp.status_code != 0) {
+        pg_consul_agent_record(pool.agent(attempt.agent), endpoint, true, elapsedUs);
+        pool.recordSuccess(attempt.agent, now - attempt.start);
+        latency.record(elapsedUs);
+        abandonAttempts();
+        return resp;
+      }
+
+      // A request that ran out of time took at least that long, which lets
+      // adaptive timeouts grow when an agent slows down.
+      const bool timedOut = (elapsedUs >= attempt.timeoutMs * 1000);
+      pg_consul_agent_record(pool.agent(attempt.agent), endpoint, false, timedOut ? elapsedUs : -1);
+
+      pool.recordFailure(attempt.agent, now);
+      r = std::move(resp);
+      if (running == 0) {
+        const auto next = pickAgent();
+        if (next != pool.size() && startAttempt(next)) {
+          hedgeFrom = next;
+          hedgeStart = attempts.back()->start;
+          running++;
+        }
+      }
+    }
+
+    if (running == 0) {
+      break;
+    }
+
+    auto waitMs = PG_CONSUL_POLL_INTERVAL_MS;
+    if (!hedged) {
+      const auto elapsed = ClockT::now() - hedgeStart;
+      if (elapsed >= hedgeDelay) {
+        hedged = true;
+        auto next = pickAgent();
+        if (next == pool.size() && pg_consul_breaker_allow(pool.agent(hedgeFrom))) {
+          next = hedgeFrom;
+        }
+        if (next != pool.size() && startAttempt(next)) {
+          running++;
+          continue;
+        }
+      }
+
+      const auto untilHedge = std::chrono::duration_cast<std::chrono::milliseconds>(hedgeDelay - elapsed).count() + 1;
+      waitMs = std::min(waitMs, static_cast<long>(untilHedge));
+    }
+
+    PgConsulWaitEvent wait{pg_consul_attempts_wait(attempts)};
+    multi.Poll(waitMs);
+  }
+
+  if (pg_consul_timeout_ms(deadline, pgConsulAgent.timeoutMs()) == 0) {
+    pgConsulGetFailure = GetFailure::DEADLINE;
+  }
+  return r;
+}
+
+
+// Time by which the current statement must be done with consul: the
+// earliest of the statement and (PG 17+) transaction timeouts that are armed,
+// or ClockT::time_point::max() if none are.  lock_timeout isn't one of them:
+// it is only armed while waiting for a heavyweight lock.
+static consul::AgentPool::ClockT::time_point
+pg_consul_deadline(void) {
+  using ClockT = consul::AgentPool::ClockT;
+
+  static const TimeoutId timeouts[] = {
+    STATEMENT_TIMEOUT,
+#if PG_VERSION_NUM >= 170000
+    TRANSACTION_TIMEOUT,
+#endif
+  };
+
+  auto deadline = ClockT::time_point::max();
+  const auto now = GetCurrentTimestamp();
+  const auto clockNow = ClockT::now();
+  for (const auto id : timeouts) {
+    if (get_timeout_active(id)) {
+      const auto remainingMs = TimestampDifferenceMilliseconds(now, get_timeout_finish_time(id));
+      deadline = std::min(deadline, clockNow + std::chrono::milliseconds(remainingMs));
+    }
+  }
+  return deadline;
+}
+
+
+// The timeout for a request: timeoutMs, shortened to what remains before
+// deadline.  0 if the deadline has passed.
+static long
+pg_consul_timeout_ms(consul::AgentPool::ClockT::time_point deadline, long timeoutMs) {
+  using ClockT = consul::AgentPool::ClockT;
+
+  if (deadline == ClockT::time_point::max()) {
+    return timeoutMs;
+  }
+
+  const auto remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ClockT::now()).count();
+  if (remainingMs <= 0) {
+    return 0;
+  }
+  return std::min(timeoutMs, static_cast<long>(remainingMs));
+}
+
+
+// Connect timeout for a request with the given total timeout
+static long
+pg_consul_connect_timeout_ms(long timeoutMs) {
+  if (pg_consul_agent_connect_timeout_ms > 0) {
+    return std::min(timeoutMs, static_cast<long>(pg_consul_agent_connect_timeout_ms));
+  }
+  return timeoutMs;
+}
+
+
+// GET endpoint from the consul agents in pg_consul_agent_pool().  Ejected
+// agents whose backoff has expired are probed first, with a short timeout, so
+// a dead agent only costs the probe.  Requests are bounded by the statement's
+// remaining time as well as consul.agent_timeout.  Throws PgConsulInterrupt
+// if the query is cancelled while waiting; callers catch it and raise the
+// error with ReThrowError() outside of their try block.
+static cpr::Response
+pg_consul_get(Endpoint endpoint, const consul::KVPair::KeyT& key, const cpr::Parameters& params) {
+  auto& pool = pg_consul_agent_pool();
+  const auto start = consul::AgentPool::ClockT::now();
+  const auto deadline = pg_consul_deadline();
+  const auto before = pgConsulBackendCounters;
+  const long probeTimeoutMs = pg_consul_timeout_ms(deadline, std::min(static_cast<long>(pgConsulAgent.timeoutMs()),
+                                                                      PG_CONSUL_AGENT_PROBE_TIMEOUT_MS));
+
+  if (probeTimeoutMs > 0) {
+    pool.probe([probeTimeoutMs](consul::Agent& agent) {
+        if (!pg_consul_breaker_allow(agent)) {
+          return cpr::Response{};
+        }
+
+        PgConsulWaitEvent wait{ConsulWait::PROBE};
+        auto r = cpr::Get(cpr::Url{agent.statusLeaderUrl()},
+                          pg_consul_share(),
+                          pg_consul_ssl_options(),
+                          pg_consul_http_version(),
+                          cpr::Timeout{probeTimeoutMs},
+                          cpr::ConnectTimeout{probeTimeoutMs});
+        pg_consul_stats_record(Endpoint::STATUS_LEADER, r, false);
+        pg_consul_agent_record(agent, Endpoint::STATUS_LEADER, r.status_code != 0, -1);
+        return r;
+      });
+  }
+
+  PG_CONSUL_PROBE(request_start, pg_consul_endpoint_str(endpoint), key.size());
+  pgConsulGetFailure = GetFailure::NONE;
+  auto r = pg_consul_get_multi(endpoint, key, params, deadline);
+  PG_CONSUL_PROBE(request_done, pg_consul_endpoint_str(endpoint), key.size(), r.status_code, r.text.size());
+  pgConsulBackendCounters.calls++;
+  pgConsulBackendCounters.timeUs += std::chrono::duration_cast<std::chrono::microseconds>(consul::AgentPool::ClockT::now() - start).count();
+  pg_consul_query_stats_record(pgConsulBackendCounters.since(before));
+  return r;
+}
+
+
+// GET a consistency-aware endpoint (i.e. /v1/kv/) using the mode selected by
+// consul.read_consistency.  Stale reads are checked against consul.max_stale
+// and retried in default mode, which is forwarded to the leader, if the
+// answering server has lost touch with the leader for too long.
+static cpr::Response
+pg_consul_read(const consul::KVPair::KeyT& key, const cpr::Parameters& params, const char* fname) {
+  const auto mode = static_cast<consul::Agent::ConsistencyT>(pg_consul_read_consistency);
+
+  cpr::Parameters readParams{params};
+  const char* modeParam = consul::Agent::ConsistencyParam(mode);
+  if (modeParam != nullptr) {
+    readParams.AddParameter({modeParam, ""});
+  }
+
+  auto r = pg_consul_get(Endpoint::KV, key, readParams);
+  if (mode != consul::Agent::ConsistencyT::STALE || pg_consul_max_stale_ms == 0 || r.status_code != 200) {
+    return r;
+  }
+
+  consul::QueryMeta meta;
+  std::string err;
+  if (consul::QueryMeta::InitFromHeaders(meta, r.header, err) && meta.knownLeader &&
+      meta.lastContactMs <= static_cast<consul::QueryMeta::LastContactT>(pg_consul_max_stale_ms)) {
+    return r;
+  }
+
+  ereport(DEBUG1,
+          (errmsg("%s() stale read exceeded consul.max_stale (last contact %lu ms ago), retrying against the leader",
+                  fname, static_cast<unsigned long>(meta.lastContactMs))));
+
+  return pg_consul_get(Endpoint::KV, key, params);
+}
+
+
+// Issue the KV GET for one of the consul_kv_get() family of functions and
+// load the response into kvps, adding the work done to instr if it isn't
+// nullptr.  Returns false if the key argument is NULL.  All other failures
+// are reported via ereport(ERROR), once the request's C++ objects are
+// destroyed.
+static bool
+pg_consul_kv_get_fetch(FunctionCallInfo fcinfo, const char* fname, PgConsulKVPairsView& kvps, ConsulInstrumentation* instr) {
+  using ClockT = consul::AgentPool::ClockT;
+
+  ErrorData* interrupt = nullptr;
+  PgConsulError error{};
+  try {
+    consul::KVPair::KeyT key;
+    if (PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_KEY_POS)) {
+      return false;
+    } else {
+      text *keyp = PG_GETARG_TEXT_P(PG_CONSUL_KV1_GET_IN_KEY_POS);
+      key.assign(VARDATA(keyp), VARSIZE(keyp) - VARHDRSZ);
+    }
+
+    bool recurseParam = false;
+    if (!PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_RECURSE_POS))
+      recurseParam = PG_GETARG_BOOL(PG_CONSUL_KV1_GET_IN_RECURSE_POS);
+
+    consul::Agent::ClusterT dcParam;
+    if (!PG_ARGISNULL(PG_CONSUL_KV1_GET_IN_CLUSTER_POS)) {
+      text *clusterp = PG_GETARG_TEXT_P(PG_CONSUL_KV1_GET_IN_CLUSTER_POS);
+      dcParam.assign(VARDATA(clusterp), VARSIZE(clusterp) - VARHDRSZ);
+    }
+
+    const consul::KVPair::IndexT casParam = 0;
+    const consul::KVPair::SessionT acquireParam;
+    const consul::KVPair::FlagsT flagsParam = 0;
+
+    auto params = cpr::Parameters();
+    if (!dcParam.empty()) {
+      params.AddParameter({"dc", dcParam});
+    }
+
+    if (recurseParam) {
+      params.AddParameter({"recurse", ""});
+    }
+
+    if (casParam) {
+      params.AddParameter({"cas", consul::KVPair::IndexStr(casParam)});
+    }
+
+    if (flagsParam) {
+      params.AddParameter({"flags", consul::KVPair::FlagsStr(flagsParam)});
+    }
+
+    if (!acquireParam.empty()) {
+      params.AddParameter({"acquire", acquireParam});
+    }
+
+    const auto before = pgConsulBackendCounters;
+    auto r = pg_consul_read(key, params, fname);
+    if (instr != nullptr) {
+      instr->counters.add(pgConsulBackendCounters.since(before));
+    }
+    if (r.status_code != 200) {
+      throw PgConsulError{ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION,
+                          psprintf("%s() returned error %ld", fname, r.status_code), true};
+    }
+
+    // The response body is handed over to kvps, which parses it in place.
+    std::string err;
+    const auto jsonSize = r.text.size();
+    const bool timing = (instr != nullptr && instr->timing);
+    const auto parseStart = (timing ? ClockT::now() : ClockT::time_point{});
+    PG_CONSUL_PROBE(json_parse_start, key.size(), jsonSize);
+    const bool parsed = PgConsulKVPairsView::InitFromJson(kvps, std::move(r.text), err, pg_consul_json_index);
+    PG_CONSUL_PROBE(json_parse_done, key.size(), jsonSize, kvps.size(), parsed);
+    if (timing) {
+      instr->parseNs += std::chrono::duration_cast<std::chrono::nanoseconds>(ClockT::now() - parseStart).count();
+    }
+    if (!parsed) {
+      throw PgConsulError{ERRCODE_FDW_REPLY_HANDLE,
+                          psprintf("Failed to load KV pairs from JSON: %s", err.c_str()), false};
+    }
+
+    if (!recurseParam && kvps.size() > 1) {
+      throw PgConsulError{ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE,
+                          psprintf("%s() performed a non-recursive GET but received %lu responses", fname, kvps.size()),
+                          false};
+    }
+  } catch (const PgConsulInterrupt& e) {
+    interrupt = e.edata;
+  } catch (const PgConsulError& e) {
+    error = e;
+  } catch (std::exception & e) {
+    error = PgConsulError{ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE,
+                          psprintf("%s() failed: %s", fname, e.what()), false};
+  }
+
+  if (interrupt != nullptr) {
+    ReThrowError(interrupt);
+  }
+  if (error.message != nullptr) {
+    pg_consul_raise(error);
+  }
+  return true;
+}
+
+static Datum
+pg_consul_kv_get_typed(FunctionCallInfo fcinfo, const char* fname, KVValueType valueType) {
+  MemoryContext oldcontext;
+  TupleDesc tupdesc;
+  ConsulGetFctx *fctx;
+  FuncCallContext *funcctx;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      ereport(ERROR,
+              (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+               errmsg("function returning record called in context "
+                      "that cannot accept type record")));
+
+    // Rows are formed from Datums, not C strings, so bless the descriptor
+    // instead of generating AttInMetadata.
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    fctx = pg_consul_fctx_new<ConsulGetFctx>(funcctx);
+    fctx->instr = pg_consul_instrumentation(fcinfo);
+
+    if (!pg_consul_kv_get_fetch(fcinfo, fname, fctx->kvps, fctx->instr)) {
+      PG_RETURN_NULL();
+    }
+
+    funcctx->max_calls = fctx->kvps.objs().size();
+
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = static_cast<ConsulGetFctx*>(funcctx->user_fctx);
+
+  if (funcctx->call_cntr < funcctx->max_calls) {
+    Datum values[PG_CONSUL_KV1_GET_TYPED_NUM_COLUMNS];
+    bool  nulls[PG_CONSUL_KV1_GET_TYPED_NUM_COLUMNS] = { false, false, false };
+
+    const auto& kvp = fctx->kvps.objs()[fctx->iter];
+    fctx->iter++;
+
+    // PG_CONSUL_KV1_GET_TYPED_COLUMN_KEY == key (TEXT)
+    values[PG_CONSUL_KV1_GET_TYPED_COLUMN_KEY] = pg_consul_text_datum(kvp.key());
+
+    // PG_CONSUL_KV1_GET_TYPED_COLUMN_VALUE == value (BOOL, INT8 or JSONB)
+    // PG_CONSUL_KV1_GET_TYPED_COLUMN_ERROR == conversion error (TEXT)
+    const auto value = pg_consul_kv_value(kvp, fctx->instr);
+
+    std::string err;
+    if (pg_consul_kv_value_to_datum(value, valueType, values[PG_CONSUL_KV1_GET_TYPED_COLUMN_VALUE], err)) {
+      values[PG_CONSUL_KV1_GET_TYPED_COLUMN_ERROR] = (Datum) 0;
+      nulls[PG_CONSUL_KV1_GET_TYPED_COLUMN_ERROR] = true;
+    } else {
+      values[PG_CONSUL_KV1_GET_TYPED_COLUMN_VALUE] = (Datum) 0;
+      nulls[PG_CONSUL_KV1_GET_TYPED_COLUMN_VALUE] = true;
+      values[PG_CONSUL_KV1_GET_TYPED_COLUMN_ERROR] = PointerGetDatum(cstring_to_text_with_len(err.data(), err.size()));
+    }
+
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    PG_CONSUL_PROBE(row_emit, funcctx->call_cntr, kvp.key().size(), tuple->t_len);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  } else {
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+
+// The value of kvp, decoded on first use, with the time taken to decode it
+// added to instr if it isn't nullptr
+static ::consul::KVPairView::ViewT
+pg_consul_kv_value(const ::consul::KVPairView& kvp, ConsulInstrumentation* instr) {
+  using ClockT = consul::AgentPool::ClockT;
+
+  const bool timing = (instr != nullptr && instr->timing);
+  const auto start = (timing ? ClockT::now() : ClockT::time_point{});
+  PG_CONSUL_PROBE(value_decode_start, kvp.key().size());
+  const auto value = kvp.value();
+  PG_CONSUL_PROBE(value_decode_done, kvp.key().size(), value.size());
+  if (timing) {
+    instr->decodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(ClockT::now() - start).count();
+  }
+  return value;
+}
+
+
+// Instrumentation of the consul_kv_get() expression fcinfo is a call of, or
+// nullptr if its executor isn't instrumented.  Repeated scans of the same
+// expression (e.g. on the inner side of a nested loop) share it.
+static ConsulInstrumentation*
+pg_consul_instrumentation(FunctionCallInfo fcinfo) {
+  const Node* expr = fcinfo->flinfo->fn_expr;
+  if (expr == nullptr || pgConsulExplainStates == nullptr) {
+    return nullptr;
+  }
+
+  // The function was looked up in the executor's per-query context
+  for (auto state = pgConsulExplainStates; state != nullptr; state = state->next) {
+    if (state->queryContext != fcinfo->flinfo->fn_mcxt) {
+      continue;
+    }
+
+    ListCell* lc;
+    foreach (lc, state->instrumentation) {
+      auto instr = static_cast<ConsulInstrumentation*>(lfirst(lc));
+      if (instr->expr == expr) {
+        return instr;
+      }
+    }
+
+    auto instr = static_cast<ConsulInstrumentation*>(MemoryContextAllocZero(state->queryContext, sizeof(ConsulInstrumentation)));
+    instr->expr = expr;
+    instr->timing = state->timing;
+    MemoryContext oldcontext = MemoryContextSwitchTo(state->queryContext);
+    state->instrumentation = lappend(state->instrumentation, instr);
+    MemoryContextSwitchTo(oldcontext);
+    return instr;
+  }
+
+  return nullptr;
+}
+
+
+#if PG_VERSION_NUM >= 180000
+// Unlink an executor's ConsulExplainState when its per-query context goes
+static void
+pg_consul_explain_state_destroy(void* arg) {
+  auto state = static_cast<ConsulExplainState*>(arg);
+  for (auto link = &pgConsulExplainStates; *link != nullptr; link = &(*link)->next) {
+    if (*link == state) {
+      *link = state->next;
+      break;
+    }
+  }
+}
+
+
+// The ConsulExplainState of the executor with the given per-query context, or
+// nullptr if it isn't instrumented
+static const ConsulExplainState*
+pg_consul_explain_state(MemoryContext queryContext) {
+  for (auto state = pgConsulExplainStates; state != nullptr; state = state->next) {
+    if (state->queryContext == queryContext) {
+      return state;
+    }
+  }
+  return nullptr;
+}
+
+
+// Add up the instrumentation of the consul_kv_get() expressions under node
+static bool
+pg_consul_explain_walker(Node* node, ConsulExplainCtx* ctx) {
+  if (node == nullptr) {
+    return false;
+  }
+
+  if (IsA(node, FuncExpr)) {
+    ListCell* lc;
+    foreach (lc, ctx->state->instrumentation) {
+      const auto instr = static_cast<const ConsulInstrumentation*>(lfirst(lc));
+      if (instr->expr == node) {
+        ctx->total.counters.add(instr->counters);
+        ctx->total.parseNs += instr->parseNs;
+        ctx->total.decodeNs += instr->decodeNs;
+        ctx->found = true;
+      }
+    }
+  }
+
+  return expression_tree_walker(node, PG_CONSUL_TREE_WALKER(pg_consul_explain_walker), ctx);
+}
+
+
+// Instrument the consul calls of executors that are themselves instrumented,
+// i.e. for EXPLAIN ANALYZE or auto_explain.log_analyze
+static void
+pg_consul_executor_start(QueryDesc* queryDesc, int eflags) {
+  if (prev_ExecutorStart_hook) {
+    prev_ExecutorStart_hook(queryDesc, eflags);
+  } else {
+    standard_ExecutorStart(queryDesc, eflags);
+  }
+
+  if (queryDesc->instrument_options == 0 || (eflags & EXEC_FLAG_EXPLAIN_ONLY) != 0) {
+    return;
+  }
+
+  const MemoryContext queryContext = queryDesc->estate->es_query_cxt;
+  auto state = static_cast<ConsulExplainState*>(MemoryContextAllocZero(queryContext, sizeof(ConsulExplainState)));
+  state->queryContext = queryContext;
+  state->timing = ((queryDesc->instrument_options & INSTRUMENT_TIMER) != 0);
+  state->callback.func = pg_consul_explain_state_destroy;
+  state->callback.arg = state;
+  MemoryContextRegisterResetCallback(queryContext, &state->callback);
+  state->next = pgConsulExplainStates;
+  pgConsulExplainStates = state;
+}
+
+
+// Show the consul work of a plan node's consul_kv_get() calls in EXPLAIN
+// ANALYZE, after the node's other details (e.g. Buffers)
+static void
+pg_consul_explain_per_node(PlanState* planstate, List* ancestors, const char* relationship, const char* plan_name, ExplainState* es) {
+  if (prev_explain_per_node_hook) {
+    prev_explain_per_node_hook(planstate, ancestors, relationship, plan_name, es);
+  }
+
+  if (!es->analyze) {
+    return;
+  }
+
+  ConsulExplainCtx ctx{};
+  ctx.state = pg_consul_explain_state(planstate->state->es_query_cxt);
+  if (ctx.state == nullptr) {
+    return;
+  }
+
+  const Plan* plan = planstate->plan;
+  if (IsA(plan, FunctionScan)) {
+    pg_consul_explain_walker(reinterpret_cast<Node*>(reinterpret_cast<const FunctionScan*>(plan)->functions), &ctx);
+  }
+  pg_consul_explain_walker(reinterpret_cast<Node*>(plan->targetlist), &ctx);
+  pg_consul_explain_walker(reinterpret_cast<Node*>(plan->qual), &ctx);
+  if (!ctx.found) {
+    return;
+  }
+
+  const auto& counters = ctx.total.counters;
+  const double waitMs = counters.timeUs / 1000.0;
+  const double parseMs = ctx.total.parseNs / 1000000.0;
+  const double decodeMs = ctx.total.decodeNs / 1000000.0;
+  if (es->format == EXPLAIN_FORMAT_TEXT) {
+    ExplainIndentText(es);
+    appendStringInfo(es->str, "Consul: calls=" UINT64_FORMAT " requests=" UINT64_FORMAT " failures=" UINT64_FORMAT
+                     " conn_reused=" UINT64_FORMAT " received=" UINT64_FORMAT " decoded=" UINT64_FORMAT "\n",
+                     counters.calls, counters.requests, counters.failures,
+                     counters.connReused, counters.bytesReceived, counters.bytesDecoded);
+    if (ctx.state->timing) {
+      ExplainIndentText(es);
+      appendStringInfo(es->str, "Consul Timing: wait=%.3f parse=%.3f decode=%.3f\n", waitMs, parseMs, decodeMs);
+    }
+  } else {
+    ExplainPropertyUInteger("Consul Calls", NULL, counters.calls, es);
+    ExplainPropertyUInteger("Consul Requests", NULL, counters.requests, es);
+    ExplainPropertyUInteger("Consul Failures", NULL, counters.failures, es);
+    ExplainPropertyUInteger("Consul Connections Reused", NULL, counters.connReused, es);
+    ExplainPropertyUInteger("Consul Bytes Received", NULL, counters.bytesReceived, es);
+    ExplainPropertyUInteger("Consul Bytes Decoded", NULL, counters.bytesDecoded, es);
+    if (ctx.state->timing) {
+      ExplainPropertyFloat("Consul Wait Time", "ms", waitMs, 3, es);
+      ExplainPropertyFloat("Consul Parse Time", "ms", parseMs, 3, es);
+      ExplainPropertyFloat("Consul Decode Time", "ms", decodeMs, 3, es);
+    }
+  }
+}
+#endif
+
+
+// A text Datum holding str, up to its first NUL (which text can't contain)
+static Datum
+pg_consul_text_datum(const ::consul::KVPairView::ViewT& str) {
+  const auto nul = str.find('\0');
+  const auto len = (nul == ::consul::KVPairView::ViewT::npos ? str.size() : nul);
+  return PointerGetDatum(cstring_to_text_with_len(str.data(), len));
+}
+
+
+// Compute the bitmask of consul_kv_get() output columns that query
+// references.  The planner doesn't tell a support function which range table
+// entry it is simplifying, so the columns of every consul_kv_get() scan in
+// query are combined.  Returns false, i.e. all columns are needed, if the
+// function is also called outside of a plain FROM clause item.
+static bool
+pg_consul_kv_get_columns(Query* query, const Oid funcid, uint32& columns) {
+  ConsulKVColumnsCtx ctx;
+  ctx.query = query;
+  ctx.rtis = nullptr;
+  ctx.funcid = funcid;
+  ctx.sublevelsUp = 0;
+  ctx.columns = 0;
+
+  ListCell* lc;
+  Index rti = 0;
+  foreach(lc, query->rtable) {
+    RangeTblEntry* rte = static_cast<RangeTblEntry*>(lfirst(lc));
+    rti++;
+    if (rte->rtekind != RTE_FUNCTION) {
+      continue;
+    }
+
+    ListCell* flc;
+    foreach(flc, rte->functions) {
+      RangeTblFunction* rtfunc = static_cast<RangeTblFunction*>(lfirst(flc));
+      if (IsA(rtfunc->funcexpr, FuncExpr) &&
+          reinterpret_cast<FuncExpr*>(rtfunc->funcexpr)->funcid == funcid) {
+        // ROWS FROM() shifts the column numbers of all but the first function
+        if (list_length(rte->functions) != 1) {
+          return false;
+        }
+        ctx.rtis = bms_add_member(ctx.rtis, static_cast<int>(rti));
+      }
+    }
+  }
+
+  if (bms_is_empty(ctx.rtis)) {
+    return false;
+  }
+
+  if (query_tree_walker(query, PG_CONSUL_TREE_WALKER(pg_consul_kv_get_columns_walker), &ctx, 0)) {
+    return false;
+  }
+
+  columns = ctx.columns;
+  return true;
+}
+
+
+// Collect the consul_kv_get() columns referenced by node.  Returns true to
+// abort the walk when all columns are needed.
+static bool
+pg_consul_kv_get_columns_walker(Node* node, ConsulKVColumnsCtx* ctx) {
+  if (node == nullptr) {
+    return false;
+  }
+
+  if (IsA(node, Var)) {
+    Var* var = reinterpret_cast<Var*>(node);
+    if (static_cast<int>(var->varlevelsup) != ctx->sublevelsUp) {
+      return false;
+    }
+
+    if (bms_is_member(static_cast<int>(var->varno), ctx->rtis)) {
+      // Whole-row reference
+      if (var->varattno <= 0) {
+        return true;
+      }
+      // Attributes past the last column are WITH ORDINALITY
+      if (var->varattno <= PG_CONSUL_KV1_GET_NUM_COLUMNS) {
+        ctx->columns |= (1u << (var->varattno - 1));
+      }
+      return false;
+    }
+
+    // Join alias variables haven't been flattened yet.  Only walk the
+    // aliases that are referenced, not the whole joinaliasvars list.
+    RangeTblEntry* rte = rt_fetch(var->varno, ctx->query->rtable);
+    if (rte->rtekind == RTE_JOIN) {
+      const int sublevelsUp = ctx->sublevelsUp;
+      bool result;
+      ctx->sublevelsUp = 0;
+      if (var->varattno <= 0) {
+        result = pg_consul_kv_get_columns_walker(reinterpret_cast<Node*>(rte->joinaliasvars), ctx);
+      } else {
+        result = pg_consul_kv_get_columns_walker(static_cast<Node*>(list_nth(rte->joinaliasvars, var->varattno - 1)), ctx);
+      }
+      ctx->sublevelsUp = sublevelsUp;
+      return result;
+    }
+    return false;
+  }
+
+  // The consul_kv_get() call of a function scan: only look at its arguments
+  if (IsA(node, RangeTblFunction)) {
+    RangeTblFunction* rtfunc = reinterpret_cast<RangeTblFunction*>(node);
+    if (IsA(rtfunc->funcexpr, FuncExpr) &&
+        reinterpret_cast<FuncExpr*>(rtfunc->funcexpr)->funcid == ctx->funcid) {
+      return expression_tree_walker(reinterpret_cast<Node*>(reinterpret_cast<FuncExpr*>(rtfunc->funcexpr)->args),
+                                    PG_CONSUL_TREE_WALKER(pg_consul_kv_get_columns_walker), ctx);
+    }
+  }
+
+  // Called anywhere else, e.g. in the target list, every column is needed
+  if (IsA(node, FuncExpr) && reinterpret_cast<FuncExpr*>(node)->funcid == ctx->funcid) {
+    return true;
+  }
+
+  if (IsA(node, Query)) {
+    ctx->sublevelsUp++;
+    const bool result = query_tree_walker(reinterpret_cast<Query*>(node),
+                                          PG_CONSUL_TREE_WALKER(pg_consul_kv_get_columns_walker), ctx, 0);
+    ctx->sublevelsUp--;
+    return result;
+  }
+
+  return expression_tree_walker(node, PG_CONSUL_TREE_WALKER(pg_consul_kv_get_columns_walker), ctx);
+}
+
+
+// Convert a decoded KV value to the requested type.  Conversion failures are
+// not fatal: they are returned via err so they can be reported per key.
+static bool
+pg_consul_kv_value_to_datum(const ::consul::KVPairView::ViewT& value, KVValueType valueType, Datum& datum, std::string& err) {
+  // Every conversion below requires a NUL terminated C string, which
+  // KVPairView::value() provides.  A value with an embedded NUL can't be any
+  // of the supported types.
+  if (value.find('\0') != ::consul::KVPairView::ViewT::npos) {
+    err = "value contains an embedded NUL byte";
+    return false;
+  }
+
+  switch (valueType) {
+  case KVValueType::BOOL: {
+    const auto trimmed = ::boost::algorithm::trim_copy(value.to_string());
+    bool result;
+    if (!parse_bool_with_len(trimmed.data(), trimmed.size(), &result)) {
+      std::ostringstream ss;
+      ss << "invalid input syntax for type boolean: \"" << value << "\"";
+      err = ss.str();
+      return false;
+    }
+    datum = BoolGetDatum(result);
+    return true;
+  }
+
+  case KVValueType::INT8: {
+    const char* begin = value.data();
+    char* end = nullptr;
+    errno = 0;
+    const long long result = std::strtoll(begin, &end, 10);
+    while (*end != '\0' && std::isspace(static_cast<unsigned char>(*end))) {
+      ++end;
+    }
+
+    if (end == begin || *end != '\0') {
+      std::ostringstream ss;
+      ss << "invalid input syntax for type bigint: \"" << value << "\"";
+      err = ss.str();
+      return false;
+    }
+
+    if (errno == ERANGE) {
+      std::ostringstream ss;
+      ss << "value \"" << value << "\" is out of range for type bigint";
+      err = ss.str();
+      return false;
+    }
+    datum = Int64GetDatum(static_cast<int64>(result));
+    return true;
+  }
+
+  case KVValueType::JSONB: {
+#if PG_VERSION_NUM >= 160000
+    // Soft error reporting lets jsonb_in() do the one and only parse.
+    ErrorSaveContext escontext = {T_ErrorSaveContext};
+    escontext.details_wanted = true;
+    if (!DirectInputFunctionCallSafe(jsonb_in, const_cast<char*>(value.data()), JSONBOID, -1,
+                                     reinterpret_cast<Node*>(&escontext), &datum)) {
+      std::ostringstream ss;
+      ss << escontext.error_data->message;
+      if (escontext.error_data->detail != nullptr) {
+        ss << ": " << escontext.error_data->detail;
+      }
+      err = ss.str();
+      return false;
+    }
+    return true;
+#else
+    // jsonb_in() can only report errors via ereport(ERROR), which would
+    // abort the whole scan.  Validate it first so malformed values are
+    // reported per key.  That only catches syntax errors: valid JSON that
+    // jsonb rejects (\u0000, unpaired surrogates, numbers out of numeric's
+    // range) still raises an ERROR, as documented in the README.
+    std::string parseErr;
+    ::consul::JsonDocument doc{pg_consul_json_allocator()};
+    if (!::consul::JsonDocument::Parse(doc, value.data(), value.size(), parseErr)) {
+      std::ostringstream ss;
+      ss << "invalid input syntax for type json: " << parseErr;
+      err = ss.str();
+      return false;
+    }
+    datum = DirectFunctionCall1(jsonb_in, CStringGetDatum(value.data()));
+    return true;
+#endif
+  }
+  }
+
+  err = "unsupported value type";
+  return false;
+}
+
+
+static void
+pg_consul_agent_host_assign_hook(const char *newHost, void *extra) {
+  // FIXME(seanc@): This is pretty dumb.  By API design we're compelled to
+  // const_cast<> from const char*, but in DefineCustomStringVariable() we
+  // can't pass nullptr for either the assignment when the function pointer
+  // is not null.  If you pass a *_assign_hook() function pointer to
+  // DefineCustom*Variable(), you can only pass a char* as an argument.  It
+  // feels like I'm missing something obvious.
+  pg_consul_agent_host_string = const_cast<char*>(newHost);
+  pgConsulAgent.setHost(newHost);
+  pgConsulAgentPoolValid = false;
+}
+
+
+static void
+pg_consul_agent_hosts_assign_hook(const char *newHosts, void *extra) {
+  pgConsulAgentPoolValid = false;
+}
+
+
+static bool
+pg_consul_agent_hosts_check_hook(char **newHosts, void **extra, GucSource source) {
+  if (newHosts == nullptr || *newHosts == nullptr || (*newHosts)[0] == '\0') {
+    // Empty list: fall back to consul.agent_host
+    return true;
+  }
+
+  consul::AgentPool pool;
+  std::string err;
+  if (!consul::AgentPool::InitFromList(pool, *newHosts, consul::Agent::DEFAULT_PORT, err)) {
+    GUC_check_errdetail("%s.", err.c_str());
+    return false;
+  }
+
+  for (const auto& agent : pool.agents()) {
+    if (!pg_consul_agent_host_check_hook(agent.host().c_str())) {
+      GUC_check_errdetail("Invalid agent host \"%s\".", agent.host().c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
 
 
 static bool
@@ -693,6 +3667,7 @@ static void
 pg_consul_agent_port_assign_hook(const int newPort, void *extra) {
   pg_consul_agent_port = static_cast<consul::Agent::PortT>(newPort); // FIXME(seanc@): Narrowing
   pgConsulAgent.setPort(newPort);
+  pgConsulAgentPoolValid = false;
 }
 
 
@@ -713,4 +3688,11 @@ pg_consul_agent_timeout_show_hook(void) {
   return pgConsulAgent.timeoutStr().c_str();
 }
 
+
+static void
+pg_consul_agent_tls_assign_hook(bool newvalue, void *extra) {
+  pgConsulAgent.setTls(newvalue);
+  pgConsulAgentPoolValid = false;
+}
+
 } // anon-namespace
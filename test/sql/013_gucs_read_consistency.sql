@@ -0,0 +1,50 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.read_consistency;
+SHOW consul.max_stale;
+
+-- PASS: Allow any consul server to answer reads
+SET consul.read_consistency = 'stale';
+SHOW consul.read_consistency;
+
+-- PASS
+SET consul.read_consistency = 'consistent';
+SHOW consul.read_consistency;
+
+-- FAIL: Not a consul consistency mode
+SET consul.read_consistency = 'eventual';
+SHOW consul.read_consistency;
+
+-- PASS: Bound the staleness of stale reads
+SET consul.max_stale = '5s';
+SHOW consul.max_stale;
+
+-- PASS
+SET consul.max_stale = 250;
+SHOW consul.max_stale;
+
+-- FAIL: Too small
+SET consul.max_stale = -1;
+SHOW consul.max_stale;
+
+-- FAIL: Too large
+SET consul.max_stale = '2d';
+SHOW consul.max_stale;
+
+-- PASS: Stale reads still return the key
+SET consul.read_consistency = 'stale';
+SELECT key, value FROM consul_kv_get(key := 'test');
+
+-- PASS: Reset
+RESET consul.read_consistency;
+SHOW consul.read_consistency;
+RESET consul.max_stale;
+SHOW consul.max_stale;
@@ -0,0 +1,44 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.agent_hosts;
+
+-- PASS: A single agent using consul.agent_port
+SET consul.agent_hosts = '127.0.0.1';
+SHOW consul.agent_hosts;
+SELECT consul_agent_ping();
+
+-- PASS: Multiple agents with explicit ports
+SET consul.agent_hosts = '127.0.0.1:8500, localhost:8500';
+SHOW consul.agent_hosts;
+SELECT consul_agent_ping();
+
+-- PASS: Fail over from an agent that isn't listening
+SET consul.agent_hosts = '127.0.0.1:1, 127.0.0.1:8500';
+SELECT consul_agent_ping();
+SELECT consul_agent_ping();
+SELECT key, value FROM consul_kv_get(key := 'test');
+
+-- FAIL: Invalid port
+SET consul.agent_hosts = '127.0.0.1:http';
+SHOW consul.agent_hosts;
+
+-- FAIL: Invalid host
+SET consul.agent_hosts = '127.0.0.1, .127.0.0.3';
+SHOW consul.agent_hosts;
+
+-- FAIL: No agents
+SET consul.agent_hosts = ',';
+SHOW consul.agent_hosts;
+
+-- PASS: Reset to consul.agent_host
+RESET consul.agent_hosts;
+SHOW consul.agent_hosts;
+SELECT consul_agent_ping();
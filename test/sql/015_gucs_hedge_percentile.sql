@@ -0,0 +1,39 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.hedge_percentile;
+
+-- PASS: Hedge reads slower than the p95 of recent reads
+SET consul.hedge_percentile = 95;
+SHOW consul.hedge_percentile;
+
+-- PASS
+SET consul.hedge_percentile = 99.9;
+SHOW consul.hedge_percentile;
+
+-- FAIL: Too small
+SET consul.hedge_percentile = -1;
+SHOW consul.hedge_percentile;
+
+-- FAIL: Too large
+SET consul.hedge_percentile = 100;
+SHOW consul.hedge_percentile;
+
+-- PASS: Hedged reads return the same results
+SET consul.hedge_percentile = 50;
+SELECT count(*) FROM generate_series(1, 25), consul_kv_get(key := 'test');
+SELECT key, value FROM consul_kv_get(key := 'test');
+SET consul.agent_hosts = '127.0.0.1:8500, localhost:8500';
+SELECT key, value FROM consul_kv_get(key := 'test');
+
+-- PASS: Reset
+RESET consul.agent_hosts;
+RESET consul.hedge_percentile;
+SHOW consul.hedge_percentile;
@@ -0,0 +1,47 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.breaker_threshold;
+SHOW consul.breaker_reset_timeout;
+
+-- PASS
+SET consul.breaker_threshold = 2;
+SHOW consul.breaker_threshold;
+SET consul.breaker_reset_timeout = '1min';
+SHOW consul.breaker_reset_timeout;
+
+-- FAIL: Too small
+SET consul.breaker_threshold = -1;
+SET consul.breaker_reset_timeout = 0;
+
+-- PASS: A healthy agent has a closed breaker
+SELECT host, port, state FROM consul_circuit_breakers WHERE port = 8500 AND host = '127.0.0.1';
+
+-- PASS: Open the breaker of an agent that isn't listening
+SET consul.agent_hosts = '127.0.0.1:1';
+SELECT consul_agent_ping();
+SELECT consul_agent_ping();
+SELECT host, port, state, trips > 0 AS tripped, retry_at > now() AS waiting FROM consul_circuit_breakers WHERE port = 1;
+
+-- FAIL: Calls fail fast while the breaker is open
+SELECT consul_agent_ping();
+SELECT * FROM consul_kv_get(key := 'test');
+SELECT rejections > 0 AS rejected FROM consul_circuit_breakers WHERE port = 1;
+
+-- PASS: Healthy agents are unaffected
+SET consul.agent_hosts = '127.0.0.1:1, 127.0.0.1:8500';
+SELECT key, value FROM consul_kv_get(key := 'test');
+
+-- PASS: Reset
+RESET consul.agent_hosts;
+RESET consul.breaker_threshold;
+RESET consul.breaker_reset_timeout;
+SHOW consul.breaker_threshold;
+SHOW consul.breaker_reset_timeout;
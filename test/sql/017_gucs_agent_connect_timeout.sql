@@ -0,0 +1,38 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.agent_connect_timeout;
+
+-- PASS: Fail fast on agents that can't be reached
+SET consul.agent_connect_timeout = 100;
+SHOW consul.agent_connect_timeout;
+
+-- PASS
+SET consul.agent_connect_timeout = '1s';
+SHOW consul.agent_connect_timeout;
+
+-- FAIL: Too small
+SET consul.agent_connect_timeout = -1;
+SHOW consul.agent_connect_timeout;
+
+-- FAIL: Too large
+SET consul.agent_connect_timeout = 65536;
+SHOW consul.agent_connect_timeout;
+
+-- PASS: Requests fit within the statement's remaining time
+SET statement_timeout = '5s';
+SELECT consul_agent_ping();
+SELECT consul_agent_ping('127.0.0.1');
+SELECT key, value FROM consul_kv_get(key := 'test');
+
+-- PASS: Reset
+RESET statement_timeout;
+RESET consul.agent_connect_timeout;
+SHOW consul.agent_connect_timeout;
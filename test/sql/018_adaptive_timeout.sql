@@ -0,0 +1,54 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.adaptive_timeout;
+SHOW consul.adaptive_timeout_percentile;
+SHOW consul.adaptive_timeout_factor;
+SHOW consul.adaptive_timeout_min;
+
+-- PASS
+SET consul.adaptive_timeout = on;
+SHOW consul.adaptive_timeout;
+SET consul.adaptive_timeout_percentile = 99.9;
+SHOW consul.adaptive_timeout_percentile;
+SET consul.adaptive_timeout_factor = 2.5;
+SHOW consul.adaptive_timeout_factor;
+SET consul.adaptive_timeout_min = '200ms';
+SHOW consul.adaptive_timeout_min;
+
+-- FAIL: Out of range
+SET consul.adaptive_timeout_percentile = 10;
+SET consul.adaptive_timeout_percentile = 100;
+SET consul.adaptive_timeout_factor = 0.5;
+SET consul.adaptive_timeout_min = 0;
+
+-- PASS: consul.agent_timeout is used until there is enough latency data
+SELECT count(*) FROM generate_series(1, 25) WHERE consul_agent_ping();
+SELECT host, port, samples >= 20 AS enough, p50_ms <= p99_ms AS ordered FROM consul_agent_timeouts WHERE port = 8500 AND endpoint = 'agent_self';
+
+-- PASS: A fast agent gets consul.adaptive_timeout_min
+SELECT consul_agent_ping();
+SELECT timeout_ms FROM consul_agent_timeouts WHERE port = 8500 AND endpoint = 'agent_self';
+
+-- PASS: consul.agent_timeout is the upper bound
+SET consul.agent_timeout = '100ms';
+SELECT consul_agent_ping();
+SELECT timeout_ms FROM consul_agent_timeouts WHERE port = 8500 AND endpoint = 'agent_self';
+
+-- PASS: Reset
+RESET consul.agent_timeout;
+RESET consul.adaptive_timeout;
+RESET consul.adaptive_timeout_percentile;
+RESET consul.adaptive_timeout_factor;
+RESET consul.adaptive_timeout_min;
+SHOW consul.adaptive_timeout;
+SHOW consul.adaptive_timeout_percentile;
+SHOW consul.adaptive_timeout_factor;
+SHOW consul.adaptive_timeout_min;
@@ -0,0 +1,41 @@
+-- Make sure the module is loaded.
+--
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  WHy isn't _PG_init() called upon new
+-- connection from a client?  Something's broken here that I don't understand
+-- yet and the oversight isn't jumping out at me.  Moving on, but marking
+-- this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.agent_tls;
+SHOW consul.agent_http2;
+SHOW consul.agent_ca_file;
+SHOW consul.agent_cert_file;
+SHOW consul.agent_key_file;
+
+-- PASS
+SET consul.agent_http2 = off;
+SHOW consul.agent_http2;
+SET consul.agent_ca_file = '/etc/consul.d/ca.pem';
+SHOW consul.agent_ca_file;
+SET consul.agent_cert_file = '/etc/consul.d/client.pem';
+SHOW consul.agent_cert_file;
+SET consul.agent_key_file = '/etc/consul.d/client-key.pem';
+SHOW consul.agent_key_file;
+
+-- FAIL: The test agent doesn't speak HTTPS
+SET consul.agent_tls = on;
+SHOW consul.agent_tls;
+SELECT consul_agent_ping();
+
+-- PASS: Reset
+RESET consul.agent_tls;
+RESET consul.agent_http2;
+RESET consul.agent_ca_file;
+RESET consul.agent_cert_file;
+RESET consul.agent_key_file;
+SHOW consul.agent_tls;
+SHOW consul.agent_http2;
+SHOW consul.agent_ca_file;
+SELECT consul_agent_ping();
@@ -17,3 +17,12 @@ SELECT * FROM consul_kv_get(key := 'test', cluster := 'pgc1');
 SELECT * FROM consul_kv_get(key := 'test', cluster := 'non-cluster');
 SELECT * FROM consul_kv_get(key := 'test/key1');
 SELECT key, value, flags, session IS NULL FROM consul_kv_get(key := 'test/key2');
+
+-- Stop a recursive scan before its last row
+SELECT key FROM consul_kv_get(key := 'test', recurse := TRUE) LIMIT 1;
+
+-- The same rows with the JSON index enabled
+SET consul.json_index = on;
+SHOW consul.json_index;
+SELECT * FROM consul_kv_get(key := 'test', recurse := TRUE);
+RESET consul.json_index;
@@ -0,0 +1,17 @@
+-- Make sure the module is loaded.
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  Something's broken here that I don't
+-- understand yet and the oversight isn't jumping out at me.  Moving on, but
+-- marking this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Only the referenced columns are requested from consul_kv_get()
+EXPLAIN (VERBOSE, COSTS OFF) SELECT key, modify_index FROM consul_kv_get('test', TRUE);
+EXPLAIN (VERBOSE, COSTS OFF) SELECT key FROM consul_kv_get('test', TRUE) WHERE flags = 0;
+SELECT key, modify_index FROM consul_kv_get('test', TRUE);
+SELECT count(*) FROM consul_kv_get('test', TRUE);
+
+-- PASS: All columns are needed
+EXPLAIN (VERBOSE, COSTS OFF) SELECT * FROM consul_kv_get('test');
+EXPLAIN (VERBOSE, COSTS OFF) SELECT kv FROM consul_kv_get('test') AS kv;
+SELECT key, value FROM consul_kv_get('test', TRUE) ORDER BY modify_index DESC;
@@ -0,0 +1,19 @@
+-- Make sure the module is loaded.
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  Something's broken here that I don't
+-- understand yet and the oversight isn't jumping out at me.  Moving on, but
+-- marking this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Values converted directly to their SQL type
+SELECT * FROM consul_kv_get_bool(key := 'typed/bool');
+SELECT * FROM consul_kv_get_int8(key := 'typed/int');
+SELECT * FROM consul_kv_get_jsonb(key := 'typed/json');
+SELECT value->'replicas' AS replicas FROM consul_kv_get_jsonb(key := 'typed/json');
+
+-- PASS: Conversion errors are reported per key, not for the whole scan
+SELECT * FROM consul_kv_get_int8(key := 'typed/', recurse := TRUE) ORDER BY key;
+SELECT key, value, error IS NULL AS converted FROM consul_kv_get_bool(key := 'typed/', recurse := TRUE) ORDER BY key;
+
+-- FAIL: Missing keys are still an error
+SELECT * FROM consul_kv_get_jsonb(key := 'does-not-exist');
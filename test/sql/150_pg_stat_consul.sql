@@ -0,0 +1,22 @@
+-- Make sure the module is loaded.
+-- FIXME(seanc@): this is broken.  Why do I have to call the function to
+-- initialize the shared object?  Something's broken here that I don't
+-- understand yet and the oversight isn't jumping out at me.  Moving on, but
+-- marking this as a bug.
+SELECT consul_agent_ping();
+
+-- PASS: Make sure extension parameters are present
+SHOW consul.agent_compression;
+
+-- PASS: Every endpoint has a row
+SELECT endpoint FROM pg_stat_consul ORDER BY endpoint;
+
+-- PASS: Requests and bytes are counted, with and without compression
+SELECT * FROM consul_kv_get(key := 'test');
+SET consul.agent_compression = off;
+SELECT * FROM consul_kv_get(key := 'test');
+SELECT requests >= 2 AS counted, bytes_received > 0 AS received, bytes_decoded >= bytes_received AS decoded FROM pg_stat_consul WHERE endpoint = 'kv';
+
+-- PASS: Reset
+RESET consul.agent_compression;
+SHOW consul.agent_compression;
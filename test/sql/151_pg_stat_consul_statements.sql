@@ -0,0 +1,34 @@
+-- Make sure the module is loaded.
+SELECT consul_agent_ping();
+
+CREATE TEMP TABLE consul_statements_before AS
+  SELECT coalesce(sum(calls), 0) AS calls FROM pg_stat_consul_statements;
+
+-- PASS: Statements are only tracked with a query id
+SET compute_query_id = off;
+SELECT key FROM consul_kv_get(key := 'test');
+SELECT coalesce(sum(calls), 0) - (SELECT calls FROM consul_statements_before) AS tracked FROM pg_stat_consul_statements;
+
+-- PASS: Requests, time and bytes are counted against the statement
+SET compute_query_id = on;
+SELECT key FROM consul_kv_get(key := 'test');
+SELECT key FROM consul_kv_get(key := 'test');
+SELECT coalesce(sum(calls), 0) - (SELECT calls FROM consul_statements_before) AS tracked FROM pg_stat_consul_statements;
+SELECT bool_or(calls >= 2 AND requests >= calls AND total_time > 0 AND bytes_received > 0) AS counted
+  FROM pg_stat_consul_statements
+ WHERE dbid = (SELECT oid FROM pg_database WHERE datname = current_database());
+
+-- PASS: Only members of pg_read_all_stats see other users' statements
+CREATE ROLE regress_consul_stats;
+SET ROLE regress_consul_stats;
+SELECT count(*) AS others FROM pg_stat_consul_statements WHERE userid <> 'regress_consul_stats'::regrole;
+RESET ROLE;
+GRANT pg_read_all_stats TO regress_consul_stats;
+SET ROLE regress_consul_stats;
+SELECT count(*) > 0 AS others FROM pg_stat_consul_statements WHERE userid <> 'regress_consul_stats'::regrole;
+RESET ROLE;
+DROP ROLE regress_consul_stats;
+
+-- PASS: Reset
+RESET compute_query_id;
+DROP TABLE consul_statements_before;
@@ -0,0 +1,27 @@
+-- Make sure the module is loaded.
+SELECT consul_agent_ping();
+
+CREATE FUNCTION explain_consul(query TEXT, do_analyze BOOL) RETURNS JSONB LANGUAGE plpgsql AS $$
+DECLARE
+  plan JSON;
+BEGIN
+  EXECUTE format('EXPLAIN (ANALYZE %s, FORMAT JSON) %s', do_analyze, query) INTO plan;
+  RETURN plan::JSONB -> 0 -> 'Plan';
+END
+$$;
+
+-- PASS: EXPLAIN ANALYZE shows the consul work of the node that called consul
+-- (PostgreSQL 18 and later, see 152_explain_consul_1.out)
+SELECT node ->> 'Node Type' AS node,
+       node -> 'Consul Calls' AS calls,
+       (node ->> 'Consul Requests')::INT8 >= 1 AS requests,
+       (node ->> 'Consul Bytes Received')::INT8 > 0 AS received,
+       (node ->> 'Consul Wait Time')::FLOAT8 > 0 AS waited,
+       node ? 'Consul Parse Time' AND node ? 'Consul Decode Time' AS timed
+  FROM explain_consul($$SELECT key, value FROM consul_kv_get(key := 'test')$$, true) AS node;
+
+-- PASS: EXPLAIN without ANALYZE doesn't
+SELECT node ? 'Consul Calls' AS shown
+  FROM explain_consul($$SELECT key, value FROM consul_kv_get(key := 'test')$$, false) AS node;
+
+DROP FUNCTION explain_consul(TEXT, BOOL);
@@ -0,0 +1,23 @@
+-- Make sure the module is loaded.
+SELECT consul_agent_ping();
+
+-- PASS: Requests to agents are recorded with their key, dc, status, bytes
+-- and phase times
+SELECT * FROM consul_kv_get(key := 'test', cluster := 'pgc1');
+SELECT endpoint, key, dc, status, host IS NOT NULL AS host, bytes_received > 0 AS received,
+       bytes_decoded > 0 AS decoded, dns_ms <= connect_ms AND connect_ms <= first_byte_ms AND first_byte_ms <= total_ms AS phases,
+       started_at <= now() AS started
+  FROM pg_consul_recent_requests
+ WHERE pid = pg_backend_pid()
+ ORDER BY started_at DESC
+ LIMIT 1;
+
+-- PASS: Only the most recent requests are kept
+SELECT count(*) <= 1024 AS bounded FROM pg_consul_recent_requests;
+
+-- PASS: Other roles can't read them
+CREATE ROLE regress_consul_nobody;
+SET ROLE regress_consul_nobody;
+SELECT count(*) FROM pg_consul_recent_requests;
+RESET ROLE;
+DROP ROLE regress_consul_nobody;
@@ -0,0 +1,9 @@
+-- Make sure the module is loaded.
+SELECT consul_agent_ping();
+
+-- PASS: The wait events reported while waiting on consul are named
+-- (PostgreSQL 17 and later, see 154_consul_wait_events_1.out)
+SELECT name
+  FROM pg_wait_events
+ WHERE type = 'Extension' AND name LIKE 'Consul%'
+ ORDER BY name;
@@ -0,0 +1,29 @@
+-- PASS: Updating from 0.1.0 gives the same objects as a fresh install
+CREATE TEMP TABLE fresh AS
+  SELECT pg_describe_object(classid, objid, 0) AS object
+    FROM pg_depend
+   WHERE refclassid = 'pg_extension'::regclass AND deptype = 'e'
+     AND refobjid = (SELECT oid FROM pg_extension WHERE extname = 'pg_consul');
+SET client_min_messages = warning;
+DROP EXTENSION pg_consul CASCADE;
+CREATE EXTENSION pg_consul VERSION '0.1.0';
+RESET client_min_messages;
+ALTER EXTENSION pg_consul UPDATE;
+SELECT extversion FROM pg_extension WHERE extname = 'pg_consul';
+(SELECT object FROM fresh
+  EXCEPT
+ SELECT pg_describe_object(classid, objid, 0)
+   FROM pg_depend
+  WHERE refclassid = 'pg_extension'::regclass AND deptype = 'e'
+    AND refobjid = (SELECT oid FROM pg_extension WHERE extname = 'pg_consul'))
+UNION ALL
+(SELECT pg_describe_object(classid, objid, 0)
+   FROM pg_depend
+  WHERE refclassid = 'pg_extension'::regclass AND deptype = 'e'
+    AND refobjid = (SELECT oid FROM pg_extension WHERE extname = 'pg_consul')
+  EXCEPT
+ SELECT object FROM fresh);
+
+-- PASS: consul_kv_get() has its planner support function
+SELECT oid::regprocedure AS function FROM pg_proc
+ WHERE prosupport = 'consul_kv_get_support'::regproc;